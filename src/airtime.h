@@ -62,6 +62,9 @@ class AirTime : private concurrency::OSThread
     bool isTxAllowedChannelUtil(bool polite = false);
     bool isTxAllowedAirUtil();
 
+    /// The channel utilization polite senders stay below
+    uint8_t getPoliteChannelUtilPercent() { return polite_channel_util_percent; }
+
   private:
     bool firstTime = true;
     uint8_t lastUtilPeriod = 0;
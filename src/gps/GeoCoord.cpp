@@ -424,6 +424,91 @@ float GeoCoord::bearing(double lat1, double lon1, double lat2, double lon2)
     return atan2(y, x);
 }
 
+/// cos() of whole degrees from 0 to 90, interpolated linearly in between (to within 4e-5)
+static const float cosTable[91] = {
+    1.0000000f, 0.9998477f, 0.9993908f, 0.9986295f, 0.9975641f, 0.9961947f, 0.9945219f, 0.9925462f,
+    0.9902681f, 0.9876883f, 0.9848078f, 0.9816272f, 0.9781476f, 0.9743701f, 0.9702957f, 0.9659258f,
+    0.9612617f, 0.9563048f, 0.9510565f, 0.9455186f, 0.9396926f, 0.9335804f, 0.9271839f, 0.9205049f,
+    0.9135455f, 0.9063078f, 0.8987940f, 0.8910065f, 0.8829476f, 0.8746197f, 0.8660254f, 0.8571673f,
+    0.8480481f, 0.8386706f, 0.8290376f, 0.8191520f, 0.8090170f, 0.7986355f, 0.7880108f, 0.7771460f,
+    0.7660444f, 0.7547096f, 0.7431448f, 0.7313537f, 0.7193398f, 0.7071068f, 0.6946584f, 0.6819984f,
+    0.6691306f, 0.6560590f, 0.6427876f, 0.6293204f, 0.6156615f, 0.6018150f, 0.5877853f, 0.5735764f,
+    0.5591929f, 0.5446390f, 0.5299193f, 0.5150381f, 0.5000000f, 0.4848096f, 0.4694716f, 0.4539905f,
+    0.4383711f, 0.4226183f, 0.4067366f, 0.3907311f, 0.3746066f, 0.3583679f, 0.3420201f, 0.3255682f,
+    0.3090170f, 0.2923717f, 0.2756374f, 0.2588190f, 0.2419219f, 0.2249511f, 0.2079117f, 0.1908090f,
+    0.1736482f, 0.1564345f, 0.1391731f, 0.1218693f, 0.1045285f, 0.0871557f, 0.0697565f, 0.0523360f,
+    0.0348995f, 0.0174524f, 0.0000000f,
+};
+
+static float cosDegreesFast(float deg)
+{
+    deg = fabsf(deg);
+    if (deg >= 90)
+        return 0;
+    int i = (int)deg;
+    return cosTable[i] + (deg - i) * (cosTable[i + 1] - cosTable[i]);
+}
+
+/// atan2() to within 0.0015 radians, from a polynomial fit of atan() between 0 and 1
+static float atan2Fast(float y, float x)
+{
+    float ax = fabsf(x), ay = fabsf(y);
+    if (ax == 0 && ay == 0)
+        return 0;
+    float z = ax > ay ? ay / ax : ax / ay;
+    float a = (float)(PI / 4) * z - z * (z - 1) * (0.2447f + 0.0663f * z);
+    if (ay > ax)
+        a = (float)(PI / 2) - a;
+    if (x < 0)
+        a = (float)PI - a;
+    return y < 0 ? -a : a;
+}
+
+/**
+ * Project point b onto the plane tangent to the globe halfway between the points, with point a at the origin
+ *
+ * @param convergence receives how much the meridians turn from a to b, in radians
+ * @return false if the points are too far apart, or too close to a pole, for the plane to be accurate
+ */
+static bool toFlat(int32_t lat_a, int32_t lng_a, int32_t lat_b, int32_t lng_b, float &east, float &north, float &convergence)
+{
+    // Same earth radius as latLongToMeter(), so both agree
+    const float metersPerUnit = (float)(6366000 * PI / 180 * 1e-7);
+
+    int32_t meanLat = lat_a / 2 + lat_b / 2;
+    if (abs(meanLat) > GEO_FAST_MAX_LATITUDE * 10000000)
+        return false;
+    int64_t dLng = (int64_t)lng_b - lng_a;
+    if (dLng > 1800000000)
+        dLng -= 3600000000LL;
+    else if (dLng < -1800000000)
+        dLng += 3600000000LL;
+
+    north = (float)((int64_t)lat_b - lat_a) * metersPerUnit;
+    east = (float)dLng * metersPerUnit * cosDegreesFast(meanLat * 1e-7f);
+    float sinMeanLat = cosDegreesFast(90 - fabsf(meanLat * 1e-7f));
+    convergence = (float)dLng * (float)(PI / 180 * 1e-7) * (meanLat < 0 ? -sinMeanLat : sinMeanLat);
+    return fabsf(north) <= GEO_FAST_MAX_METERS && fabsf(east) <= GEO_FAST_MAX_METERS;
+}
+
+float GeoCoord::latLongToMeterFast(int32_t lat_a, int32_t lng_a, int32_t lat_b, int32_t lng_b)
+{
+    float east, north, convergence;
+    if (!toFlat(lat_a, lng_a, lat_b, lng_b, east, north, convergence))
+        return latLongToMeter(lat_a * 1e-7, lng_a * 1e-7, lat_b * 1e-7, lng_b * 1e-7);
+    return sqrtf(east * east + north * north);
+}
+
+float GeoCoord::bearingFast(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2)
+{
+    float east, north, convergence;
+    if (!toFlat(lat1, lon1, lat2, lon2, east, north, convergence))
+        return bearing(lat1 * 1e-7, lon1 * 1e-7, lat2 * 1e-7, lon2 * 1e-7);
+    // The plane is aligned with the meridian halfway, at point 1 the meridian is turned by half the convergence
+    float b = atan2Fast(east, north) - convergence / 2;
+    return b > (float)PI ? b - (float)(2 * PI) : b < (float)-PI ? b + (float)(2 * PI) : b;
+}
+
 /**
  * Ported from http://www.edwilliams.org/avform147.htm#Intro
  * @brief Convert from meters to range in radians on a great circle
@@ -13,6 +13,12 @@
 #define OLC_CODE_LEN 11
 #define DEG_CONVERT (180 / PI)
 
+/// Beyond this distance, or this close to a pole, the fast distance and bearing fall back to the exact ones
+#ifndef GEO_FAST_MAX_METERS
+#define GEO_FAST_MAX_METERS 20000
+#endif
+#define GEO_FAST_MAX_LATITUDE 80
+
 // Helper functions
 // Raises a number to an exponent, handling negative exponents.
 static inline double pow_neg(double base, double exponent)
@@ -118,6 +124,15 @@ class GeoCoord
     static float rangeRadiansToMeters(double range_radians);
     static float rangeMetersToRadians(double range_meters);
 
+    /**
+     * Fast distance and bearing between points in 1e-7 degrees (like in positions), in float math with a cosine table, for
+     * FPU-less MCUs.  They treat the short hop between the points as flat (equirectangular approximation), which is within
+     * 0.1% of latLongToMeter() and 0.1 degree of bearing() up to GEO_FAST_MAX_METERS, and fall back to them beyond it.  Use
+     * them where the points are usually close and a display or threshold is all that depends on the result.
+     */
+    static float latLongToMeterFast(int32_t lat_a, int32_t lng_a, int32_t lat_b, int32_t lng_b);
+    static float bearingFast(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2);
+
     // Point to point conversions
     int32_t distanceTo(const GeoCoord &pointB);
     int32_t bearingTo(const GeoCoord &pointB);
@@ -82,7 +82,9 @@ NRF52Bluetooth *nrf52Bluetooth;
 #ifdef ARCH_PORTDUINO
 #include "linux/LinuxHardwareI2C.h"
 #include "mesh/raspihttp/PiWebServer.h"
+#include "platform/portduino/MeshSimulator.h"
 #include "platform/portduino/PortduinoGlue.h"
+#include "platform/portduino/RadioTrace.h"
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -236,6 +238,12 @@ void setup()
 
     serialSinceMsec = millis();
 
+#ifdef ARCH_PORTDUINO
+    // The simulator doesn't need any of the hardware or services below, it only borrows the mesh code
+    if (simScenarioPath)
+        exit(runMeshSimulation(simScenarioPath));
+#endif
+
     LOG_INFO("\n\n//\\ E S H T /\\ S T / C\n\n");
 
     initDeepSleep();
@@ -959,6 +967,13 @@ void setup()
                                                          1000);
     }
 
+#ifdef ARCH_PORTDUINO
+    if (settingsStrings[radiotracepath] != "")
+        radioTraceRecorder = new RadioTraceRecorder(settingsStrings[radiotracepath].c_str());
+    if (replayTracePath)
+        new RadioTraceReplayer(replayTracePath, replaySpeed);
+#endif
+
     // This must be _after_ service.init because we need our preferences loaded from flash to have proper timeout values
     PowerFSM_setup(); // we will transition to ON in a couple of seconds, FIXME, only do this for cold boots, not waking from SDS
     powerFSMthread = new PowerFSMThread();
@@ -200,6 +200,8 @@ void Channels::onConfigChanged()
             primaryIndex = i;
     }
 #if !MESHTASTIC_EXCLUDE_MQTT
+    if (mqtt)
+        mqtt->onChannelsChanged();
     if (channels.anyMqttEnabled() && mqtt && !mqtt->isEnabled()) {
         LOG_DEBUG("MQTT is enabled on at least one channel, so set MQTT thread to run immediately\n");
         mqtt->start();
@@ -296,6 +298,11 @@ bool Channels::hasDefaultChannel()
     return false;
 }
 
+bool Channels::isPublic(ChannelIndex chIndex)
+{
+    return getByIndex(chIndex).settings.psk.size <= 1;
+}
+
 /** Given a channel hash setup crypto for decoding that channel (or the primary channel if that channel is unsecured)
  *
  * This method is called before decoding inbound packets
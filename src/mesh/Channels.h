@@ -86,6 +86,9 @@ class Channels
     // Returns true if we can be reached via a channel with the default settings given a region and modem preset
     bool hasDefaultChannel();
 
+    // Returns true if anyone can read this channel, as it has no key or one of the well-known single byte ones
+    bool isPublic(ChannelIndex chIndex);
+
     // Returns true if any of our channels have enabled MQTT uplink or downlink
     bool anyMqttEnabled();
 
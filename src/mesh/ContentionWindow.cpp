@@ -0,0 +1,88 @@
+#include "ContentionWindow.h"
+#include "configuration.h"
+#include <algorithm>
+#include <math.h>
+
+// The range of LoRa SNRs rebroadcast delays are spread over
+#define SNR_MIN -20
+#define SNR_MAX 15
+
+/// Weight of a new observation in the moving averages
+#define CW_EWMA_ALPHA (1.0f / 16)
+
+/// How many CW sizes full congestion adds on top of the density based size
+#define CW_CONGESTION_STEPS 3
+
+/// How far the rebroadcast window reaches above the density based size, to leave room for the SNR weighting
+#define CW_FLOOD_SPREAD 3
+
+uint32_t ContentionWindow::getTxDelayMsec(float channelUtil, uint32_t slotTimeMsec)
+{
+    return random(0, 1 << getCWsize(channelUtil)) * slotTimeMsec;
+}
+
+uint32_t ContentionWindow::getTxDelayMsecWeighted(float channelUtil, float snr, bool isRouter, uint32_t slotTimeMsec)
+{
+    uint8_t CWsize = getFloodCWsize(channelUtil, snr);
+    if (isRouter)
+        return random(0, 2 * CWsize) * slotTimeMsec;
+
+    // offset the maximum delay for routers: (2 * CWmax * slotTimeMsec)
+    return (2 * CWmax * slotTimeMsec) + random(0, 1 << CWsize) * slotTimeMsec;
+}
+
+uint8_t FixedContentionWindow::getCWsize(float channelUtil)
+{
+    return map(channelUtil, 0, 100, CWmin, CWmax);
+}
+
+uint8_t FixedContentionWindow::getFloodCWsize(float channelUtil, float snr)
+{
+    //  high SNR = large CW size (Long Delay)
+    //  low SNR = small CW size (Short Delay)
+    return map(constrain(snr, SNR_MIN, SNR_MAX), SNR_MIN, SNR_MAX, CWmin, CWmax);
+}
+
+void AdaptiveContentionWindow::reset()
+{
+    duplicateRatio = 0;
+    congestion = 0;
+}
+
+void AdaptiveContentionWindow::onPacketHeard(bool duplicate)
+{
+    duplicateRatio += CW_EWMA_ALPHA * ((duplicate ? 1 : 0) - duplicateRatio);
+}
+
+void AdaptiveContentionWindow::updateCongestion(bool failed)
+{
+    congestion += CW_EWMA_ALPHA * ((failed ? 1 : 0) - congestion);
+}
+
+float AdaptiveContentionWindow::getDensityCWsize() const
+{
+    // With a fraction r of duplicates we hear every packet 1 / (1 - r) times, i.e. that many nodes around us relay it.
+    // Thanks to rebroadcast cancelling that's usually far fewer than our neighbors, who are only an upper bound.
+    float contenders = 1 / std::max(1 - duplicateRatio, 1.0f / 64);
+    if (neighbors)
+        contenders = std::min(contenders, (float)neighbors);
+
+    // Two slots per contender keeps the chance of picking the same slot as someone else low
+    return log2f(2 * contenders);
+}
+
+uint8_t AdaptiveContentionWindow::getCWsize(float channelUtil)
+{
+    // Our own packets mostly contend with other nodes' own packets, so the load matters here rather than density
+    float CWsize = CWmin + channelUtil / 100 * (CWmax - CWmin) + congestion * CW_CONGESTION_STEPS;
+    return constrain(lroundf(CWsize), CWmin, CWmax);
+}
+
+uint8_t AdaptiveContentionWindow::getFloodCWsize(float channelUtil, float snr)
+{
+    // The same SNR weighting as the fixed window, over a range sized for the nodes that will rebroadcast with us
+    uint8_t low = getCWsize(channelUtil);
+    long high = lroundf(getDensityCWsize() + congestion * CW_CONGESTION_STEPS) + CW_FLOOD_SPREAD;
+    high = constrain(high, low, CWmax);
+    return map(constrain(snr, SNR_MIN, SNR_MAX), SNR_MIN, SNR_MAX, low, high);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+/// Build with -DMESHTASTIC_ADAPTIVE_CW=1 to use AdaptiveContentionWindow instead of the fixed mapping
+#ifndef MESHTASTIC_ADAPTIVE_CW
+#define MESHTASTIC_ADAPTIVE_CW 0
+#endif
+
+/**
+ * Decides the contention window (CW) for our transmissions: before sending, we wait a random number of slots out of
+ * 2^CWsize, so nodes that want to transmit at the same time are unlikely to collide.
+ *
+ * RadioInterface owns one and feeds it what the radio and router observe, so policies can adapt to the channel.
+ * Policies don't touch any globals, which lets the mesh simulator run one per virtual node and compare them.
+ */
+class ContentionWindow
+{
+  public:
+    const uint8_t CWmin = 2; // minimum CWsize
+    const uint8_t CWmax = 8; // maximum CWsize
+
+    virtual ~ContentionWindow() {}
+
+    /// Name for logs and simulator reports
+    virtual const char *getName() const = 0;
+
+    /// CW size for sending our own packets
+    virtual uint8_t getCWsize(float channelUtil) = 0;
+
+    /**
+     * CW size for rebroadcasting a packet we received with this SNR.  The better the SNR, the longer we wait, so that
+     * nodes further away (which cover more new ground) get to rebroadcast first.
+     */
+    virtual uint8_t getFloodCWsize(float channelUtil, float snr) = 0;
+
+    /// Forget what was learned about the channel, because the modem settings changed
+    virtual void reset() {}
+
+    /// The radio received a frame, crcOk is false if it was corrupted (most likely by a collision)
+    virtual void onFrameReceived(bool crcOk) {}
+
+    /// The router heard a packet, duplicate if we had seen it before (i.e. another node rebroadcast it as well)
+    virtual void onPacketHeard(bool duplicate) {}
+
+    /// One of our reliable packets was acked, or it wasn't acked in time and is retransmitted
+    virtual void onAckResult(bool acked) {}
+
+    /// The number of nodes we heard directly recently
+    virtual void setNeighborCount(uint32_t count) {}
+
+    /// The delay to use when we want to send something
+    uint32_t getTxDelayMsec(float channelUtil, uint32_t slotTimeMsec);
+
+    /// The delay to use when we want to flood a message, routers get to go before clients
+    uint32_t getTxDelayMsecWeighted(float channelUtil, float snr, bool isRouter, uint32_t slotTimeMsec);
+};
+
+/**
+ * Maps channel utilization (for our own packets) or SNR (for rebroadcasts) linearly onto CWmin..CWmax.
+ */
+class FixedContentionWindow : public ContentionWindow
+{
+  public:
+    virtual const char *getName() const override { return "fixed"; }
+    virtual uint8_t getCWsize(float channelUtil) override;
+    virtual uint8_t getFloodCWsize(float channelUtil, float snr) override;
+};
+
+/**
+ * Sizes the window for the number of nodes actually contending for the channel, and widens it when transmissions fail.
+ *
+ * The number of contenders is estimated from our neighbor count and from how many copies of each flooded packet we
+ * hear.  Corrupted frames and unacked packets raise a congestion estimate, while good frames and acks lower it again.
+ * On a quiet channel with few neighbors the rebroadcast window shrinks well below the fixed 2^CWmax slots, which cuts
+ * flooding latency; in a busy dense mesh it grows faster than channel utilization alone would, to avoid collisions.
+ */
+class AdaptiveContentionWindow : public ContentionWindow
+{
+  public:
+    virtual const char *getName() const override { return "adaptive"; }
+    virtual uint8_t getCWsize(float channelUtil) override;
+    virtual uint8_t getFloodCWsize(float channelUtil, float snr) override;
+    virtual void reset() override;
+    virtual void onFrameReceived(bool crcOk) override { updateCongestion(!crcOk); }
+    virtual void onPacketHeard(bool duplicate) override;
+    virtual void onAckResult(bool acked) override { updateCongestion(!acked); }
+    virtual void setNeighborCount(uint32_t count) override { neighbors = count; }
+
+  private:
+    uint32_t neighbors = 0;
+
+    /// Moving average of the fraction of packets we heard that were duplicates
+    float duplicateRatio = 0;
+
+    /// Moving average of the fraction of recent transmissions (ours and others') that failed, 0..1
+    float congestion = 0;
+
+    void updateCongestion(bool failed);
+
+    /// The CW size (not rounded) for which the estimated contenders rarely pick the same slot
+    float getDensityCWsize() const;
+};
@@ -1,6 +1,7 @@
 #include "FloodingRouter.h"
 #include "configuration.h"
 #include "mesh-pb-constants.h"
+#include "modules/NeighborInfoModule.h"
 
 FloodingRouter::FloodingRouter() {}
 
@@ -19,12 +20,16 @@ ErrorCode FloodingRouter::send(meshtastic_MeshPacket *p)
 
 bool FloodingRouter::shouldFilterReceived(const meshtastic_MeshPacket *p)
 {
-    if (wasSeenRecently(p)) { // Note: this will also add a recent packet record
+    bool seen = wasSeenRecently(p); // Note: this will also add a recent packet record
+
+    // Packets without rx_snr/rx_rssi were generated locally, the others tell us how many nodes relay around us
+    if (iface && (p->rx_snr != 0 || p->rx_rssi != 0))
+        iface->getContentionWindow()->onPacketHeard(seen);
+
+    if (seen) {
         printPacket("Ignoring incoming msg, because we've already seen it", p);
-        if (config.device.role != meshtastic_Config_DeviceConfig_Role_ROUTER &&
-            config.device.role != meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT &&
-            config.device.role != meshtastic_Config_DeviceConfig_Role_REPEATER) {
-            // cancel rebroadcast of this message *if* there was already one, unless we're a router/repeater!
+        if (shouldCancelRebroadcast(p)) {
+            // cancel rebroadcast of this message *if* there was already one
             Router::cancelSending(p->from, p->id);
         }
         return true;
@@ -33,6 +38,47 @@ bool FloodingRouter::shouldFilterReceived(const meshtastic_MeshPacket *p)
     return Router::shouldFilterReceived(p);
 }
 
+#if MESHTASTIC_COVERAGE_SUPPRESSION
+uint8_t FloodingRouter::getRelayer(const meshtastic_MeshPacket *p)
+{
+    if (rxRelayNode)
+        return rxRelayNode;
+    // Firmware without relay_node support leaves it 0, but we can still tell when we heard the original sender
+    if (p->hop_start != 0 && p->hop_start == p->hop_limit)
+        return p->from & 0xff;
+    return 0;
+}
+#endif
+
+bool FloodingRouter::shouldCancelRebroadcast(const meshtastic_MeshPacket *p)
+{
+    bool isRouter = config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER ||
+                    config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT ||
+                    config.device.role == meshtastic_Config_DeviceConfig_Role_REPEATER;
+#if MESHTASTIC_COVERAGE_SUPPRESSION
+    RelayerSet *pending = NULL;
+    for (auto &r : pendingRelayers)
+        if (r.count && r.from == getFrom(p) && r.id == p->id)
+            pending = &r;
+    uint8_t relayer = getRelayer(p);
+    if (!pending || !relayer || !neighborInfoModule)
+        return !isRouter; // unless we're a router/repeater
+
+    bool known = false;
+    for (uint8_t i = 0; i < pending->count; i++)
+        known |= pending->relayers[i] == relayer;
+    if (!known && pending->count < COVERAGE_MAX_RELAYERS)
+        pending->relayers[pending->count++] = relayer;
+
+    if (neighborInfoModule->getCoverage(pending->relayers, pending->count) == COVERAGE_COMPLETE) {
+        LOG_DEBUG("All our neighbors were reached by %d relayers, cancelling our rebroadcast\n", pending->count);
+        pending->count = 0;
+        return true;
+    }
+#endif
+    return !isRouter; // unless we're a router/repeater
+}
+
 void FloodingRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtastic_Routing *c)
 {
     bool isAckorReply = (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) && (p->decoded.request_id != 0);
@@ -43,7 +89,9 @@ void FloodingRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtas
     }
     if ((p->to != getNodeNum()) && (p->hop_limit > 0) && (getFrom(p) != getNodeNum())) {
         if (p->id != 0) {
-            if (config.device.role != meshtastic_Config_DeviceConfig_Role_CLIENT_MUTE) {
+            if (config.device.role == meshtastic_Config_DeviceConfig_Role_CLIENT_MUTE) {
+                LOG_DEBUG("Not rebroadcasting. Role = Role_ClientMute\n");
+            } else if (shouldRelay(p)) {
                 meshtastic_MeshPacket *tosend = packetPool.allocCopy(*p); // keep a copy because we will be sending it
 
                 tosend->hop_limit--; // bump down the hop count
@@ -52,8 +100,16 @@ void FloodingRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtas
                 // Note: we are careful to resend using the original senders node id
                 // We are careful not to call our hooked version of send() - because we don't want to check this again
                 Router::send(tosend);
-            } else {
-                LOG_DEBUG("Not rebroadcasting. Role = Role_ClientMute\n");
+                rebroadcastCount++;
+#if MESHTASTIC_COVERAGE_SUPPRESSION
+                // Whoever sent us this already reached part of our neighbors
+                RelayerSet &pending = pendingRelayers[nextPendingRelayers];
+                nextPendingRelayers = (nextPendingRelayers + 1) % COVERAGE_MAX_PACKETS;
+                pending = {getFrom(p), p->id, 0, {}};
+                uint8_t relayer = getRelayer(p);
+                if (relayer)
+                    pending.relayers[pending.count++] = relayer;
+#endif
             }
         } else {
             LOG_DEBUG("Ignoring a simple (0 id) broadcast\n");
@@ -3,6 +3,18 @@
 #include "PacketHistory.h"
 #include "Router.h"
 
+/// Build with -DMESHTASTIC_COVERAGE_SUPPRESSION=1 to cancel our rebroadcast, even as a router, once the relayers we overheard
+/// reached all of our neighbors, see FloodingRouter::shouldCancelRebroadcast()
+#ifndef MESHTASTIC_COVERAGE_SUPPRESSION
+#define MESHTASTIC_COVERAGE_SUPPRESSION 0
+#endif
+
+/// Most relayers of a packet we remember to judge whether our neighbors already got it
+#define COVERAGE_MAX_RELAYERS 4
+
+/// Number of our pending rebroadcasts we track the relayers for
+#define COVERAGE_MAX_PACKETS 8
+
 /**
  * This is a mixin that extends Router with the ability to do Naive Flooding (in the standard mesh protocol sense)
  *
@@ -25,10 +37,34 @@
 
   Any entries in recentBroadcasts that are older than X seconds (longer than the
   max time a flood can take) will be discarded.
+
+  A duplicate cancels the rebroadcast of clients, but not of routers.  With
+  MESHTASTIC_COVERAGE_SUPPRESSION, while our rebroadcast is waiting for its slot
+  we also note which nodes we heard transmit the packet.  When NeighborInfoModule
+  knows who those relayers reach, we cancel our rebroadcast once all of our
+  neighbors are covered, even as a router.
  */
 class FloodingRouter : public Router, protected PacketHistory
 {
   private:
+#if MESHTASTIC_COVERAGE_SUPPRESSION
+    /// The nodes we heard transmit a packet we're about to rebroadcast, by the last byte of their node number
+    struct RelayerSet {
+        NodeNum from;
+        PacketId id;
+        uint8_t count;
+        uint8_t relayers[COVERAGE_MAX_RELAYERS];
+    };
+    RelayerSet pendingRelayers[COVERAGE_MAX_PACKETS] = {};
+    uint8_t nextPendingRelayers = 0;
+
+    /// The last byte of the node that transmitted this packet, or 0 if we can't tell
+    uint8_t getRelayer(const meshtastic_MeshPacket *p);
+#endif
+
+    /// We heard p again before our own rebroadcast went out, decide whether it's still needed
+    bool shouldCancelRebroadcast(const meshtastic_MeshPacket *p);
+
   public:
     /**
      * Constructor
@@ -43,6 +79,11 @@ class FloodingRouter : public Router, protected PacketHistory
      */
     virtual ErrorCode send(meshtastic_MeshPacket *p) override;
 
+    virtual bool wasSeenRecently(const meshtastic_MeshPacket *p, bool withUpdate = true) override
+    {
+        return PacketHistory::wasSeenRecently(p, withUpdate);
+    }
+
   protected:
     /**
      * Should this incoming filter be dropped?
@@ -56,4 +97,10 @@ class FloodingRouter : public Router, protected PacketHistory
      * Look for broadcasts we need to rebroadcast
      */
     virtual void sniffReceived(const meshtastic_MeshPacket *p, const meshtastic_Routing *c) override;
+
+    /**
+     * Called for every packet we would rebroadcast, allows subclasses to hold back our rebroadcast when other nodes are
+     * better placed to relay it
+     */
+    virtual bool shouldRelay(const meshtastic_MeshPacket *p) { return true; }
 };
\ No newline at end of file
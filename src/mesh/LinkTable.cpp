@@ -0,0 +1,98 @@
+#include "LinkTable.h"
+#include "configuration.h"
+#include <algorithm>
+
+LinkTable linkTable;
+
+float Link::getEtx() const
+{
+    return 1 / std::max(delivery * delivery, 0.01f);
+}
+
+Link &LinkTable::touch(NodeNum node, float snr, uint32_t nowMsec)
+{
+    expire(nowMsec);
+
+    auto found = byNode.find(node);
+    if (found != byNode.end()) {
+        links.splice(links.end(), links, found->second);
+        Link &link = links.back();
+        link.snr += LINK_SNR_EWMA_ALPHA * (snr - link.snr);
+        link.lastHeardMsec = nowMsec;
+        byLastByte[node & 0xff] = node;
+        return link;
+    }
+
+    if (links.size() >= LINK_TABLE_MAX_LINKS) {
+        LOG_DEBUG("Link table full, dropping 0x%x\n", links.front().node);
+        remove(links.begin());
+    }
+    links.push_back({node, snr, 1, nowMsec, 0});
+    byNode[node] = std::prev(links.end());
+    byLastByte[node & 0xff] = node;
+    return links.back();
+}
+
+void LinkTable::remove(std::list<Link>::iterator it)
+{
+    auto sameByte = byLastByte.find(it->node & 0xff);
+    if (sameByte != byLastByte.end() && sameByte->second == it->node)
+        byLastByte.erase(sameByte);
+    byNode.erase(it->node);
+    links.erase(it);
+}
+
+void LinkTable::onOriginalHeard(NodeNum node, PacketId id, float snr, uint32_t nowMsec)
+{
+    Link &link = touch(node, snr, nowMsec);
+
+    // Nodes number their packets sequentially, so a gap means we missed the packets in between
+    int32_t gap = id - link.lastId;
+    if (link.lastId != 0 && gap > 0 && gap <= LINK_MAX_ID_GAP) {
+        for (int32_t missed = 1; missed < gap; missed++)
+            link.delivery -= LINK_DELIVERY_EWMA_ALPHA * link.delivery;
+        link.delivery += LINK_DELIVERY_EWMA_ALPHA * (1 - link.delivery);
+    }
+    // A gap of 0 is a retransmission of the same packet, which doesn't tell us anything
+    if (gap != 0)
+        link.lastId = id;
+}
+
+void LinkTable::onHeard(NodeNum node, float snr, uint32_t nowMsec)
+{
+    touch(node, snr, nowMsec);
+}
+
+void LinkTable::onRelayHeard(uint8_t relayNode, float snr, uint32_t nowMsec)
+{
+    auto found = byLastByte.find(relayNode);
+    if (found != byLastByte.end())
+        touch(found->second, snr, nowMsec);
+}
+
+const Link *LinkTable::get(NodeNum node) const
+{
+    auto found = byNode.find(node);
+    return found != byNode.end() ? &*found->second : nullptr;
+}
+
+const Link *LinkTable::getByLastByte(uint8_t lastByte) const
+{
+    auto found = byLastByte.find(lastByte);
+    return found != byLastByte.end() ? get(found->second) : nullptr;
+}
+
+void LinkTable::expire(uint32_t nowMsec)
+{
+    while (!links.empty() && nowMsec - links.front().lastHeardMsec > LINK_EXPIRE_MSECS) {
+        LOG_DEBUG("Link to 0x%x expired\n", links.front().node);
+        remove(links.begin());
+    }
+}
+
+void LinkTable::clear()
+{
+    links.clear();
+    byNode.clear();
+    byLastByte.clear();
+}
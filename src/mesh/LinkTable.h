@@ -0,0 +1,94 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include <list>
+#include <unordered_map>
+
+/// Most neighbors we keep links to, the least recently heard one is dropped to make room
+#ifndef LINK_TABLE_MAX_LINKS
+#define LINK_TABLE_MAX_LINKS 64
+#endif
+
+/// Forget a neighbor we haven't heard for this long
+#define LINK_EXPIRE_MSECS (2 * 60 * 60 * 1000UL)
+
+/// Weight of a new observation in the moving averages
+#define LINK_SNR_EWMA_ALPHA (1.0f / 4)
+#define LINK_DELIVERY_EWMA_ALPHA (1.0f / 8)
+
+/// A larger jump in a neighbor's packet ids means it rebooted (or we were away), rather than that we missed its packets
+#define LINK_MAX_ID_GAP 16
+
+/**
+ * What we know about the radio link to a neighbor, i.e. a node we hear directly
+ */
+struct Link {
+    NodeNum node;
+
+    /// Moving average of the SNR we hear it with
+    float snr;
+
+    /// Moving average of the fraction of the packets it originated that we received, 1 until we see a gap in their ids
+    float delivery;
+
+    uint32_t lastHeardMsec;
+
+    /// The id of the last packet it originated that we heard directly, 0 if none
+    PacketId lastId;
+
+    /**
+     * Expected number of transmissions to get a packet across and acked.  We can only measure the delivery ratio from the
+     * neighbor to us, so the link is assumed to be as good in the other direction.
+     */
+    float getEtx() const;
+};
+
+/**
+ * The links to our neighbors, fed by Router with every packet we receive over LoRa.
+ *
+ * Lookups and updates are O(1): links are kept in a list ordered by when we last heard them, with a hash map from node
+ * number into the list.  As they all expire after the same time, the stale ones are always at the front of the list, so
+ * expiring them only visits the links that are removed.
+ */
+class LinkTable
+{
+  public:
+    /// We heard a packet directly from the node that originated it, which tells us which of its packets we missed
+    void onOriginalHeard(NodeNum node, PacketId id, float snr, uint32_t nowMsec);
+
+    /// We heard a neighbor transmit, e.g. relaying someone else's packet
+    void onHeard(NodeNum node, float snr, uint32_t nowMsec);
+
+    /// We heard a relayer identified by the last byte of its node number, only known neighbors are updated
+    void onRelayHeard(uint8_t relayNode, float snr, uint32_t nowMsec);
+
+    /// @return the link to this neighbor, or nullptr if we don't hear it
+    const Link *get(NodeNum node) const;
+
+    /// @return the most recently heard neighbor with this last byte of its node number, or nullptr if none
+    const Link *getByLastByte(uint8_t lastByte) const;
+
+    /// Drop the links we didn't hear for LINK_EXPIRE_MSECS
+    void expire(uint32_t nowMsec);
+
+    void clear();
+
+    size_t size() const { return links.size(); }
+
+    /// All links, the least recently heard first
+    const std::list<Link> &getLinks() const { return links; }
+
+  private:
+    std::list<Link> links;
+    std::unordered_map<NodeNum, std::list<Link>::iterator> byNode;
+
+    /// The most recently heard neighbor for each last byte of a node number
+    std::unordered_map<uint8_t, NodeNum> byLastByte;
+
+    /// Find or create the link to node, and move it to the back of the list as we just heard it
+    Link &touch(NodeNum node, float snr, uint32_t nowMsec);
+
+    void remove(std::list<Link>::iterator it);
+};
+
+extern LinkTable linkTable;
@@ -13,8 +13,12 @@
 #include "TypeConversions.h"
 #include "main.h"
 #include "mesh-pb-constants.h"
+#include "modules/NeighborInfoModule.h"
 #include "modules/NodeInfoModule.h"
 #include "modules/PositionModule.h"
+#if HAS_TELEMETRY
+#include "modules/Telemetry/TelemetryAggregator.h"
+#endif
 #include "power.h"
 #include <assert.h>
 #include <string>
@@ -97,8 +101,24 @@ int MeshService::handleFromRadio(const meshtastic_MeshPacket *mp)
         nodeInfoModule->sendOurNodeInfo(mp->from, true, mp->channel);
     }
 
+    if (NeighborInfoModule::isDelta(*mp)) {
+        LOG_DEBUG("Not forwarding a NeighborInfo delta to the phone\n");
+        return 0;
+    }
+
     printPacket("Forwarding to phone", mp);
-    sendToPhone(packetPool.allocCopy(*mp));
+    meshtastic_MeshPacket *copy = packetPool.allocCopy(*mp);
+#if !MESHTASTIC_EXCLUDE_GPS
+    if (positionModule && !positionModule->expandForPhone(*copy)) {
+        packetPool.release(copy);
+        copy = nullptr;
+    }
+#endif
+    if (copy)
+        sendToPhone(copy);
+#if HAS_TELEMETRY
+    TelemetryAggregator::sendUnbatchedToPhone(*mp);
+#endif
 
     return 0;
 }
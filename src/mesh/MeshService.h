@@ -83,6 +83,9 @@ class MeshService
     /// Return the next MqttClientProxyMessage packet destined to the phone.
     meshtastic_MqttClientProxyMessage *getMqttClientProxyMessageForPhone() { return toPhoneMqttProxyQueue.dequeuePtr(0); }
 
+    /// Return true if the client proxy queue can take count more messages without discarding the oldest ones
+    bool hasRoomForMqttClientProxyMessage(int count = 1) { return toPhoneMqttProxyQueue.numFree() >= count; }
+
     // search the queue for a request id and return the matching nodenum
     NodeNum getNodenumFromRequestId(uint32_t request_id);
 
@@ -0,0 +1,127 @@
+#include "NextHopRouter.h"
+#include "configuration.h"
+#include "mesh-pb-constants.h"
+
+void NextHopTable::learn(NodeNum dest, uint8_t nextHop, uint32_t nowMsec)
+{
+    if (nextHop == NO_NEXT_HOP_PREFERENCE)
+        return; // can't be told apart from 'flood', so we can't route through such a node
+
+    if (entries.size() >= MAX_NUM_NODES && entries.find(dest) == entries.end()) {
+        // Full, make room by dropping the route we confirmed longest ago
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+            if (nowMsec - it->second.learnedMsec > nowMsec - oldest->second.learnedMsec)
+                oldest = it;
+        entries.erase(oldest);
+    }
+    entries[dest] = {nextHop, nowMsec};
+}
+
+uint8_t NextHopTable::get(NodeNum dest, uint32_t nowMsec) const
+{
+    auto found = entries.find(dest);
+    if (found == entries.end() || nowMsec - found->second.learnedMsec > NEXT_HOP_EXPIRE_MSECS)
+        return NO_NEXT_HOP_PREFERENCE;
+    return found->second.nextHop;
+}
+
+void RecentPacketSet::add(NodeNum from, PacketId id)
+{
+    entries[next] = {from, id};
+    next = (next + 1) % NEXT_HOP_RECENT_PACKETS;
+}
+
+bool RecentPacketSet::contains(NodeNum from, PacketId id) const
+{
+    for (auto &e : entries)
+        if (e.from == from && e.id == id)
+            return true;
+    return false;
+}
+
+bool RecentPacketSet::take(NodeNum from, PacketId id)
+{
+    for (auto &e : entries) {
+        if (e.from == from && e.id == id) {
+            e = {0, 0};
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t NextHopRouter::getNextHop(const meshtastic_MeshPacket *p)
+{
+    if (p->to == NODENUM_BROADCAST || floodedRelays.contains(getFrom(p), p->id))
+        return NO_NEXT_HOP_PREFERENCE;
+    return nextHops.get(p->to, millis());
+}
+
+void NextHopRouter::learnNextHop(NodeNum dest, uint8_t nextHop)
+{
+    if (dest != getNodeNum()) {
+        LOG_DEBUG("Learned next hop 0x%x for 0x%x\n", nextHop, dest);
+        nextHops.learn(dest, nextHop, millis());
+    }
+}
+
+bool NextHopRouter::shouldFilterReceived(const meshtastic_MeshPacket *p)
+{
+    // The sender or a relay gave up on the directed path and floods this packet now, so it needs our relay after all
+    if (rxNextHop == NO_NEXT_HOP_PREFERENCE && p->to != NODENUM_BROADCAST && skippedRelays.take(getFrom(p), p->id)) {
+        printPacket("Directed packet is flooded now, relaying it", p);
+        floodedRelays.add(getFrom(p), p->id);
+        return Router::shouldFilterReceived(p);
+    }
+
+    // We relayed it already, so it's our next hop towards the destination that didn't get it through
+    if (rxNextHop == NO_NEXT_HOP_PREFERENCE && p->to != NODENUM_BROADCAST && relayed.contains(getFrom(p), p->id) &&
+        !floodedRelays.contains(getFrom(p), p->id)) {
+        floodedRelays.add(getFrom(p), p->id);
+        if (nextHops.get(p->to, millis()) != NO_NEXT_HOP_PREFERENCE) {
+            LOG_INFO("Directed packet we relayed is flooded now, forgetting the next hop for 0x%x\n", p->to);
+            nextHops.forget(p->to);
+        }
+    }
+
+    return FloodingRouter::shouldFilterReceived(p);
+}
+
+void NextHopRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtastic_Routing *c)
+{
+    NodeNum from = getFrom(p);
+
+    // rxRelayNode is zero for packets that didn't come in over LoRa, or came from firmware without next hop support
+    if (rxRelayNode != 0 && from != getNodeNum()) {
+        bool heardDirectly = p->hop_start != 0 && p->hop_start == p->hop_limit;
+        bool isReply = p->which_payload_variant == meshtastic_MeshPacket_decoded_tag && p->decoded.request_id != 0;
+        // A reply proves the path works both ways: our request got through, and rxRelayNode brought the answer back
+        if (heardDirectly ||
+            (isReply && (p->to == getNodeNum() || relayed.contains(p->to, p->decoded.request_id))))
+            learnNextHop(from, rxRelayNode);
+    }
+
+    uint32_t rebroadcastsBefore = rebroadcastCount;
+    FloodingRouter::sniffReceived(p, c);
+    if (rebroadcastCount != rebroadcastsBefore)
+        relayed.add(from, p->id);
+}
+
+bool NextHopRouter::shouldRelay(const meshtastic_MeshPacket *p)
+{
+    if (p->to == NODENUM_BROADCAST || rxNextHop == NO_NEXT_HOP_PREFERENCE || rxNextHop == getOurByte())
+        return true;
+
+    LOG_DEBUG("Not rebroadcasting, the next hop is 0x%x\n", rxNextHop);
+    skippedRelays.add(getFrom(p), p->id);
+    return false;
+}
+
+void NextHopRouter::fallBackToFlooding(const meshtastic_MeshPacket *p)
+{
+    if (p->to != NODENUM_BROADCAST && nextHops.get(p->to, millis()) != NO_NEXT_HOP_PREFERENCE) {
+        LOG_INFO("No ack through the next hop for 0x%x, flooding instead\n", p->to);
+        nextHops.forget(p->to);
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "FloodingRouter.h"
+#include <unordered_map>
+
+/// Forget a learned next hop if it wasn't confirmed for this long, so routes follow nodes that move
+#define NEXT_HOP_EXPIRE_MSECS (2 * 60 * 60 * 1000UL)
+
+/// Number of recent packets remembered for the relay decisions below
+#define NEXT_HOP_RECENT_PACKETS 32
+
+/**
+ * For each destination, the neighbor that recently relayed traffic from it to us.  Neighbors are identified by the last
+ * byte of their node number, as that is all the LoRa header has room for.
+ */
+class NextHopTable
+{
+  public:
+    void learn(NodeNum dest, uint8_t nextHop, uint32_t nowMsec);
+
+    /// @return the learned next hop, or NO_NEXT_HOP_PREFERENCE if we don't know one
+    uint8_t get(NodeNum dest, uint32_t nowMsec) const;
+
+    void forget(NodeNum dest) { entries.erase(dest); }
+
+  private:
+    struct Entry {
+        uint8_t nextHop;
+        uint32_t learnedMsec;
+    };
+    std::unordered_map<NodeNum, Entry> entries;
+};
+
+/**
+ * A small FIFO set of packets (sender and id), the oldest one is forgotten when full
+ */
+class RecentPacketSet
+{
+  public:
+    void add(NodeNum from, PacketId id);
+    bool contains(NodeNum from, PacketId id) const;
+
+    /// Remove the packet, return true if it was there
+    bool take(NodeNum from, PacketId id);
+
+  private:
+    struct Entry {
+        NodeNum from;
+        PacketId id;
+    };
+    Entry entries[NEXT_HOP_RECENT_PACKETS] = {};
+    uint8_t next = 0;
+};
+
+/**
+ * Extends FloodingRouter with directed routing for unicast packets.
+ *
+ * Every transmission carries our node number's last byte in relay_node.  When an ACK or reply comes back (or a traceroute
+ * completes) we learn which neighbor relayed it to us, and use that as next_hop for later packets to the same node.  Only
+ * the neighbor named in next_hop rebroadcasts a unicast packet, so it takes one path through the mesh instead of
+ * flooding it.  Broadcasts and unicasts without a known next hop are flooded as before.
+ *
+ * The origin doesn't take the next hop's relay of a directed packet as an implicit ack, as the rest of the path may be
+ * broken.  If the real ack doesn't come, ReliableRouter calls fallBackToFlooding() before retransmitting, which forgets the
+ * next hop so the retransmission floods.  Nodes that held back their relay of the directed attempt relay the flood, and the
+ * relays that forwarded it forget their next hop too.
+ */
+class NextHopRouter : public FloodingRouter
+{
+  public:
+    virtual uint8_t getNextHop(const meshtastic_MeshPacket *p) override;
+
+    virtual void learnNextHop(NodeNum dest, uint8_t nextHop) override;
+
+  protected:
+    virtual bool shouldFilterReceived(const meshtastic_MeshPacket *p) override;
+
+    virtual void sniffReceived(const meshtastic_MeshPacket *p, const meshtastic_Routing *c) override;
+
+    virtual bool shouldRelay(const meshtastic_MeshPacket *p) override;
+
+    /// Our reliable send of p went unacked, flood the retransmission in case its next hop went away
+    void fallBackToFlooding(const meshtastic_MeshPacket *p);
+
+    /// Did we hold back our relay of this packet because another node was its next hop?
+    bool wasRelaySkipped(const meshtastic_MeshPacket *p) const { return skippedRelays.contains(getFrom(p), p->id); }
+
+  private:
+    NextHopTable nextHops;
+
+    /// Directed packets we didn't relay because we weren't the next hop
+    RecentPacketSet skippedRelays;
+
+    /// Packets we relay as part of a fallback flood, which must not be directed again
+    RecentPacketSet floodedRelays;
+
+    /// Packets we relayed, so we can learn from the replies to them
+    RecentPacketSet relayed;
+
+    uint8_t getOurByte() { return getNodeNum() & 0xff; }
+};
@@ -12,6 +12,11 @@ PacketHistory::PacketHistory()
                                           // setup our periodic task
 }
 
+uint32_t PacketHistory::getTimeMsec()
+{
+    return millis();
+}
+
 /**
  * Update recentBroadcasts and return true if we have already seen this packet
  */
@@ -22,7 +27,7 @@ bool PacketHistory::wasSeenRecently(const meshtastic_MeshPacket *p, bool withUpd
         return false; // Not a floodable message ID, so we don't care
     }
 
-    uint32_t now = millis();
+    uint32_t now = getTimeMsec();
 
     PacketRecord r;
     r.id = p->id;
@@ -64,7 +69,7 @@ bool PacketHistory::wasSeenRecently(const meshtastic_MeshPacket *p, bool withUpd
  */
 void PacketHistory::clearExpiredRecentPackets()
 {
-    uint32_t now = millis();
+    uint32_t now = getTimeMsec();
 
     LOG_DEBUG("recentPackets size=%ld\n", recentPackets.size());
 
@@ -33,8 +33,13 @@ class PacketHistory
 
     void clearExpiredRecentPackets(); // clear all recentPackets older than FLOOD_EXPIRE_TIME
 
+  protected:
+    /// The clock the records expire by, millis() unless a subclass keeps virtual time like the mesh simulator
+    virtual uint32_t getTimeMsec();
+
   public:
     PacketHistory();
+    virtual ~PacketHistory() {}
 
     /**
      * Update recentBroadcasts and return true if we have already seen this packet
@@ -1,6 +1,7 @@
 #include "RadioInterface.h"
 #include "Channels.h"
 #include "DisplayFormatters.h"
+#include "LinkTable.h"
 #include "MeshRadio.h"
 #include "MeshService.h"
 #include "NodeDB.h"
@@ -8,6 +9,7 @@
 #include "configuration.h"
 #include "main.h"
 #include "sleep.h"
+#include <algorithm>
 #include <assert.h>
 #include <pb_decode.h>
 #include <pb_encode.h>
@@ -149,8 +151,6 @@ const RegionInfo regions[] = {
 const RegionInfo *myRegion;
 bool RadioInterface::uses_default_frequency_slot = true;
 
-static uint8_t bytes[MAX_RHPACKETLEN];
-
 void initRegion()
 {
     const RegionInfo *r = regions;
@@ -187,7 +187,7 @@ separated by 2.16 MHz with respect to the adjacent channels. Channel zero starts
  *
  * @return num msecs for the packet
  */
-uint32_t RadioInterface::getPacketTime(uint32_t pl)
+uint32_t RadioInterface::computePacketTime(uint32_t pl)
 {
     float bandwidthHz = bw * 1000.0f;
     bool headDisable = false; // we currently always use the header
@@ -201,11 +201,26 @@ uint32_t RadioInterface::getPacketTime(uint32_t pl)
     float tPayload = numPayloadSym * tSym;
     float tPacket = tPreamble + tPayload;
 
-    uint32_t msecs = tPacket * 1000;
+    return tPacket * 1000;
+}
+
+void RadioInterface::computePacketTimeTable()
+{
+    // UINT16_MAX marks the rare packets of very slow custom modem settings that take longer, see getPacketTime()
+    for (uint32_t pl = 0; pl <= MAX_RHPACKETLEN; pl++)
+        packetTimeTable[pl] = std::min<uint32_t>(computePacketTime(pl), UINT16_MAX);
 
-    LOG_DEBUG("(bw=%d, sf=%d, cr=4/%d) packet symLen=%d ms, payloadSize=%u, time %d ms\n", (int)bw, sf, cr, (int)(tSym * 1000),
-              pl, msecs);
-    return msecs;
+    preambleTimeMsec = getPacketTime((uint32_t)0);
+    maxPacketTimeMsec = getPacketTime(meshtastic_Constants_DATA_PAYLOAD_LEN + sizeof(PacketHeader));
+    LOG_DEBUG("(bw=%d, sf=%d, cr=4/%d) preamble time %u ms, max packet time %u ms\n", (int)bw, sf, cr, preambleTimeMsec,
+              maxPacketTimeMsec);
+}
+
+uint32_t RadioInterface::getPacketTime(uint32_t pl)
+{
+    if (pl <= MAX_RHPACKETLEN && packetTimeTable[pl] < UINT16_MAX)
+        return packetTimeTable[pl];
+    return computePacketTime(pl);
 }
 
 uint32_t RadioInterface::getPacketTime(const meshtastic_MeshPacket *p)
@@ -214,7 +229,9 @@ uint32_t RadioInterface::getPacketTime(const meshtastic_MeshPacket *p)
     if (p->which_payload_variant == meshtastic_MeshPacket_encrypted_tag) {
         pl = p->encrypted.size + sizeof(PacketHeader);
     } else {
-        size_t numbytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_Data_msg, &p->decoded);
+        // Only the length matters, so don't bother encoding the payload
+        size_t numbytes = 0;
+        pb_get_encoded_size(&numbytes, &meshtastic_Data_msg, &p->decoded);
         pl = numbytes + sizeof(PacketHeader);
     }
     return getPacketTime(pl);
@@ -223,14 +240,14 @@ uint32_t RadioInterface::getPacketTime(const meshtastic_MeshPacket *p)
 /** The delay to use for retransmitting dropped packets */
 uint32_t RadioInterface::getRetransmissionMsec(const meshtastic_MeshPacket *p)
 {
-    size_t numbytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_Data_msg, &p->decoded);
-    uint32_t packetAirtime = getPacketTime(numbytes + sizeof(PacketHeader));
+    uint32_t packetAirtime = getPacketTime(p);
     // Make sure enough time has elapsed for this packet to be sent and an ACK is received.
     // LOG_DEBUG("Waiting for flooding message with airtime %d and slotTime is %d\n", packetAirtime, slotTimeMsec);
-    float channelUtil = airTime->channelUtilizationPercent();
-    uint8_t CWsize = map(channelUtil, 0, 100, CWmin, CWmax);
+    float channelUtil = airTime ? airTime->channelUtilizationPercent() : 0;
+    uint8_t CWsize = contentionWindow->getCWsize(channelUtil);
+    uint8_t CWmin = contentionWindow->CWmin, CWmax = contentionWindow->CWmax;
     // Assuming we pick max. of CWsize and there will be a client with SNR at half the range
-    return 2 * packetAirtime + (pow(2, CWsize) + 2 * CWmax + pow(2, int((CWmax + CWmin) / 2))) * slotTimeMsec +
+    return 2 * packetAirtime + ((1 << CWsize) + 2 * CWmax + (1 << ((CWmax + CWmin) / 2))) * slotTimeMsec +
            PROCESSING_TIME_MSEC;
 }
 
@@ -240,40 +257,34 @@ uint32_t RadioInterface::getTxDelayMsec()
     /** We wait a random multiple of 'slotTimes' (see definition in header file) in order to avoid collisions.
     The pool to take a random multiple from is the contention window (CW), which size depends on the
     current channel utilization. */
-    float channelUtil = airTime->channelUtilizationPercent();
-    uint8_t CWsize = map(channelUtil, 0, 100, CWmin, CWmax);
-    // LOG_DEBUG("Current channel utilization is %f so setting CWsize to %d\n", channelUtil, CWsize);
-    return random(0, pow(2, CWsize)) * slotTimeMsec;
+    float channelUtil = airTime ? airTime->channelUtilizationPercent() : 0;
+    updateNeighborCount();
+    return contentionWindow->getTxDelayMsec(channelUtil, slotTimeMsec);
 }
 
 /** The delay to use when we want to flood a message */
 uint32_t RadioInterface::getTxDelayMsecWeighted(float snr)
 {
-    // The minimum value for a LoRa SNR
-    const uint32_t SNR_MIN = -20;
-
-    // The maximum value for a LoRa SNR
-    const uint32_t SNR_MAX = 15;
-
-    //  high SNR = large CW size (Long Delay)
-    //  low SNR = small CW size (Short Delay)
-    uint32_t delay = 0;
-    uint8_t CWsize = map(snr, SNR_MIN, SNR_MAX, CWmin, CWmax);
-    // LOG_DEBUG("rx_snr of %f so setting CWsize to:%d\n", snr, CWsize);
-    if (config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER ||
-        config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT ||
-        config.device.role == meshtastic_Config_DeviceConfig_Role_REPEATER) {
-        delay = random(0, 2 * CWsize) * slotTimeMsec;
+    float channelUtil = airTime ? airTime->channelUtilizationPercent() : 0;
+    bool isRouter = config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER ||
+                    config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT ||
+                    config.device.role == meshtastic_Config_DeviceConfig_Role_REPEATER;
+    updateNeighborCount();
+    uint32_t delay = contentionWindow->getTxDelayMsecWeighted(channelUtil, snr, isRouter, slotTimeMsec);
+    if (isRouter)
         LOG_DEBUG("rx_snr found in packet. As a router, setting tx delay:%d\n", delay);
-    } else {
-        // offset the maximum delay for routers: (2 * CWmax * slotTimeMsec)
-        delay = (2 * CWmax * slotTimeMsec) + random(0, pow(2, CWsize)) * slotTimeMsec;
+    else
         LOG_DEBUG("rx_snr found in packet. Setting tx delay:%d\n", delay);
-    }
 
     return delay;
 }
 
+void RadioInterface::updateNeighborCount()
+{
+    linkTable.expire(millis());
+    contentionWindow->setNeighborCount(linkTable.size());
+}
+
 void printPacket(const char *prefix, const meshtastic_MeshPacket *p)
 {
 #ifdef DEBUG_PORT
@@ -326,6 +337,12 @@ void printPacket(const char *prefix, const meshtastic_MeshPacket *p)
 RadioInterface::RadioInterface()
 {
     assert(sizeof(PacketHeader) == 16); // make sure the compiler did what we expected
+
+#if MESHTASTIC_ADAPTIVE_CW
+    contentionWindow = new AdaptiveContentionWindow();
+#else
+    contentionWindow = new FixedContentionWindow();
+#endif
 }
 
 bool RadioInterface::reconfigure()
@@ -516,8 +533,9 @@ void RadioInterface::applyModemConfig()
     saveChannelNum(channel_num);
     saveFreq(freq + loraConfig.frequency_offset);
 
-    preambleTimeMsec = getPacketTime((uint32_t)0);
-    maxPacketTimeMsec = getPacketTime(meshtastic_Constants_DATA_PAYLOAD_LEN + sizeof(PacketHeader));
+    slotTimeMsec = 8.5 * pow(2, sf) / bw + 0.2 + 0.4 + 7;
+    computePacketTimeTable();
+    contentionWindow->reset(); // what we learned about the channel doesn't carry over to other modem settings
 
     LOG_INFO("Radio freq=%.3f, config.lora.frequency_offset=%.3f\n", freq, loraConfig.frequency_offset);
     LOG_INFO("Set radio: region=%s, name=%s, config=%u, ch=%d, power=%d\n", myRegion->name, channelName, loraConfig.modem_preset,
@@ -527,7 +545,7 @@ void RadioInterface::applyModemConfig()
     LOG_INFO("Radio myRegion->numChannels: %d x %.3fkHz\n", numChannels, bw);
     LOG_INFO("Radio channel_num: %d\n", channel_num + 1);
     LOG_INFO("Radio frequency: %f\n", getFreq());
-    LOG_INFO("Slot time: %u msec\n", slotTimeMsec);
+    LOG_INFO("Slot time: %u msec, %s contention window\n", slotTimeMsec, contentionWindow->getName());
 }
 
 /**
@@ -549,10 +567,10 @@ void RadioInterface::limitPower()
     LOG_INFO("Set radio: final power level=%d\n", power);
 }
 
-void RadioInterface::deliverToReceiver(meshtastic_MeshPacket *p)
+void RadioInterface::deliverToReceiver(meshtastic_MeshPacket *p, uint8_t nextHop, uint8_t relayNode)
 {
     if (router)
-        router->enqueueReceivedMessage(p);
+        router->enqueueReceivedMessage(p, nextHop, relayNode);
 }
 
 /***
@@ -573,8 +591,8 @@ size_t RadioInterface::beginSending(meshtastic_MeshPacket *p)
     h->to = p->to;
     h->id = p->id;
     h->channel = p->channel;
-    h->next_hop = 0;   // *** For future use ***
-    h->relay_node = 0; // *** For future use ***
+    h->next_hop = router ? router->getNextHop(p) : NO_NEXT_HOP_PREFERENCE;
+    h->relay_node = nodeDB->getNodeNum() & 0xff;
     if (p->hop_limit > HOP_MAX) {
         LOG_WARN("hop limit %d is too high, setting to %d\n", p->hop_limit, HOP_RELIABLE);
         p->hop_limit = HOP_RELIABLE;
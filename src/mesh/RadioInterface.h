@@ -4,6 +4,7 @@
 #include "MeshTypes.h"
 #include "Observer.h"
 #include "PointerQueue.h"
+#include "ContentionWindow.h"
 #include "airtime.h"
 
 #define MAX_TX_QUEUE 16 // max number of packets which can be waiting for transmission
@@ -16,6 +17,9 @@
 #define PACKET_FLAGS_HOP_START_MASK 0xE0
 #define PACKET_FLAGS_HOP_START_SHIFT 5
 
+/// next_hop value meaning any node may relay the packet (plain flooding)
+#define NO_NEXT_HOP_PREFERENCE 0
+
 /**
  * This structure has to exactly match the wire layout when sent over the radio link.  Used to keep compatibility
  * with the old radiohead implementation.
@@ -35,10 +39,10 @@ typedef struct {
     /** The channel hash - used as a hint for the decoder to limit which channels we consider */
     uint8_t channel;
 
-    // ***For future use*** Last byte of the NodeNum of the next-hop for this packet
+    // Last byte of the NodeNum of the only node that should relay this packet, or NO_NEXT_HOP_PREFERENCE
     uint8_t next_hop;
 
-    // ***For future use*** Last byte of the NodeNum of the node that will relay/relayed this packet
+    // Last byte of the NodeNum of the node that transmitted (originated or relayed) this packet
     uint8_t relay_node;
 } PacketHeader;
 
@@ -76,9 +80,13 @@ class RadioInterface
     uint32_t preambleTimeMsec = 165;   // calculated on startup, this is the default for LongFast
     uint32_t maxPacketTimeMsec = 3246; // calculated on startup, this is the default for LongFast
     const uint32_t PROCESSING_TIME_MSEC =
-        4500;                // time to construct, process and construct a packet again (empirically determined)
-    const uint8_t CWmin = 2; // minimum CWsize
-    const uint8_t CWmax = 8; // maximum CWsize
+        4500; // time to construct, process and construct a packet again (empirically determined)
+
+    /// Decides our random transmit delays, see ContentionWindow
+    ContentionWindow *contentionWindow;
+
+    /// Airtime in msecs for every total packet length, precomputed by applyModemConfig() so we don't need float math per packet
+    uint16_t packetTimeTable[MAX_RHPACKETLEN + 1] = {};
 
     meshtastic_MeshPacket *sendingPacket = NULL; // The packet we are currently sending
     uint32_t lastTxStart = 0L;
@@ -89,16 +97,16 @@ class RadioInterface
     uint8_t radiobuf[MAX_RHPACKETLEN];
 
     /**
-     * Enqueue a received packet for the registered receiver
+     * Enqueue a received packet for the registered receiver, along with the relay fields of its header
      */
-    void deliverToReceiver(meshtastic_MeshPacket *p);
+    void deliverToReceiver(meshtastic_MeshPacket *p, uint8_t nextHop = NO_NEXT_HOP_PREFERENCE, uint8_t relayNode = 0);
 
   public:
     /** pool is the pool we will alloc our rx packets from
      */
     RadioInterface();
 
-    virtual ~RadioInterface() {}
+    virtual ~RadioInterface() { delete contentionWindow; }
 
     /**
      * Return true if we think the board can go to sleep (i.e. our tx queue is empty, we are not sending or receiving)
@@ -158,6 +166,11 @@ class RadioInterface
     /** The delay to use when we want to flood a message. Use a weighted scale based on SNR */
     uint32_t getTxDelayMsecWeighted(float snr);
 
+    /// For the router to report the duplicates and acks it sees
+    ContentionWindow *getContentionWindow() { return contentionWindow; }
+
+    uint32_t getSlotTimeMsec() { return slotTimeMsec; }
+
     /**
      * Calculate airtime per
      * https://www.rs-online.com/designspark/rel-assets/ds-assets/uploads/knowledge-items/application-notes-for-the-internet-of-things/LoRa%20Design%20Guide.pdf
@@ -214,7 +227,16 @@ class RadioInterface
      */
     virtual void saveChannelNum(uint32_t savedChannelNum);
 
+    /// Fill packetTimeTable (and the times derived from it) for the current modem settings
+    void computePacketTimeTable();
+
+    /// Tell the contention window how many neighbors we hear, see LinkTable
+    void updateNeighborCount();
+
   private:
+    /// The LoRa airtime formula itself, only used to fill packetTimeTable
+    uint32_t computePacketTime(uint32_t totalPacketLen);
+
     /**
      * Convert our modemConfig enum into wf, sf, etc...
      *
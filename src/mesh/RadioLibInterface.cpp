@@ -9,6 +9,10 @@
 #include <pb_decode.h>
 #include <pb_encode.h>
 
+#ifdef ARCH_PORTDUINO
+#include "platform/portduino/RadioTrace.h"
+#endif
+
 void LockingArduinoHal::spiBeginTransaction()
 {
     spiLock->lock();
@@ -334,6 +338,7 @@ void RadioLibInterface::handleReceiveInterrupt()
     if (state != RADIOLIB_ERR_NONE) {
         LOG_ERROR("ignoring received packet due to error=%d\n", state);
         rxBad++;
+        contentionWindow->onFrameReceived(false); // usually a CRC error, i.e. a collision
 
         airTime->logAirtime(RX_ALL_LOG, xmitMsec);
 
@@ -350,6 +355,7 @@ void RadioLibInterface::handleReceiveInterrupt()
         } else {
             const PacketHeader *h = (PacketHeader *)radiobuf;
             rxGood++;
+            contentionWindow->onFrameReceived(true);
             // altered packet with "from == 0" can do Remote Node Administration without permission
             if (h->from == 0) {
                 LOG_WARN("ignoring received packet without sender\n");
@@ -372,6 +378,10 @@ void RadioLibInterface::handleReceiveInterrupt()
             mp->via_mqtt = !!(h->flags & PACKET_FLAGS_VIA_MQTT_MASK);
 
             addReceiveMetadata(mp);
+#ifdef ARCH_PORTDUINO
+            if (radioTraceRecorder)
+                radioTraceRecorder->record(radiobuf, length, mp->rx_snr, mp->rx_rssi);
+#endif
 
             mp->which_payload_variant =
                 meshtastic_MeshPacket_encrypted_tag; // Mark that the payload is still encrypted at this point
@@ -383,7 +393,7 @@ void RadioLibInterface::handleReceiveInterrupt()
 
             airTime->logAirtime(RX_LOG, xmitMsec);
 
-            deliverToReceiver(mp);
+            deliverToReceiver(mp, h->next_hop, h->relay_node);
         }
     }
 }
@@ -3,6 +3,7 @@
 #include "MeshTypes.h"
 #include "configuration.h"
 #include "mesh-pb-constants.h"
+#include <algorithm>
 
 // ReliableRouter::ReliableRouter() {}
 
@@ -12,6 +13,12 @@
  */
 ErrorCode ReliableRouter::send(meshtastic_MeshPacket *p)
 {
+    /* If we have pending retransmissions, add the airtime of this packet to it, because during that time we cannot receive an
+       (implicit) ACK. Otherwise, we might retransmit too early.  This is done before we add p itself.
+     */
+    if (!pending.empty())
+        delayRetransmissions(iface->getPacketTime(p));
+
     if (p->want_ack) {
         // If someone asks for acks on broadcast, we need the hop limit to be at least one, so that first node that receives our
         // message will rebroadcast.  But asking for hop_limit 0 in that context means the client app has no preference on hop
@@ -24,15 +31,6 @@ ErrorCode ReliableRouter::send(meshtastic_MeshPacket *p)
         startRetransmission(copy);
     }
 
-    /* If we have pending retransmissions, add the airtime of this packet to it, because during that time we cannot receive an
-       (implicit) ACK. Otherwise, we might retransmit too early.
-     */
-    for (auto i = pending.begin(); i != pending.end(); i++) {
-        if (i->first.id != p->id) {
-            i->second.nextTxMsec += iface->getPacketTime(p);
-        }
-    }
-
     return FloodingRouter::send(p);
 }
 
@@ -50,8 +48,14 @@ bool ReliableRouter::shouldFilterReceived(const meshtastic_MeshPacket *p)
         // from the intended recipient.
         auto key = GlobalPacketId(getFrom(p), p->id);
         auto old = findPendingPacket(key);
-        if (old) {
+        if (old && p->to != NODENUM_BROADCAST && getNextHop(old->packet) != NO_NEXT_HOP_PREFERENCE) {
+            // Only the next hop relays a directed packet, so hearing it says nothing about the rest of the path.  Keep
+            // retransmitting until the real ack comes back, allowing for the hops it may still take there and back.
+            LOG_DEBUG("Next hop relayed our directed packet, waiting for the ack\n");
+            setNextTx(old, p->hop_limit + 1);
+        } else if (old) {
             LOG_DEBUG("generating implicit ack\n");
+            iface->getContentionWindow()->onAckResult(true);
             // NOTE: we do NOT check p->wantAck here because p is the INCOMING rebroadcast and that packet is not expected to be
             // marked as wantAck
             sendAckNak(meshtastic_Routing_Error_NONE, getFrom(p), p->id, old->packet->channel);
@@ -67,23 +71,24 @@ bool ReliableRouter::shouldFilterReceived(const meshtastic_MeshPacket *p)
        because while receiving this packet, we could not have received an (implicit) ACK for it.
        If we don't add this, we will likely retransmit too early.
     */
-    for (auto i = pending.begin(); i != pending.end(); i++) {
-        i->second.nextTxMsec += iface->getPacketTime(p);
-    }
+    if (!pending.empty())
+        delayRetransmissions(iface->getPacketTime(p));
 
     /* Resend implicit ACKs for repeated packets (hopStart equals hopLimit);
      * this way if an implicit ACK is dropped and a packet is resent we'll rebroadcast again.
      * Resending real ACKs is omitted, as you might receive a packet multiple times due to flooding and
      * flooding this ACK back to the original sender already adds redundancy. */
     bool isRepeated = p->hop_start == 0 ? (p->hop_limit == HOP_RELIABLE) : (p->hop_start == p->hop_limit);
-    if (wasSeenRecently(p, false) && isRepeated && !MeshModule::currentReply && p->to != nodeDB->getNodeNum()) {
+    // Packets we held back our relay for are relayed by NextHopRouter instead, if this is a fallback to flooding
+    if (wasSeenRecently(p, false) && isRepeated && !MeshModule::currentReply && p->to != nodeDB->getNodeNum() &&
+        !wasRelaySkipped(p)) {
         LOG_DEBUG("Resending implicit ack for a repeated floodmsg\n");
         meshtastic_MeshPacket *tosend = packetPool.allocCopy(*p);
         tosend->hop_limit--; // bump down the hop count
         Router::send(tosend);
     }
 
-    return FloodingRouter::shouldFilterReceived(p);
+    return NextHopRouter::shouldFilterReceived(p);
 }
 
 /**
@@ -107,7 +112,12 @@ void ReliableRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtas
             if (MeshModule::currentReply) {
                 LOG_DEBUG("Some other module has replied to this message, no need for a 2nd ack\n");
             } else if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
-                sendAckNak(meshtastic_Routing_Error_NONE, getFrom(p), p->id, p->channel, p->hop_start, p->hop_limit);
+#if MESHTASTIC_ACK_AGGREGATION
+                if (isAckAggregatingPeer(getFrom(p)))
+                    holdAck(p);
+                else
+#endif
+                    sendAckNak(meshtastic_Routing_Error_NONE, getFrom(p), p->id, p->channel, p->hop_start, p->hop_limit);
             } else {
                 // Send a 'NO_CHANNEL' error on the primary channel if want_ack packet destined for us cannot be decoded
                 sendAckNak(meshtastic_Routing_Error_NO_CHANNEL, getFrom(p), p->id, channels.getPrimaryIndex(), p->hop_start,
@@ -125,7 +135,10 @@ void ReliableRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtas
         if (ackId || nakId) {
             if (ackId) {
                 LOG_DEBUG("Received an ack for 0x%x, stopping retransmissions\n", ackId);
-                stopRetransmission(p->to, ackId);
+                if (stopRetransmission(p->to, ackId))
+                    iface->getContentionWindow()->onAckResult(true);
+                if (c)
+                    handleAckedIds(p);
             } else {
                 LOG_DEBUG("Received a nak for 0x%x, stopping retransmissions\n", nakId);
                 stopRetransmission(p->to, nakId);
@@ -134,7 +147,79 @@ void ReliableRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtas
     }
 
     // handle the packet as normal
-    FloodingRouter::sniffReceived(p, c);
+    NextHopRouter::sniffReceived(p, c);
+}
+
+void ReliableRouter::holdAck(const meshtastic_MeshPacket *p)
+{
+    if (heldAcks.count > 0 && (heldAcks.to != getFrom(p) || heldAcks.channel != p->channel))
+        flushHeldAcks(true); // the burst we were waiting for is over
+    for (uint8_t i = 0; i < heldAcks.count; i++)
+        if (heldAcks.ids[i] == p->id)
+            return; // a retransmission of a packet we're about to ack anyway
+
+    if (heldAcks.count == 0) {
+        // The sender's next packet follows after its airtime and a contention window that is short on a quiet channel.  That is
+        // well within its retransmission timeout, which allows for twice the airtime and the largest contention windows.
+        uint32_t waitMsec = iface->getPacketTime(p) + (1 << iface->getContentionWindow()->CWmin) * iface->getSlotTimeMsec();
+        heldAcks.to = getFrom(p);
+        heldAcks.channel = p->channel;
+        heldAcks.dueMsec = millis() + waitMsec;
+        setReceivedMessage(); // Run ASAP, so we can figure out our correct sleep time
+    }
+    heldAcks.hopStart = p->hop_start;
+    heldAcks.hopLimit = p->hop_limit;
+    heldAcks.ids[heldAcks.count++] = p->id;
+    if (heldAcks.count == MAX_ACKED_IDS)
+        flushHeldAcks(true);
+}
+
+int32_t ReliableRouter::flushHeldAcks(bool force)
+{
+    if (heldAcks.count == 0)
+        return INT32_MAX;
+
+    int32_t d = heldAcks.dueMsec - millis();
+    if (!force && d > 0)
+        return d;
+
+    LOG_DEBUG("Sending one ack for %d packets from 0x%x\n", heldAcks.count, heldAcks.to);
+    routingModule->sendAcks(heldAcks.to, heldAcks.ids, heldAcks.count, heldAcks.channel, heldAcks.hopStart, heldAcks.hopLimit);
+    heldAcks.count = 0;
+    return INT32_MAX;
+}
+
+void ReliableRouter::handleAckedIds(const meshtastic_MeshPacket *p)
+{
+    PacketId ids[MAX_ACKED_IDS];
+    int numIds = RoutingModule::getAckedIds(p, ids, MAX_ACKED_IDS);
+    if (numIds < 0)
+        return;
+
+    NodeNum from = getFrom(p);
+    if (from != getNodeNum() && !isAckAggregatingPeer(from)) {
+        ackAggregatingPeers[nextAckAggregatingPeer] = from;
+        nextAckAggregatingPeer = (nextAckAggregatingPeer + 1) % ACK_AGGREGATION_PEERS;
+    }
+
+    for (int i = 0; i < numIds; i++) {
+        auto old = findPendingPacket(p->to, ids[i]);
+        if (old) {
+            LOG_DEBUG("Received an aggregated ack for 0x%x, stopping retransmissions\n", ids[i]);
+            iface->getContentionWindow()->onAckResult(true);
+            // Like an implicit ack, so the sending app learns about it too
+            sendAckNak(meshtastic_Routing_Error_NONE, p->to, ids[i], old->packet->channel);
+            stopRetransmission(p->to, ids[i]);
+        }
+    }
+}
+
+bool ReliableRouter::isAckAggregatingPeer(NodeNum n) const
+{
+    for (auto peer : ackAggregatingPeers)
+        if (peer == n)
+            return true;
+    return false;
 }
 
 #define NUM_RETRANSMISSIONS 3
@@ -177,6 +262,8 @@ bool ReliableRouter::stopRetransmission(GlobalPacketId key)
         }
         auto numErased = pending.erase(key);
         assert(numErased == 1);
+        if (pending.empty())
+            timers.clear(); // all remaining timers are stale
         return true;
     } else
         return false;
@@ -204,55 +291,56 @@ PendingPacket *ReliableRouter::startRetransmission(meshtastic_MeshPacket *p)
 int32_t ReliableRouter::doRetransmissions()
 {
     uint32_t now = millis();
-    int32_t d = INT32_MAX;
-
-    // FIXME, we should use a better datastructure rather than walking through this map.
-    // for(auto el: pending) {
-    for (auto it = pending.begin(), nextIt = it; it != pending.end(); it = nextIt) {
-        ++nextIt; // we use this odd pattern because we might be deleting it...
-        auto &p = it->second;
-
-        bool stillValid = true; // assume we'll keep this record around
-
-        // FIXME, handle 51 day rolloever here!!!
-        if (p.nextTxMsec <= now) {
-            if (p.numRetransmissions == 0) {
-                LOG_DEBUG("Reliable send failed, returning a nak for fr=0x%x,to=0x%x,id=0x%x\n", p.packet->from, p.packet->to,
-                          p.packet->id);
-                sendAckNak(meshtastic_Routing_Error_MAX_RETRANSMIT, getFrom(p.packet), p.packet->id, p.packet->channel);
-                // Note: we don't stop retransmission here, instead the Nak packet gets processed in sniffReceived
-                stopRetransmission(it->first);
-                stillValid = false; // just deleted it
-            } else {
-                LOG_DEBUG("Sending reliable retransmission fr=0x%x,to=0x%x,id=0x%x, tries left=%d\n", p.packet->from,
-                          p.packet->to, p.packet->id, p.numRetransmissions);
 
-                // Note: we call the superclass version because we don't want to have our version of send() add a new
-                // retransmission record
-                FloodingRouter::send(packetPool.allocCopy(*p.packet));
+    while (!timers.empty()) {
+        RetransmissionTimer timer = timers.front();
+        auto found = pending.find(timer.key);
+        bool stale = found == pending.end() || found->second.nextTxMsec != timer.nextTxMsec; // acked or rescheduled
+
+        int32_t d = timer.dueInMsec(busyMsec, now);
+        if (!stale && d > 0)
+            return d; // nothing else is due before this one
+
+        std::pop_heap(timers.begin(), timers.end(), &CompareRetransmissionTimer);
+        timers.pop_back();
+        if (stale)
+            continue;
+
+        auto &p = found->second;
+        iface->getContentionWindow()->onAckResult(false);
+        if (p.numRetransmissions == 0) {
+            LOG_DEBUG("Reliable send failed, returning a nak for fr=0x%x,to=0x%x,id=0x%x\n", p.packet->from, p.packet->to,
+                      p.packet->id);
+            sendAckNak(meshtastic_Routing_Error_MAX_RETRANSMIT, getFrom(p.packet), p.packet->id, p.packet->channel);
+            // Note: we don't stop retransmission here, instead the Nak packet gets processed in sniffReceived
+            stopRetransmission(timer.key);
+        } else {
+            LOG_DEBUG("Sending reliable retransmission fr=0x%x,to=0x%x,id=0x%x, tries left=%d\n", p.packet->from, p.packet->to,
+                      p.packet->id, p.numRetransmissions);
 
-                // Queue again
-                --p.numRetransmissions;
-                setNextTx(&p);
-            }
-        }
+            // The next hop might be gone, so don't rely on it for the retransmission
+            fallBackToFlooding(p.packet);
 
-        if (stillValid) {
-            // Update our desired sleep delay
-            int32_t t = p.nextTxMsec - now;
+            // Note: we call the superclass version because we don't want to have our version of send() add a new
+            // retransmission record
+            FloodingRouter::send(packetPool.allocCopy(*p.packet));
 
-            d = min(t, d);
+            // Queue again
+            --p.numRetransmissions;
+            setNextTx(&p);
         }
     }
 
-    return d;
+    return INT32_MAX;
 }
 
-void ReliableRouter::setNextTx(PendingPacket *pending)
+void ReliableRouter::setNextTx(PendingPacket *pending, uint8_t numHops)
 {
     assert(iface);
-    auto d = iface->getRetransmissionMsec(pending->packet);
-    pending->nextTxMsec = millis() + d;
+    auto d = iface->getRetransmissionMsec(pending->packet) * numHops;
+    pending->nextTxMsec = millis() + d - busyMsec;
+    timers.push_back({GlobalPacketId(pending->packet), pending->nextTxMsec});
+    std::push_heap(timers.begin(), timers.end(), &CompareRetransmissionTimer);
     LOG_DEBUG("Setting next retransmission in %u msecs: ", d);
     printPacket("", pending->packet);
     setReceivedMessage(); // Run ASAP, so we can figure out our correct sleep time
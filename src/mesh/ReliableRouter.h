@@ -1,30 +1,13 @@
 #pragma once
 
-#include "FloodingRouter.h"
+#include "NextHopRouter.h"
+#include "RetransmissionTimer.h"
+#include "modules/RoutingModule.h"
 #include <unordered_map>
+#include <vector>
 
-/**
- * An identifier for a globalally unique message - a pair of the sending nodenum and the packet id assigned
- * to that message
- */
-struct GlobalPacketId {
-    NodeNum node;
-    PacketId id;
-
-    bool operator==(const GlobalPacketId &p) const { return node == p.node && id == p.id; }
-
-    explicit GlobalPacketId(const meshtastic_MeshPacket *p)
-    {
-        node = getFrom(p);
-        id = p->id;
-    }
-
-    GlobalPacketId(NodeNum _from, PacketId _id)
-    {
-        node = _from;
-        id = _id;
-    }
-};
+/// Number of nodes we remember to understand aggregated ACKs
+#define ACK_AGGREGATION_PEERS 8
 
 /**
  * A packet queued for retransmission
@@ -32,7 +15,7 @@ struct GlobalPacketId {
 struct PendingPacket {
     meshtastic_MeshPacket *packet;
 
-    /** The next time we should try to retransmit this packet */
+    /** The next time we should try to retransmit this packet, minus ReliableRouter::busyMsec */
     uint32_t nextTxMsec = 0;
 
     /** Starts at NUM_RETRANSMISSIONS -1(normally 3) and counts down.  Once zero it will be removed from the list */
@@ -42,20 +25,43 @@ struct PendingPacket {
     explicit PendingPacket(meshtastic_MeshPacket *p);
 };
 
-class GlobalPacketIdHashFunction
-{
-  public:
-    size_t operator()(const GlobalPacketId &p) const { return (std::hash<NodeNum>()(p.node)) ^ (std::hash<PacketId>()(p.id)); }
-};
-
 /**
  * This is a mixin that extends Router with the ability to do (one hop only) reliable message sends.
+ *
+ * With MESHTASTIC_ACK_AGGREGATION, the ACK for a want_ack packet is held back for about the time the sender needs to send
+ * its next packet, and a burst of packets from the same node (e.g. store and forward history) is acknowledged with a
+ * single ACK listing all their ids.  We only do this for nodes whose own ACKs showed they understand that.
  */
-class ReliableRouter : public FloodingRouter
+class ReliableRouter : public NextHopRouter
 {
   private:
     std::unordered_map<GlobalPacketId, PendingPacket, GlobalPacketIdHashFunction> pending;
 
+    /** Min-heap of retransmission times, so finding the next one doesn't need to walk all pending packets */
+    std::vector<RetransmissionTimer> timers;
+
+    /** ACKs we hold back to send them as one, all for the same node and channel */
+    struct HeldAcks {
+        NodeNum to;
+        ChannelIndex channel;
+        uint8_t hopStart;
+        uint8_t hopLimit;
+        uint8_t count;
+        PacketId ids[MAX_ACKED_IDS];
+        uint32_t dueMsec;
+    };
+    HeldAcks heldAcks = {};
+
+    /** Nodes that recently sent ACKs with the ROUTING_ACKED_IDS_TAG field */
+    NodeNum ackAggregatingPeers[ACK_AGGREGATION_PEERS] = {};
+    uint8_t nextAckAggregatingPeer = 0;
+
+    /**
+     * Airtime during which we couldn't have heard an (implicit) ACK, added to all pending retransmissions at once by
+     * storing their nextTxMsec relative to it
+     */
+    uint32_t busyMsec = 0;
+
   public:
     /**
      * Constructor
@@ -75,10 +81,11 @@ class ReliableRouter : public FloodingRouter
     {
         // Note: We must doRetransmissions FIRST, because it might queue up work for the base class runOnce implementation
         auto d = doRetransmissions();
+        auto a = flushHeldAcks();
 
         int32_t r = FloodingRouter::runOnce();
 
-        return min(d, r);
+        return min(min(d, a), r);
     }
 
   protected:
@@ -119,5 +126,24 @@ class ReliableRouter : public FloodingRouter
      */
     int32_t doRetransmissions();
 
-    void setNextTx(PendingPacket *pending);
+    /// Schedule the next retransmission, after the time an ack takes to come back over numHops hops
+    void setNextTx(PendingPacket *pending, uint8_t numHops = 1);
+
+    /** Acknowledge p later, together with the packets its sender sends right after it */
+    void holdAck(const meshtastic_MeshPacket *p);
+
+    /**
+     * Send the held ACKs, if they are due or force is set
+     *
+     * @return the number of msecs until they are due, or INT32_MAX if there are none
+     */
+    int32_t flushHeldAcks(bool force = false);
+
+    /** Stop retransmitting the packets acked by an aggregated ACK, other than its request_id */
+    void handleAckedIds(const meshtastic_MeshPacket *p);
+
+    bool isAckAggregatingPeer(NodeNum n) const;
+
+    /** Delay all pending retransmissions, because we were busy sending or receiving for this long */
+    void delayRetransmissions(uint32_t msec) { busyMsec += msec; }
 };
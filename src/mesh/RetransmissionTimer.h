@@ -0,0 +1,53 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include <functional>
+
+/**
+ * An identifier for a globalally unique message - a pair of the sending nodenum and the packet id assigned
+ * to that message
+ */
+struct GlobalPacketId {
+    NodeNum node;
+    PacketId id;
+
+    bool operator==(const GlobalPacketId &p) const { return node == p.node && id == p.id; }
+
+    explicit GlobalPacketId(const meshtastic_MeshPacket *p)
+    {
+        node = getFrom(p);
+        id = p->id;
+    }
+
+    GlobalPacketId(NodeNum _from, PacketId _id)
+    {
+        node = _from;
+        id = _id;
+    }
+};
+
+class GlobalPacketIdHashFunction
+{
+  public:
+    size_t operator()(const GlobalPacketId &p) const { return (std::hash<NodeNum>()(p.node)) ^ (std::hash<PacketId>()(p.id)); }
+};
+
+/**
+ * An entry in the retransmission timer heap.  It is stale once its packet is no longer pending, or was rescheduled to a
+ * different nextTxMsec, and is then skipped when it reaches the top.
+ */
+struct RetransmissionTimer {
+    GlobalPacketId key;
+    uint32_t nextTxMsec;
+
+    /// @return msecs until this timer is due at "now", zero or less once it is.  nextTxMsec is stored minus "busyMsec", so that
+    /// delaying all pending retransmissions is a single addition
+    int32_t dueInMsec(uint32_t busyMsec, uint32_t now) const { return (int32_t)(nextTxMsec + busyMsec - now); }
+};
+
+/// @return "true" if "t1" is due after "t2", which makes the heap a min-heap.  The times are compared as a signed
+/// difference, so this stays correct when millis() rolls over, as long as all pending times are within 24 days of each other
+inline bool CompareRetransmissionTimer(const RetransmissionTimer &t1, const RetransmissionTimer &t2)
+{
+    return (int32_t)(t1.nextTxMsec - t2.nextTxMsec) > 0;
+}
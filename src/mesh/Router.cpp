@@ -1,12 +1,14 @@
 #include "Router.h"
 #include "Channels.h"
 #include "CryptoEngine.h"
+#include "LinkTable.h"
 #include "MeshRadio.h"
 #include "NodeDB.h"
 #include "RTC.h"
 #include "configuration.h"
 #include "main.h"
 #include "mesh-pb-constants.h"
+#include "mesh/compression/unishox2.h"
 #include "modules/RoutingModule.h"
 #if !MESHTASTIC_EXCLUDE_MQTT
 #include "mqtt/MQTT.h"
@@ -36,6 +38,63 @@ Allocator<meshtastic_MeshPacket> &packetPool = staticPool;
 
 static uint8_t bytes[MAX_RHPACKETLEN];
 
+/**
+ * Replace a text payload with its unishox2 compressed form, if that is smaller.  The portnum tells receivers to decompress it.
+ */
+void perhapsCompress(meshtastic_Data *d)
+{
+    if (d->payload.size < 2)
+        return;
+
+    char compressed[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    // Limiting the output to one byte less than the input makes unishox2 give up as soon as compressing doesn't pay off
+    int len = unishox2_compress_simple_olen((const char *)d->payload.bytes, d->payload.size, compressed, d->payload.size - 1);
+    if (len <= 0 || len >= d->payload.size)
+        return;
+
+    LOG_DEBUG("Compressed text from %d to %d bytes\n", d->payload.size, len);
+    memcpy(d->payload.bytes, compressed, len);
+    d->payload.size = len;
+    d->portnum = meshtastic_PortNum_TEXT_MESSAGE_COMPRESSED_APP;
+}
+
+/**
+ * Restore a payload compressed by perhapsCompress(), leave it alone if it doesn't decompress into a whole payload
+ */
+bool perhapsDecompress(meshtastic_Data *d)
+{
+    char decompressed[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    int len =
+        unishox2_decompress_simple_olen((const char *)d->payload.bytes, d->payload.size, decompressed, sizeof(decompressed));
+    if (len <= 0 || len > (int)sizeof(decompressed)) {
+        LOG_WARN("Can't decompress text message of %d bytes\n", d->payload.size);
+        return false;
+    }
+
+    memcpy(d->payload.bytes, decompressed, len);
+    d->payload.size = len;
+    d->portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
+    return true;
+}
+
+/// How many of the text messages we decompressed on reception to remember, so relaying them compresses them again
+#define RECENT_DECOMPRESSED 8
+
+static struct {
+    NodeNum from;
+    PacketId id;
+} recentDecompressed[RECENT_DECOMPRESSED];
+static uint8_t nextDecompressed;
+
+/// Did this packet arrive compressed?  Modules, the phone and MQTT get the text, but relays must keep what the sender chose.
+static bool wasDecompressed(NodeNum from, PacketId id)
+{
+    for (auto &r : recentDecompressed)
+        if (r.from == from && r.id == id)
+            return true;
+    return false;
+}
+
 /**
  * Constructor
  *
@@ -65,8 +124,13 @@ int32_t Router::runOnce()
     meshtastic_MeshPacket *mp;
     while ((mp = fromRadioQueue.dequeuePtr(0)) != NULL) {
         // printPacket("handle fromRadioQ", mp);
+        rxNextHop = fromRadioRelayHeaders.front().nextHop;
+        rxRelayNode = fromRadioRelayHeaders.front().relayNode;
+        fromRadioRelayHeaders.pop();
         perhapsHandleReceived(mp);
     }
+    rxNextHop = NO_NEXT_HOP_PREFERENCE;
+    rxRelayNode = 0;
 
     // LOG_DEBUG("sleeping forever!\n");
     return INT32_MAX; // Wait a long time - until we get woken for the message queue
@@ -76,9 +140,10 @@ int32_t Router::runOnce()
  * RadioInterface calls this to queue up packets that have been received from the radio.  The router is now responsible for
  * freeing the packet
  */
-void Router::enqueueReceivedMessage(meshtastic_MeshPacket *p)
+void Router::enqueueReceivedMessage(meshtastic_MeshPacket *p, uint8_t nextHop, uint8_t relayNode)
 {
     if (fromRadioQueue.enqueue(p, 0)) { // NOWAIT - fixme, if queue is full, delete older messages
+        fromRadioRelayHeaders.push({nextHop, relayNode});
 
         // Nasty hack because our threading is primitive.  interfaces shouldn't need to know about routers FIXME
         setReceivedMessage();
@@ -329,25 +394,11 @@ bool perhapsDecode(meshtastic_MeshPacket *p)
                 p->which_payload_variant = meshtastic_MeshPacket_decoded_tag; // change type to decoded
                 p->channel = chIndex;                                         // change to store the index instead of the hash
 
-                /* Not actually ever used.
-                // Decompress if needed. jm
-                if (p->decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_COMPRESSED_APP) {
-                    // Decompress the payload
-                    char compressed_in[meshtastic_Constants_DATA_PAYLOAD_LEN] = {};
-                    char decompressed_out[meshtastic_Constants_DATA_PAYLOAD_LEN] = {};
-                    int decompressed_len;
-
-                    memcpy(compressed_in, p->decoded.payload.bytes, p->decoded.payload.size);
-
-                    decompressed_len = unishox2_decompress_simple(compressed_in, p->decoded.payload.size, decompressed_out);
-
-                    // LOG_DEBUG("\n\n**\n\nDecompressed length - %d \n", decompressed_len);
-
-                    memcpy(p->decoded.payload.bytes, decompressed_out, decompressed_len);
-
-                    // Switch the port from PortNum_TEXT_MESSAGE_COMPRESSED_APP to PortNum_TEXT_MESSAGE_APP
-                    p->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
-                } */
+                if (p->decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_COMPRESSED_APP && perhapsDecompress(&p->decoded) &&
+                    !wasDecompressed(p->from, p->id)) {
+                    recentDecompressed[nextDecompressed] = {p->from, p->id};
+                    nextDecompressed = (nextDecompressed + 1) % RECENT_DECOMPRESSED;
+                }
 
                 printPacket("decoded message", p);
                 return true;
@@ -367,44 +418,12 @@ meshtastic_Routing_Error perhapsEncode(meshtastic_MeshPacket *p)
 
     // If the packet is not yet encrypted, do so now
     if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
+        // unishox2 is deterministic, so a relayed message goes out as the same bytes the sender compressed it to
+        if (p->decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_APP &&
+            (MESHTASTIC_COMPRESS_TEXT || wasDecompressed(getFrom(p), p->id)))
+            perhapsCompress(&p->decoded);
         size_t numbytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_Data_msg, &p->decoded);
 
-        /* Not actually used, so save the cycles
-        // Only allow encryption on the text message app.
-        //  TODO: Allow modules to opt into compression.
-        if (p->decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_APP) {
-
-            char original_payload[meshtastic_Constants_DATA_PAYLOAD_LEN];
-            memcpy(original_payload, p->decoded.payload.bytes, p->decoded.payload.size);
-
-            char compressed_out[meshtastic_Constants_DATA_PAYLOAD_LEN] = {0};
-
-            int compressed_len;
-            compressed_len = unishox2_compress_simple(original_payload, p->decoded.payload.size, compressed_out);
-
-            LOG_DEBUG("Original length - %d \n", p->decoded.payload.size);
-            LOG_DEBUG("Compressed length - %d \n", compressed_len);
-            LOG_DEBUG("Original message - %s \n", p->decoded.payload.bytes);
-
-            // If the compressed length is greater than or equal to the original size, don't use the compressed form
-            if (compressed_len >= p->decoded.payload.size) {
-
-                LOG_DEBUG("Not using compressing message.\n");
-                // Set the uncompressed payload variant anyway. Shouldn't hurt?
-                // p->decoded.which_payloadVariant = Data_payload_tag;
-
-                // Otherwise we use the compressor
-            } else {
-                LOG_DEBUG("Using compressed message.\n");
-                // Copy the compressed data into the meshpacket
-
-                p->decoded.payload.size = compressed_len;
-                memcpy(p->decoded.payload.bytes, compressed_out, compressed_len);
-
-                p->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_COMPRESSED_APP;
-            }
-        } */
-
         if (numbytes > MAX_RHPACKETLEN)
             return meshtastic_Routing_Error_TOO_LARGE;
 
@@ -487,17 +506,34 @@ void Router::perhapsHandleReceived(meshtastic_MeshPacket *p)
 {
     // assert(radioConfig.has_preferences);
     bool ignore = is_in_repeated(config.lora.ignore_incoming, p->from) || (config.lora.ignore_mqtt && p->via_mqtt);
+    RxDisposition disposition = RX_DISPOSITION_IGNORED;
+    uint32_t rebroadcastsBefore = rebroadcastCount;
+
+    // Even duplicates we'll drop below tell us how well we hear our neighbors
+    if (!ignore && !p->via_mqtt && p->from != getNodeNum()) {
+        if (p->hop_start != 0 && p->hop_start == p->hop_limit)
+            linkTable.onOriginalHeard(p->from, p->id, p->rx_snr, millis());
+        else if (rxRelayNode != 0)
+            linkTable.onRelayHeard(rxRelayNode, p->rx_snr, millis());
+    }
 
     if (ignore) {
         LOG_DEBUG("Ignoring incoming message, 0x%x is in our ignore list or came via MQTT\n", p->from);
     } else if (ignore |= shouldFilterReceived(p)) {
         LOG_DEBUG("Incoming message was filtered 0x%x\n", p->from);
+        disposition = RX_DISPOSITION_FILTERED;
     }
 
     // Note: we avoid calling shouldFilterReceived if we are supposed to ignore certain nodes - because some overrides might
     // cache/learn of the existence of nodes (i.e. FloodRouter) that they should not
-    if (!ignore)
+    if (!ignore) {
         handleReceived(p);
+        disposition = p->which_payload_variant == meshtastic_MeshPacket_decoded_tag ? RX_DISPOSITION_HANDLED
+                                                                                     : RX_DISPOSITION_UNDECODABLE;
+    }
+
+    RxProcessedEvent event = {p, disposition, rebroadcastCount != rebroadcastsBefore};
+    rxProcessed.notifyObservers(&event);
 
     packetPool.release(p);
 }
\ No newline at end of file
@@ -7,6 +7,17 @@
 #include "PointerQueue.h"
 #include "RadioInterface.h"
 #include "concurrency/OSThread.h"
+#include <queue>
+
+/// What became of a packet received from the radio
+enum RxDisposition { RX_DISPOSITION_HANDLED, RX_DISPOSITION_IGNORED, RX_DISPOSITION_FILTERED, RX_DISPOSITION_UNDECODABLE };
+
+/// Passed to Router::rxProcessed observers once a received packet has been fully processed (but not yet freed)
+struct RxProcessedEvent {
+    const meshtastic_MeshPacket *p;
+    RxDisposition disposition;
+    bool rebroadcast; // the packet caused us to queue a rebroadcast
+};
 
 /**
  * A mesh aware router that supports multiple interfaces.
@@ -18,10 +29,27 @@ class Router : protected concurrency::OSThread
     /// forwarded to the phone.
     PointerQueue<meshtastic_MeshPacket> fromRadioQueue;
 
+    /// The relay fields of the LoRa header (which have no MeshPacket field) for every packet in fromRadioQueue, in order
+    struct RelayHeader {
+        uint8_t nextHop;
+        uint8_t relayNode;
+    };
+    std::queue<RelayHeader> fromRadioRelayHeaders;
+
   protected:
     RadioInterface *iface = NULL;
 
+    /// Incremented by subclasses whenever they queue a rebroadcast of a received packet
+    uint32_t rebroadcastCount = 0;
+
+    /// The next_hop and relay_node header fields of the packet currently being processed (0 if it wasn't received by LoRa)
+    uint8_t rxNextHop = NO_NEXT_HOP_PREFERENCE;
+    uint8_t rxRelayNode = 0;
+
   public:
+    /// Notified for every packet taken from the receive queue, e.g. for benchmarking with a replayed radio trace
+    Observable<const RxProcessedEvent *> rxProcessed;
+
     /**
      * Constructor
      *
@@ -58,10 +86,19 @@ class Router : protected concurrency::OSThread
     /** Return Underlying interface's TX queue status */
     meshtastic_QueueStatus getQueueStatus();
 
+    /** Return the airtime in msec of a packet we'd send, decoded or not, or 0 if we have no interface */
+    uint32_t getPacketTime(const meshtastic_MeshPacket *p) { return iface ? iface->getPacketTime(p) : 0; }
+
+    /** Return the airtime in msec of a packet of this length (header included), or 0 if we have no interface */
+    uint32_t getPacketTime(uint32_t totalPacketLen) { return iface ? iface->getPacketTime(totalPacketLen) : 0; }
+
     /**
      * @return our local nodenum */
     NodeNum getNodeNum();
 
+    /** Did we already receive or send this packet?  Routers that keep no packet history never have */
+    virtual bool wasSeenRecently(const meshtastic_MeshPacket *p, bool withUpdate = true) { return false; }
+
     /** Wake up the router thread ASAP, because we just queued a message for it.
      * FIXME, this is kinda a hack because we don't have a nice way yet to say 'wake us because we are 'blocked on this queue'
      */
@@ -71,7 +108,16 @@ class Router : protected concurrency::OSThread
      * RadioInterface calls this to queue up packets that have been received from the radio.  The router is now responsible for
      * freeing the packet
      */
-    void enqueueReceivedMessage(meshtastic_MeshPacket *p);
+    void enqueueReceivedMessage(meshtastic_MeshPacket *p, uint8_t nextHop = NO_NEXT_HOP_PREFERENCE, uint8_t relayNode = 0);
+
+    /**
+     * The next_hop to put in the LoRa header when transmitting this packet, i.e. the last byte of the only neighbor which
+     * should relay it.  Called by the radio right before sending.
+     */
+    virtual uint8_t getNextHop(const meshtastic_MeshPacket *p) { return NO_NEXT_HOP_PREFERENCE; }
+
+    /// Tell the router that dest can be reached through the neighbor with nextHop as its last byte, e.g. from a traceroute
+    virtual void learnNextHop(NodeNum dest, uint8_t nextHop) {}
 
     /**
      * Send a packet on a suitable interface.  This routine will
@@ -139,6 +185,18 @@ class Router : protected concurrency::OSThread
  */
 bool perhapsDecode(meshtastic_MeshPacket *p);
 
+/// Build with -DMESHTASTIC_COMPRESS_TEXT=1 to send text messages unishox2 compressed when that makes them smaller.
+/// Compressed text is decompressed on reception either way, and relayed compressed again.
+#ifndef MESHTASTIC_COMPRESS_TEXT
+#define MESHTASTIC_COMPRESS_TEXT 0
+#endif
+
+/// Replace a TEXT_MESSAGE_APP payload with its compressed form and switch to TEXT_MESSAGE_COMPRESSED_APP, if that is smaller
+void perhapsCompress(meshtastic_Data *d);
+
+/// Undo perhapsCompress(), return false and leave the payload alone if it doesn't decompress into a whole payload
+bool perhapsDecompress(meshtastic_Data *d);
+
 /** Return 0 for success or a Routing_Errror code for failure
  */
 meshtastic_Routing_Error perhapsEncode(meshtastic_MeshPacket *p);
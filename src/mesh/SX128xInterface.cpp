@@ -63,6 +63,7 @@ template <typename T> bool SX128xInterface<T>::init()
     limitPower();
 
     preambleLength = 12; // 12 is the default for this chip, 32 does not RX at all
+    computePacketTimeTable();
 
     int res = lora.begin(getFreq(), bw, sf, cr, syncWord, power, preambleLength);
     // \todo Display actual typename of the adapter, not just `SX128x`
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cassert>
+#include <climits>
 #include <type_traits>
 
 #include "concurrency/OSThread.h"
@@ -78,7 +79,7 @@ template <class T> class TypedQueue
   public:
     explicit TypedQueue(int maxElements) {}
 
-    int numFree() { return 1; } // Always claim 1 free, because we can grow to any size
+    int numFree() { return INT_MAX; } // Always claim room, because we can grow to any size
 
     bool isEmpty() { return q.empty(); }
 
@@ -1421,3 +1421,17 @@ int unishox2_decompress_simple(const char *in, int len, char *out)
 {
     return unishox2_decompress(in, len, UNISHOX_API_OUT_AND_LEN(out, INT_MAX - 1), USX_PSET_DFLT);
 }
+
+#if defined(UNISHOX_API_WITH_OUTPUT_LEN) && UNISHOX_API_WITH_OUTPUT_LEN != 0
+// Main API function. See unishox2.h for documentation
+int unishox2_compress_simple_olen(const char *in, int len, char *out, int olen)
+{
+    return unishox2_compress(in, len, out, olen, USX_PSET_DFLT);
+}
+
+// Main API function. See unishox2.h for documentation
+int unishox2_decompress_simple_olen(const char *in, int len, char *out, int olen)
+{
+    return unishox2_decompress(in, len, out, olen, USX_PSET_DFLT);
+}
+#endif
@@ -320,6 +320,18 @@ extern int unishox2_compress_simple(const char *in, int len, char *out);
  * @param[out] out  output buffer for ASCII / UTF-8 string - should be large enough
  */
 extern int unishox2_decompress_simple(const char *in, int len, char *out);
+#if defined(UNISHOX_API_WITH_OUTPUT_LEN) && UNISHOX_API_WITH_OUTPUT_LEN != 0
+/**
+ * Simple API for compressing a string into a buffer of olen bytes, for C++ callers that can't pass the USX_PSET_* presets
+ * @return the compressed length, or a value below 1 or above olen if it doesn't fit
+ */
+extern int unishox2_compress_simple_olen(const char *in, int len, char *out, int olen);
+/**
+ * Simple API for decompressing a string into a buffer of olen bytes
+ * @return the decompressed length, or a value below 1 or above olen if it doesn't fit or the input is invalid
+ */
+extern int unishox2_decompress_simple_olen(const char *in, int len, char *out, int olen);
+#endif
 /**
  * Comprehensive API for compressing a string
  *
@@ -10,6 +10,9 @@
 #include "mesh/wifi/WiFiAPClient.h"
 #endif
 #include "mqtt/JSON.h"
+#if !MESHTASTIC_EXCLUDE_MQTT
+#include "mqtt/MQTT.h"
+#endif
 #include "power.h"
 #include "sleep.h"
 #include <FSCommon.h>
@@ -652,6 +655,17 @@ void handleReport(HTTPRequest *req, HTTPResponse *res)
     jsonObjRadio["frequency"] = new JSONValue(RadioLibInterface::instance->getFreq());
     jsonObjRadio["lora_channel"] = new JSONValue((int)RadioLibInterface::instance->getChannelNum() + 1);
 
+#if !MESHTASTIC_EXCLUDE_MQTT
+    // data->mqtt
+    JSONObject jsonObjMqtt;
+    if (mqtt) {
+        jsonObjMqtt["downlink_received"] = new JSONValue((int)mqtt->downlinkReceived);
+        jsonObjMqtt["downlink_duplicate"] = new JSONValue((int)mqtt->downlinkDuplicate);
+        jsonObjMqtt["downlink_rate_limited"] = new JSONValue((int)mqtt->downlinkRateLimited);
+        jsonObjMqtt["downlink_injected"] = new JSONValue((int)mqtt->downlinkInjected);
+    }
+#endif
+
     // collect data to inner data object
     JSONObject jsonObjInner;
     jsonObjInner["airtime"] = new JSONValue(jsonObjAirtime);
@@ -660,6 +674,9 @@ void handleReport(HTTPRequest *req, HTTPResponse *res)
     jsonObjInner["power"] = new JSONValue(jsonObjPower);
     jsonObjInner["device"] = new JSONValue(jsonObjDevice);
     jsonObjInner["radio"] = new JSONValue(jsonObjRadio);
+#if !MESHTASTIC_EXCLUDE_MQTT
+    jsonObjInner["mqtt"] = new JSONValue(jsonObjMqtt);
+#endif
 
     // create json output structure
     JSONObject jsonObjOuter;
@@ -61,6 +61,7 @@ mail:   marchammermann@googlemail.com
 
 #include "PortduinoFS.h"
 #include "platform/portduino/PortduinoGlue.h"
+#include "platform/portduino/TopologyGraph.h"
 
 #define DEFAULT_REALM "default_realm"
 #define PREFIX ""
@@ -296,6 +297,24 @@ int handleAPIv1FromRadio(const struct _u_request *req, struct _u_response *res,
     return U_CALLBACK_COMPLETE;
 }
 
+/*
+ * The mesh topology as JSON, see TopologyGraph.  With ?from=NODENUM&to=NODENUM, the lowest ETX path between them instead.
+ */
+int handleAPIv1Topology(const struct _u_request *req, struct _u_response *res, void *user_data)
+{
+    ulfius_add_header_to_response(res, "Content-Type", "application/json");
+    ulfius_add_header_to_response(res, "Access-Control-Allow-Origin", "*");
+    ulfius_add_header_to_response(res, "Access-Control-Allow-Methods", "GET");
+
+    const char *from = u_map_get(req->map_url, "from");
+    const char *to = u_map_get(req->map_url, "to");
+    uint32_t now = millis() / 1000;
+    std::string json = from && to ? topologyGraph.pathToJson(strtoul(from, NULL, 0), strtoul(to, NULL, 0), now)
+                                  : topologyGraph.toJson(now);
+    ulfius_set_string_body_response(res, 200, json.c_str());
+    return U_CALLBACK_COMPLETE;
+}
+
 /*
 OpenSSL RSA Key Gen
 */
@@ -494,6 +513,7 @@ PiWebServerThread::PiWebServerThread()
         instanceWeb.max_post_body_size = 1024;
         ulfius_add_endpoint_by_val(&instanceWeb, "GET", PREFIX, "/api/v1/fromradio/*", 1, &handleAPIv1FromRadio, NULL);
         ulfius_add_endpoint_by_val(&instanceWeb, "PUT", PREFIX, "/api/v1/toradio/*", 1, &handleAPIv1ToRadio, configWeb.rootPath);
+        ulfius_add_endpoint_by_val(&instanceWeb, "GET", PREFIX, "/api/v1/topology", 1, &handleAPIv1Topology, NULL);
 
         // Add callback function to all endpoints for the Web Server
         ulfius_add_endpoint_by_val(&instanceWeb, "GET", NULL, "/*", 2, &callback_static_file, &configWeb);
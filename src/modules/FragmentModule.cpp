@@ -0,0 +1,281 @@
+#include "FragmentModule.h"
+#include "MeshService.h"
+#include "NodeDB.h"
+#include "configuration.h"
+#include "main.h"
+#include <algorithm>
+
+FragmentModule *fragmentModule;
+
+#define FRAGMENT_TYPE_DATA 0
+#define FRAGMENT_TYPE_REPORT 1
+
+#define FRAGMENT_REPORT_LEN 7 // type, payload id and the bitmap of missing fragments
+
+/// Payloads we send or reassemble at the same time, each holds a buffer of up to FRAGMENT_MAX_PAYLOAD_LEN
+#define FRAGMENT_MAX_OUTGOING 2
+#define FRAGMENT_MAX_INCOMING 2
+
+/// TX queue slots we leave to other traffic
+#define FRAGMENT_TX_QUEUE_RESERVE 4
+
+/// Receivers report what they're missing after this long without a fragment, and give up after FRAGMENT_MAX_REPORTS
+#define FRAGMENT_REPORT_MSECS (15 * 1000)
+#define FRAGMENT_MAX_REPORTS 3
+
+/// Senders retransmit the last fragment to ask for a report after this long without one, and give up after
+/// FRAGMENT_MAX_RETRIES
+#define FRAGMENT_RETRY_MSECS (30 * 1000)
+#define FRAGMENT_MAX_RETRIES 3
+
+#define FRAGMENT_POLL_MSECS 1000
+
+static_assert(FRAGMENT_MAX_COUNT <= 32, "missing fragments are reported as a 32 bit bitmap");
+
+/// @return the bitmap with a bit set for each of count fragments
+static uint32_t allFragments(uint8_t count)
+{
+    return count == 32 ? UINT32_MAX : (1UL << count) - 1;
+}
+
+FragmentModule::FragmentModule() : SinglePortModule("fragment", FRAGMENT_PORTNUM), OSThread("FragmentModule")
+{
+    nextId = random(0, UINT16_MAX);
+}
+
+bool FragmentModule::send(NodeNum to, meshtastic_PortNum portnum, const uint8_t *bytes, size_t size, ChannelIndex channel)
+{
+    if (size == 0 || size > FRAGMENT_MAX_PAYLOAD_LEN) {
+        LOG_WARN("Can't fragment a payload of %u bytes\n", (unsigned)size);
+        return false;
+    }
+    if (outgoing.size() >= FRAGMENT_MAX_OUTGOING) {
+        LOG_WARN("Still sending %u fragmented payloads, try again later\n", (unsigned)outgoing.size());
+        return false;
+    }
+
+    Outgoing o;
+    o.to = to;
+    o.channel = channel;
+    o.portnum = portnum;
+    o.id = nextId++;
+    o.count = (size + FRAGMENT_DATA_LEN - 1) / FRAGMENT_DATA_LEN;
+    o.unsent = allFragments(o.count);
+    o.retries = 0;
+    o.lastActivityMsec = millis();
+    o.bytes.assign(bytes, bytes + size);
+    LOG_INFO("Sending %u bytes to 0x%x in %d fragments, id 0x%x\n", (unsigned)size, to, o.count, o.id);
+    outgoing.push_back(std::move(o));
+
+    setIntervalFromNow(0);
+    return true;
+}
+
+bool FragmentModule::sendFragments(Outgoing &o)
+{
+    for (uint8_t i = 0; i < o.count && o.unsent; i++) {
+        if (!(o.unsent & (1UL << i)))
+            continue;
+
+        meshtastic_QueueStatus qs = router->getQueueStatus();
+        if (qs.maxlen && qs.free <= FRAGMENT_TX_QUEUE_RESERVE)
+            return false;
+
+        size_t offset = i * FRAGMENT_DATA_LEN;
+        size_t len = std::min((size_t)FRAGMENT_DATA_LEN, o.bytes.size() - offset);
+        meshtastic_MeshPacket *p = allocDataPacket();
+        p->to = o.to;
+        p->channel = o.channel;
+        p->want_ack = false; // we find out what's missing ourselves, with one report per payload instead of an ack per fragment
+        p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
+        uint8_t *b = p->decoded.payload.bytes;
+        b[0] = FRAGMENT_TYPE_DATA;
+        b[1] = o.id & 0xff;
+        b[2] = o.id >> 8;
+        b[3] = i;
+        b[4] = o.count;
+        b[5] = o.portnum & 0xff;
+        b[6] = o.portnum >> 8;
+        memcpy(b + FRAGMENT_HEADER_LEN, o.bytes.data() + offset, len);
+        p->decoded.payload.size = FRAGMENT_HEADER_LEN + len;
+        service.sendToMesh(p);
+
+        o.unsent &= ~(1UL << i);
+        o.lastActivityMsec = millis();
+    }
+    return true;
+}
+
+void FragmentModule::sendReport(NodeNum to, ChannelIndex channel, uint16_t id, uint32_t missing)
+{
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->to = to;
+    p->channel = channel;
+    p->want_ack = false;
+    uint8_t *b = p->decoded.payload.bytes;
+    b[0] = FRAGMENT_TYPE_REPORT;
+    b[1] = id & 0xff;
+    b[2] = id >> 8;
+    b[3] = missing & 0xff;
+    b[4] = (missing >> 8) & 0xff;
+    b[5] = (missing >> 16) & 0xff;
+    b[6] = missing >> 24;
+    p->decoded.payload.size = FRAGMENT_REPORT_LEN;
+    service.sendToMesh(p);
+}
+
+ProcessMessage FragmentModule::handleReceived(const meshtastic_MeshPacket &mp)
+{
+    const meshtastic_Data &d = mp.decoded;
+    if (d.payload.size > FRAGMENT_HEADER_LEN && d.payload.bytes[0] == FRAGMENT_TYPE_DATA)
+        handleFragment(mp);
+    else if (d.payload.size == FRAGMENT_REPORT_LEN && d.payload.bytes[0] == FRAGMENT_TYPE_REPORT)
+        handleReport(mp);
+    else
+        LOG_WARN("Ignoring malformed fragment\n");
+
+    return ProcessMessage::STOP;
+}
+
+void FragmentModule::handleFragment(const meshtastic_MeshPacket &mp)
+{
+    const uint8_t *b = mp.decoded.payload.bytes;
+    uint16_t id = b[1] | (b[2] << 8);
+    uint8_t index = b[3], count = b[4];
+    meshtastic_PortNum portnum = (meshtastic_PortNum)(b[5] | (b[6] << 8));
+    size_t len = mp.decoded.payload.size - FRAGMENT_HEADER_LEN;
+    NodeNum from = getFrom(&mp);
+    uint32_t now = millis();
+
+    if (count == 0 || count > FRAGMENT_MAX_COUNT || index >= count || (index < count - 1 && len != FRAGMENT_DATA_LEN)) {
+        LOG_WARN("Ignoring fragment %d of %d from 0x%x\n", index, count, from);
+        return;
+    }
+
+    for (auto &c : completed) {
+        if (c.from == from && c.id == id) {
+            // The sender didn't get our report and is asking again
+            if (mp.to != NODENUM_BROADCAST)
+                sendReport(from, mp.channel, id, 0);
+            return;
+        }
+    }
+
+    auto in = std::find_if(incoming.begin(), incoming.end(), [&](const Incoming &i) { return i.from == from && i.id == id; });
+    if (in == incoming.end()) {
+        if (incoming.size() >= FRAGMENT_MAX_INCOMING) {
+            auto oldest = std::min_element(incoming.begin(), incoming.end(), [](const Incoming &a, const Incoming &b) {
+                return (int32_t)(a.lastActivityMsec - b.lastActivityMsec) < 0;
+            });
+            LOG_WARN("Dropping payload 0x%x from 0x%x to reassemble a newer one\n", oldest->id, oldest->from);
+            incoming.erase(oldest);
+        }
+        Incoming n = {from, mp.to, mp.channel, portnum, id, count, 0, 0, 0, now, {}};
+        n.bytes.resize(count * FRAGMENT_DATA_LEN);
+        incoming.push_back(std::move(n));
+        in = incoming.end() - 1;
+    }
+    if (in->count != count)
+        return;
+
+    in->lastActivityMsec = now;
+    // Wake up to report missing fragments, or drop the payload, if the rest doesn't come.  While sending, we already poll
+    if (outgoing.empty())
+        setIntervalFromNow(FRAGMENT_POLL_MSECS);
+    if (!(in->received & (1UL << index))) {
+        memcpy(in->bytes.data() + index * FRAGMENT_DATA_LEN, b + FRAGMENT_HEADER_LEN, len);
+        in->received |= 1UL << index;
+        if (index == count - 1)
+            in->size = index * FRAGMENT_DATA_LEN + len;
+    }
+
+    uint32_t missing = allFragments(count) & ~in->received;
+    if (!missing) {
+        complete(in);
+    } else if (index == count - 1 && mp.to != NODENUM_BROADCAST) {
+        // Fragments are sent in order, so the ones before the last that we don't have were lost
+        in->reports++;
+        sendReport(from, mp.channel, id, missing);
+    }
+}
+
+void FragmentModule::complete(std::vector<Incoming>::iterator in)
+{
+    LOG_INFO("Reassembled %u bytes from 0x%x for port %d\n", (unsigned)in->size, in->from, in->portnum);
+    if (in->to != NODENUM_BROADCAST)
+        sendReport(in->from, in->channel, in->id, 0);
+    completed[nextCompleted] = {in->from, in->id};
+    nextCompleted = (nextCompleted + 1) % (sizeof(completed) / sizeof(completed[0]));
+
+    FragmentedPayload payload = {in->from, in->to, in->channel, in->portnum, in->bytes.data(), in->size};
+    notifyObservers(&payload);
+    incoming.erase(in);
+}
+
+void FragmentModule::handleReport(const meshtastic_MeshPacket &mp)
+{
+    const uint8_t *b = mp.decoded.payload.bytes;
+    uint16_t id = b[1] | (b[2] << 8);
+    uint32_t missing = b[3] | (b[4] << 8) | (b[5] << 16) | ((uint32_t)b[6] << 24);
+    NodeNum from = getFrom(&mp);
+
+    auto o = std::find_if(outgoing.begin(), outgoing.end(), [&](const Outgoing &out) { return out.to == from && out.id == id; });
+    if (o == outgoing.end())
+        return;
+
+    if (!missing) {
+        LOG_INFO("0x%x received all of payload 0x%x\n", from, id);
+        outgoing.erase(o);
+        return;
+    }
+    LOG_DEBUG("0x%x is missing fragments 0x%x of payload 0x%x, retransmitting them\n", from, missing, id);
+    o->unsent |= missing & allFragments(o->count);
+    o->retries = 0;
+    o->lastActivityMsec = millis();
+    setIntervalFromNow(0);
+}
+
+int32_t FragmentModule::runOnce()
+{
+    uint32_t now = millis();
+
+    for (auto in = incoming.begin(); in != incoming.end();) {
+        if (now - in->lastActivityMsec < FRAGMENT_REPORT_MSECS) {
+            ++in;
+            continue;
+        }
+        if (in->to == NODENUM_BROADCAST || in->reports >= FRAGMENT_MAX_REPORTS) {
+            LOG_WARN("Dropping incomplete payload 0x%x from 0x%x\n", in->id, in->from);
+            in = incoming.erase(in);
+            continue;
+        }
+        in->reports++;
+        in->lastActivityMsec = now;
+        sendReport(in->from, in->channel, in->id, allFragments(in->count) & ~in->received);
+        ++in;
+    }
+
+    for (auto o = outgoing.begin(); o != outgoing.end();) {
+        if (o->unsent && !sendFragments(*o))
+            return FRAGMENT_POLL_MSECS; // the TX queue is full, try again later
+
+        if (o->to == NODENUM_BROADCAST) {
+            o = outgoing.erase(o); // nobody reports back on broadcasts
+            continue;
+        }
+        if (now - o->lastActivityMsec >= FRAGMENT_RETRY_MSECS) {
+            if (o->retries >= FRAGMENT_MAX_RETRIES) {
+                LOG_WARN("0x%x didn't confirm payload 0x%x, giving up\n", o->to, o->id);
+                o = outgoing.erase(o);
+                continue;
+            }
+            // The receiver answers the last fragment with what it's missing
+            o->retries++;
+            o->unsent |= 1UL << (o->count - 1);
+            sendFragments(*o);
+        }
+        ++o;
+    }
+
+    return (outgoing.empty() && incoming.empty()) ? INT32_MAX : FRAGMENT_POLL_MSECS;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "Observer.h"
+#include "SinglePortModule.h"
+#include "concurrency/OSThread.h"
+#include <vector>
+
+/// The port fragments travel on.  In the private range, as it isn't in portnums.proto yet
+#define FRAGMENT_PORTNUM ((meshtastic_PortNum)258)
+
+/// Most fragments one payload is split into, at most 32 as missing fragments are reported as a bitmap
+#ifndef FRAGMENT_MAX_COUNT
+#define FRAGMENT_MAX_COUNT 16
+#endif
+
+/// Type, payload id, fragment index and count, and the original port number
+#define FRAGMENT_HEADER_LEN 7
+
+#define FRAGMENT_DATA_LEN (meshtastic_Constants_DATA_PAYLOAD_LEN - FRAGMENT_HEADER_LEN)
+
+/// The largest payload send() accepts
+#define FRAGMENT_MAX_PAYLOAD_LEN (FRAGMENT_MAX_COUNT * FRAGMENT_DATA_LEN)
+
+/**
+ * A payload that was reassembled from its fragments, passed to the observers of FragmentModule
+ */
+struct FragmentedPayload {
+    NodeNum from;
+    NodeNum to;
+    ChannelIndex channel;
+    meshtastic_PortNum portnum;
+    const uint8_t *bytes;
+    size_t size;
+};
+
+/**
+ * Moves payloads larger than a single packet (up to FRAGMENT_MAX_PAYLOAD_LEN) by splitting them into numbered fragments.
+ *
+ * The fragments are sent without want_ack, as fast as the TX queue takes them.  A receiver keeps a bounded number of
+ * payloads in reassembly, and reports which fragments it is missing when the last one arrived or when the sender went
+ * quiet; the sender then retransmits only those.  Once everything arrived the receiver reports nothing missing, and the
+ * payload is passed to the observers of this module.  Broadcast payloads are sent once, without any reports.
+ */
+class FragmentModule : public SinglePortModule, public Observable<const FragmentedPayload *>, private concurrency::OSThread
+{
+  public:
+    FragmentModule();
+
+    /**
+     * Send a payload for portnum, fragmented as needed.  The payload is copied.
+     *
+     * @return false if it's too large, or too many other payloads are still being sent
+     */
+    bool send(NodeNum to, meshtastic_PortNum portnum, const uint8_t *bytes, size_t size, ChannelIndex channel = 0);
+
+  protected:
+    virtual ProcessMessage handleReceived(const meshtastic_MeshPacket &mp) override;
+
+    virtual int32_t runOnce() override;
+
+  private:
+    /// A payload we are sending
+    struct Outgoing {
+        NodeNum to;
+        ChannelIndex channel;
+        meshtastic_PortNum portnum;
+        uint16_t id;
+        uint8_t count;
+        uint32_t unsent; // bitmap of the fragments still to (re)transmit
+        uint8_t retries;
+        uint32_t lastActivityMsec;
+        std::vector<uint8_t> bytes;
+    };
+
+    /// A payload we are reassembling
+    struct Incoming {
+        NodeNum from;
+        NodeNum to;
+        ChannelIndex channel;
+        meshtastic_PortNum portnum;
+        uint16_t id;
+        uint8_t count;
+        uint32_t received; // bitmap of the fragments we have
+        size_t size;
+        uint8_t reports;
+        uint32_t lastActivityMsec;
+        std::vector<uint8_t> bytes;
+    };
+
+    /// A payload we reassembled, remembered to answer retransmissions of its last fragment
+    struct Completed {
+        NodeNum from;
+        uint16_t id;
+    };
+
+    std::vector<Outgoing> outgoing;
+    std::vector<Incoming> incoming;
+    Completed completed[4] = {};
+    uint8_t nextCompleted = 0;
+    uint16_t nextId;
+
+    void handleFragment(const meshtastic_MeshPacket &mp);
+    void handleReport(const meshtastic_MeshPacket &mp);
+
+    /// Send as many unsent fragments of o as the TX queue takes, @return false if the queue is full
+    bool sendFragments(Outgoing &o);
+
+    /// Tell the sender of a unicast payload which fragments we're still missing, none once it is complete
+    void sendReport(NodeNum to, ChannelIndex channel, uint16_t id, uint32_t missing);
+
+    void complete(std::vector<Incoming>::iterator in);
+};
+
+extern FragmentModule *fragmentModule;
@@ -1,8 +1,16 @@
 #include "NeighborInfoModule.h"
 #include "Default.h"
+#include "LinkTable.h"
 #include "MeshService.h"
 #include "NodeDB.h"
 #include "RTC.h"
+#include <algorithm>
+#include <math.h>
+#include <pb_decode.h>
+#include <pb_encode.h>
+#ifdef ARCH_PORTDUINO
+#include "platform/portduino/TopologyGraph.h"
+#endif
 
 NeighborInfoModule *neighborInfoModule;
 
@@ -27,9 +35,9 @@ NOTE: for debugging only
 */
 void NeighborInfoModule::printNodeDBNeighbors()
 {
-    LOG_DEBUG("Our NodeDB contains %d neighbors\n", neighbors.size());
-    for (size_t i = 0; i < neighbors.size(); i++) {
-        LOG_DEBUG("Node %d: node_id=0x%x, snr=%.2f\n", i, neighbors[i].node_id, neighbors[i].snr);
+    LOG_DEBUG("Our link table contains %d neighbors\n", linkTable.size());
+    for (auto &link : linkTable.getLinks()) {
+        LOG_DEBUG("Node 0x%x: snr=%.2f, etx=%.2f\n", link.node, link.snr, link.getEtx());
     }
 }
 
@@ -39,9 +47,11 @@ NeighborInfoModule::NeighborInfoModule()
       concurrency::OSThread("NeighborInfoModule")
 {
     ourPortNum = meshtastic_PortNum_NEIGHBORINFO_APP;
+#if MESHTASTIC_NEIGHBORINFO_DELTA
+    keyframeNumber = random(0, UINT16_MAX); // so our deltas aren't applied to a full list from before we rebooted
+#endif
 
     if (moduleConfig.neighbor_info.enabled) {
-        isPromiscuous = true; // Update neighbors from all packets
         setIntervalFromNow(
             Default::getConfiguredOrDefaultMs(moduleConfig.neighbor_info.update_interval, default_broadcast_interval_secs));
     } else {
@@ -51,7 +61,7 @@ NeighborInfoModule::NeighborInfoModule()
 }
 
 /*
-Collect neighbor info from the nodeDB's history, capping at a maximum number of entries and max time
+Collect neighbor info from the link table, the most recently heard neighbors first, capping at a maximum number of entries
 Assumes that the neighborInfo packet has been allocated
 @returns the number of entries collected
 */
@@ -64,15 +74,22 @@ uint32_t NeighborInfoModule::collectNeighborInfo(meshtastic_NeighborInfo *neighb
 
     cleanUpNeighbors();
 
-    for (auto nbr : neighbors) {
-        if ((neighborInfo->neighbors_count < MAX_NUM_NEIGHBORS) && (nbr.node_id != my_node_id)) {
-            neighborInfo->neighbors[neighborInfo->neighbors_count].node_id = nbr.node_id;
-            neighborInfo->neighbors[neighborInfo->neighbors_count].snr = nbr.snr;
+    auto &links = linkTable.getLinks();
+    for (auto link = links.rbegin(); link != links.rend(); ++link) {
+        if ((neighborInfo->neighbors_count < MAX_NUM_NEIGHBORS) && (link->node != my_node_id)) {
+            neighborInfo->neighbors[neighborInfo->neighbors_count].node_id = link->node;
+            neighborInfo->neighbors[neighborInfo->neighbors_count].snr = link->snr;
             // Note: we don't set the last_rx_time and node_broadcast_intervals_secs here, because we don't want to send this over
             // the mesh
             neighborInfo->neighbors_count++;
         }
     }
+#ifdef ARCH_PORTDUINO
+    TopologyGraph::Neighbor ours[MAX_NUM_NEIGHBORS];
+    for (pb_size_t i = 0; i < neighborInfo->neighbors_count; i++)
+        ours[i] = {neighborInfo->neighbors[i].node_id, neighborInfo->neighbors[i].snr};
+    topologyGraph.setNeighbors(my_node_id, ours, neighborInfo->neighbors_count, millis() / 1000);
+#endif
     printNodeDBNeighbors();
     return neighborInfo->neighbors_count;
 }
@@ -82,18 +99,11 @@ uint32_t NeighborInfoModule::collectNeighborInfo(meshtastic_NeighborInfo *neighb
 */
 void NeighborInfoModule::cleanUpNeighbors()
 {
-    uint32_t now = getTime();
-    NodeNum my_node_id = nodeDB->getNodeNum();
-    for (auto it = neighbors.rbegin(); it != neighbors.rend();) {
-        // We will remove a neighbor if we haven't heard from them in twice the broadcast interval
-        if ((now - it->last_rx_time > it->node_broadcast_interval_secs * 2) && (it->node_id != my_node_id)) {
-            LOG_DEBUG("Removing neighbor with node ID 0x%x\n", it->node_id);
-            it = std::vector<meshtastic_Neighbor>::reverse_iterator(
-                neighbors.erase(std::next(it).base())); // Erase the element and update the iterator
-        } else {
-            ++it;
-        }
-    }
+    linkTable.expire(millis());
+    // What a node we don't hear anymore reaches doesn't matter to us
+    neighborLists.erase(std::remove_if(neighborLists.begin(), neighborLists.end(),
+                                       [](const NeighborList &l) { return !linkTable.get(l.node_id); }),
+                        neighborLists.end());
 }
 
 /* Send neighbor info to the mesh */
@@ -101,13 +111,26 @@ void NeighborInfoModule::sendNeighborInfo(NodeNum dest, bool wantReplies)
 {
     meshtastic_NeighborInfo neighborInfo = meshtastic_NeighborInfo_init_zero;
     collectNeighborInfo(&neighborInfo);
+    DeltaFields fields = {DeltaFields::PLAIN, 0, 0, {}, true};
+#if MESHTASTIC_NEIGHBORINFO_DELTA
+    // Whoever asks us directly gets the full list
+    if (dest == NODENUM_BROADCAST && !encodeDelta(&neighborInfo, fields)) {
+        LOG_DEBUG("Our neighbors didn't change since our last NeighborInfo, not sending\n");
+        return;
+    }
+#endif
     meshtastic_MeshPacket *p = allocDataProtobuf(neighborInfo);
+    appendDeltaFields(p, fields);
     // send regardless of whether or not we have neighbors in our DB,
     // because we want to get neighbors for the next cycle
     p->to = dest;
     p->decoded.want_response = wantReplies;
     printNeighborInfo("SENDING", &neighborInfo);
+#if MESHTASTIC_NEIGHBORINFO_DELTA
+    service.sendToMesh(p, RX_SRC_LOCAL, fields.kind != DeltaFields::DELTA); // the phone only gets our full lists
+#else
     service.sendToMesh(p, RX_SRC_LOCAL, true);
+#endif
 }
 
 /*
@@ -131,9 +154,24 @@ bool NeighborInfoModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp,
     if (np) {
         printNeighborInfo("RECEIVED", np);
         updateNeighbors(mp, np);
-    } else if (mp.hop_start != 0 && mp.hop_start == mp.hop_limit) {
-        // If the hopLimit is the same as hopStart, then it is a neighbor
-        getOrCreateNeighbor(mp.from, mp.from, 0, mp.rx_snr); // Set the broadcast interval to 0, as we don't know it
+        updateNeighborList(mp, np);
+#if MESHTASTIC_NEIGHBORINFO_DELTA
+        DeltaFields fields;
+        readDeltaFields(mp, fields);
+        if (!fields.supportsDeltas) {
+            uint32_t interval = np->node_broadcast_interval_secs;
+            if (interval == 0 || interval > ONE_DAY)
+                interval = default_broadcast_interval_secs;
+            LOG_DEBUG("0x%x doesn't understand NeighborInfo deltas, sending full lists\n", np->node_id);
+            uint32_t now = millis(), since = now - noDeltaSupportHeardMsec;
+            uint32_t remaining = fullListsForMsec > since ? fullListsForMsec - since : 0;
+            noDeltaSupportHeardMsec = now;
+            fullListsForMsec = std::max<uint32_t>(remaining, NEIGHBORINFO_DELTA_BLOCK_INTERVALS * interval * 1000);
+        }
+#endif
+#ifdef ARCH_PORTDUINO
+        topologyGraph.onNeighborInfo(mp, np, millis() / 1000);
+#endif
     }
     // Allow others to handle this packet
     return false;
@@ -146,63 +184,235 @@ void NeighborInfoModule::alterReceivedProtobuf(meshtastic_MeshPacket &p, meshtas
 {
     n->last_sent_by_id = nodeDB->getNodeNum();
 
-    // Set updated last_sent_by_id to the payload of the to be flooded packet
+    // Set updated last_sent_by_id to the payload of the to be flooded packet, keeping the delta fields nanopb didn't decode
+    DeltaFields fields;
+    readDeltaFields(p, fields);
     p.decoded.payload.size =
         pb_encode_to_bytes(p.decoded.payload.bytes, sizeof(p.decoded.payload.bytes), &meshtastic_NeighborInfo_msg, n);
+    appendDeltaFields(&p, fields);
 }
 
 void NeighborInfoModule::resetNeighbors()
 {
-    neighbors.clear();
+    neighborLists.clear();
 }
 
-void NeighborInfoModule::updateNeighbors(const meshtastic_MeshPacket &mp, const meshtastic_NeighborInfo *np)
+void NeighborInfoModule::updateNeighborList(const meshtastic_MeshPacket &mp, const meshtastic_NeighborInfo *np)
 {
-    // The last sent ID will be 0 if the packet is from the phone, which we don't count as
-    // an edge. So we assume that if it's zero, then this packet is from our node.
-    if (mp.which_payload_variant == meshtastic_MeshPacket_decoded_tag && mp.from) {
-        getOrCreateNeighbor(mp.from, np->last_sent_by_id, np->node_broadcast_interval_secs, mp.rx_snr);
+    if (!linkTable.get(np->node_id) || np->node_id == nodeDB->getNodeNum())
+        return; // we only need to know what our own neighbors reach
+
+    DeltaFields fields;
+    readDeltaFields(mp, fields);
+
+    NeighborList *list = NULL;
+    for (auto &l : neighborLists)
+        if (l.node_id == np->node_id)
+            list = &l;
+
+    if (fields.kind == DeltaFields::DELTA) {
+        if (!list || !list->hasKeyframe || list->keyframe != fields.keyframe) {
+            LOG_DEBUG("Missed the full NeighborInfo of 0x%x, ignoring its delta\n", np->node_id);
+            return;
+        }
+        // The full list, less the neighbors that left, plus the ones that joined or changed
+        list->count = 0;
+        for (uint8_t i = 0; i < list->keyframeCount; i++) {
+            NodeNum n = list->keyframeNeighbors[i];
+            if (std::find(fields.removed, fields.removed + fields.numRemoved, n) == fields.removed + fields.numRemoved)
+                list->neighbors[list->count++] = n;
+        }
+        for (pb_size_t i = 0; i < np->neighbors_count && list->count < MAX_NUM_NEIGHBORS; i++) {
+            NodeNum n = np->neighbors[i].node_id;
+            if (std::find(list->neighbors, list->neighbors + list->count, n) == list->neighbors + list->count)
+                list->neighbors[list->count++] = n;
+        }
+        return;
+    }
+
+    if (!list) {
+        if (neighborLists.size() >= MAX_NUM_NEIGHBORS)
+            neighborLists.erase(neighborLists.begin());
+        neighborLists.push_back({});
+        list = &neighborLists.back();
+    }
+    list->node_id = np->node_id;
+    list->count = 0;
+    for (pb_size_t i = 0; i < np->neighbors_count && list->count < MAX_NUM_NEIGHBORS; i++)
+        list->neighbors[list->count++] = np->neighbors[i].node_id;
+    list->hasKeyframe = fields.kind == DeltaFields::KEYFRAME;
+    list->keyframe = fields.keyframe;
+    list->keyframeCount = list->count;
+    memcpy(list->keyframeNeighbors, list->neighbors, sizeof(list->neighbors));
+}
+
+void NeighborInfoModule::readDeltaFields(const meshtastic_MeshPacket &p, DeltaFields &fields)
+{
+    fields = {DeltaFields::PLAIN, 0, 0, {}, false};
+    pb_istream_t stream = pb_istream_from_buffer(p.decoded.payload.bytes, p.decoded.payload.size);
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(&stream, &wireType, &tag, &eof)) {
+        uint32_t value;
+        if ((tag == NEIGHBORINFO_KEYFRAME_TAG || tag == NEIGHBORINFO_DELTA_TAG) && wireType == PB_WT_VARINT) {
+            if (!pb_decode_varint32(&stream, &value))
+                break;
+            fields.kind = tag == NEIGHBORINFO_KEYFRAME_TAG ? DeltaFields::KEYFRAME : DeltaFields::DELTA;
+            fields.keyframe = value;
+        } else if (tag == NEIGHBORINFO_DELTA_SUPPORT_TAG && wireType == PB_WT_VARINT) {
+            if (!pb_decode_varint32(&stream, &value))
+                break;
+            fields.supportsDeltas = value != 0;
+        } else if (tag == NEIGHBORINFO_REMOVED_TAG && wireType == PB_WT_STRING) {
+            uint32_t len;
+            if (!pb_decode_varint32(&stream, &len) || len % 4 != 0)
+                break;
+            for (; len > 0; len -= 4) {
+                if (!pb_decode_fixed32(&stream, &value))
+                    return;
+                if (fields.numRemoved < MAX_NUM_NEIGHBORS)
+                    fields.removed[fields.numRemoved++] = value;
+            }
+        } else if (!pb_skip_field(&stream, wireType)) {
+            break;
+        }
     }
 }
 
-meshtastic_Neighbor *NeighborInfoModule::getOrCreateNeighbor(NodeNum originalSender, NodeNum n,
-                                                             uint32_t node_broadcast_interval_secs, float snr)
+bool NeighborInfoModule::isDelta(const meshtastic_MeshPacket &p)
 {
-    // our node and the phone are the same node (not neighbors)
-    if (n == 0) {
-        n = nodeDB->getNodeNum();
+    if (p.which_payload_variant != meshtastic_MeshPacket_decoded_tag || p.decoded.portnum != meshtastic_PortNum_NEIGHBORINFO_APP)
+        return false;
+    DeltaFields fields;
+    readDeltaFields(p, fields);
+    return fields.kind == DeltaFields::DELTA;
+}
+
+void NeighborInfoModule::appendDeltaFields(meshtastic_MeshPacket *p, const DeltaFields &fields)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(p->decoded.payload.bytes + p->decoded.payload.size,
+                                                 sizeof(p->decoded.payload.bytes) - p->decoded.payload.size);
+    bool ok = true;
+    if (fields.supportsDeltas)
+        ok = pb_encode_tag(&stream, PB_WT_VARINT, NEIGHBORINFO_DELTA_SUPPORT_TAG) && pb_encode_varint(&stream, 1);
+    if (ok && fields.kind != DeltaFields::PLAIN) {
+        uint32_t tag = fields.kind == DeltaFields::KEYFRAME ? NEIGHBORINFO_KEYFRAME_TAG : NEIGHBORINFO_DELTA_TAG;
+        ok = pb_encode_tag(&stream, PB_WT_VARINT, tag) && pb_encode_varint(&stream, fields.keyframe);
     }
-    // look for one in the existing list
-    for (size_t i = 0; i < neighbors.size(); i++) {
-        if (neighbors[i].node_id == n) {
-            // if found, update it
-            neighbors[i].snr = snr;
-            neighbors[i].last_rx_time = getTime();
-            // Only if this is the original sender, the broadcast interval corresponds to it
-            if (originalSender == n && node_broadcast_interval_secs != 0)
-                neighbors[i].node_broadcast_interval_secs = node_broadcast_interval_secs;
-            return &neighbors[i];
+    if (ok && fields.numRemoved) {
+        ok = pb_encode_tag(&stream, PB_WT_STRING, NEIGHBORINFO_REMOVED_TAG) && pb_encode_varint(&stream, fields.numRemoved * 4);
+        for (uint8_t i = 0; ok && i < fields.numRemoved; i++)
+            ok = pb_encode_fixed32(&stream, &fields.removed[i]);
+    }
+    if (ok)
+        p->decoded.payload.size += stream.bytes_written;
+}
+
+#if MESHTASTIC_NEIGHBORINFO_DELTA
+bool NeighborInfoModule::encodeDelta(meshtastic_NeighborInfo *np, DeltaFields &fields)
+{
+    if (fullListsForMsec && millis() - noDeltaSupportHeardMsec >= fullListsForMsec)
+        fullListsForMsec = 0; // the nodes that don't understand deltas went quiet
+    if (!fullListsForMsec && broadcastsSinceKeyframe + 1 < NEIGHBORINFO_KEYFRAME_INTERVAL) {
+        meshtastic_NeighborInfo changes = *np;
+        changes.neighbors_count = 0;
+        fields = {DeltaFields::DELTA, keyframeNumber, 0, {}, true};
+
+        for (pb_size_t i = 0; i < np->neighbors_count; i++) {
+            const meshtastic_Neighbor *old = NULL;
+            for (pb_size_t k = 0; k < keyframe.neighbors_count && !old; k++)
+                if (keyframe.neighbors[k].node_id == np->neighbors[i].node_id)
+                    old = &keyframe.neighbors[k];
+            if (!old || fabsf(np->neighbors[i].snr - old->snr) >= NEIGHBORINFO_DELTA_SNR_DB)
+                changes.neighbors[changes.neighbors_count++] = np->neighbors[i];
+        }
+        for (pb_size_t k = 0; k < keyframe.neighbors_count; k++) {
+            bool present = false;
+            for (pb_size_t i = 0; i < np->neighbors_count && !present; i++)
+                present = np->neighbors[i].node_id == keyframe.neighbors[k].node_id;
+            if (!present)
+                fields.removed[fields.numRemoved++] = keyframe.neighbors[k].node_id;
+        }
+
+        uint32_t numChanges = changes.neighbors_count + fields.numRemoved;
+        if (numChanges == 0 || numChanges < np->neighbors_count) {
+            broadcastsSinceKeyframe++;
+            *np = changes;
+            return numChanges != 0;
         }
     }
-    // otherwise, allocate one and assign data to it
 
-    meshtastic_Neighbor new_nbr = meshtastic_Neighbor_init_zero;
-    new_nbr.node_id = n;
-    new_nbr.snr = snr;
-    new_nbr.last_rx_time = getTime();
-    // Only if this is the original sender, the broadcast interval corresponds to it
-    if (originalSender == n && node_broadcast_interval_secs != 0)
-        new_nbr.node_broadcast_interval_secs = node_broadcast_interval_secs;
-    else // Assume the same broadcast interval as us for the neighbor if we don't know it
-        new_nbr.node_broadcast_interval_secs = moduleConfig.neighbor_info.update_interval;
+    keyframe = *np;
+    keyframeNumber++;
+    broadcastsSinceKeyframe = 0;
+    fields = {DeltaFields::KEYFRAME, keyframeNumber, 0, {}, true};
+    return true;
+}
+#endif
+
+const NeighborInfoModule::NeighborList *NeighborInfoModule::findNeighborList(uint8_t lastByte)
+{
+    const NeighborList *found = NULL;
+    for (auto &l : neighborLists) {
+        if ((l.node_id & 0xff) != lastByte)
+            continue;
+        if (found)
+            return NULL; // Two nodes end in this byte, we can't tell which of them relayed
+        found = &l;
+    }
+    return found;
+}
 
-    if (neighbors.size() < MAX_NUM_NEIGHBORS) {
-        neighbors.push_back(new_nbr);
-    } else {
-        // If we have too many neighbors, replace the oldest one
-        LOG_WARN("Neighbor DB is full, replacing oldest neighbor\n");
-        neighbors.erase(neighbors.begin());
-        neighbors.push_back(new_nbr);
+NeighborCoverage NeighborInfoModule::getCoverage(const uint8_t *relayers, size_t numRelayers)
+{
+    NodeNum ourNum = nodeDB->getNodeNum();
+    if (linkTable.size() == 0 || numRelayers == 0)
+        return COVERAGE_UNKNOWN;
+
+    // Check we know what every relayer reaches first, so we don't call it partial while we're missing information
+    for (size_t r = 0; r < numRelayers; r++) {
+        if (!findNeighborList(relayers[r]))
+            return COVERAGE_UNKNOWN;
+        uint8_t links = 0;
+        for (auto &link : linkTable.getLinks())
+            links += (link.node & 0xff) == relayers[r];
+        if (links > 1)
+            return COVERAGE_UNKNOWN;
+    }
+
+    // Routers are placed to reach further than the nodes next to them, so only their neighbor lists count
+    bool isRouter = config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER ||
+                    config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT ||
+                    config.device.role == meshtastic_Config_DeviceConfig_Role_REPEATER;
+    for (size_t r = 0; r < numRelayers && !isRouter; r++) {
+        const Link *link = linkTable.getByLastByte(relayers[r]);
+        if (link && link->snr >= COVERAGE_COLOCATED_SNR)
+            return COVERAGE_COMPLETE;
+    }
+
+    for (auto &link : linkTable.getLinks()) {
+        if (link.node == ourNum)
+            continue;
+        bool covered = false;
+        for (size_t r = 0; r < numRelayers && !covered; r++) {
+            const NeighborList *list = findNeighborList(relayers[r]);
+            covered = (link.node & 0xff) == relayers[r];
+            for (uint8_t i = 0; i < list->count && !covered; i++)
+                covered = list->neighbors[i] == link.node;
+        }
+        if (!covered)
+            return COVERAGE_PARTIAL;
     }
-    return &neighbors.back();
-}
\ No newline at end of file
+    return COVERAGE_COMPLETE;
+}
+
+void NeighborInfoModule::updateNeighbors(const meshtastic_MeshPacket &mp, const meshtastic_NeighborInfo *np)
+{
+    // Every relayer rewrites last_sent_by_id, so it's the node we heard this from, with its full node number unlike the relay
+    // byte in the LoRa header.  It is 0 if the packet is from our phone, which we don't count as an edge.
+    if (mp.which_payload_variant == meshtastic_MeshPacket_decoded_tag && mp.from && np->last_sent_by_id &&
+        np->last_sent_by_id != nodeDB->getNodeNum()) {
+        linkTable.onHeard(np->last_sent_by_id, mp.rx_snr, millis());
+    }
+}
@@ -2,12 +2,103 @@
 #include "ProtobufModule.h"
 #define MAX_NUM_NEIGHBORS 10 // also defined in NeighborInfo protobuf options
 
+/// A relayer we hear at least this well is practically next to us, so it reaches the same neighbors we do
+#define COVERAGE_COLOCATED_SNR 10
+
+/// Build with -DMESHTASTIC_NEIGHBORINFO_DELTA=1 to only broadcast the neighbors that changed since our last full list, see
+/// NeighborInfoModule::encodeDelta().  We only do this while every node we hear NeighborInfo from says it understands deltas.
+/// Nodes on older firmware that don't send NeighborInfo themselves can't tell us, and their phones would take our deltas for
+/// short lists, so only enable this on meshes where every node runs NeighborInfo or this firmware.
+#ifndef MESHTASTIC_NEIGHBORINFO_DELTA
+#define MESHTASTIC_NEIGHBORINFO_DELTA 0
+#endif
+
+/// Broadcast the full list at least every this many broadcasts
+#ifndef NEIGHBORINFO_KEYFRAME_INTERVAL
+#define NEIGHBORINFO_KEYFRAME_INTERVAL 6
+#endif
+
+/// A neighbor whose SNR moved at least this much since the last full list is sent again
+#define NEIGHBORINFO_DELTA_SNR_DB 3
+
+/// After hearing NeighborInfo from a node that doesn't understand deltas, send full lists for this many of its intervals
+#define NEIGHBORINFO_DELTA_BLOCK_INTERVALS 2
+
+/**
+ * NeighborInfo field numbers for delta encoding.  They aren't part of the protobufs, so firmware that doesn't know them skips
+ * them and takes a delta for a (short) full list.  That is why every NeighborInfo we send says we know them.
+ */
+#define NEIGHBORINFO_KEYFRAME_TAG 1000      // varint: number of this full list
+#define NEIGHBORINFO_DELTA_TAG 1001         // varint: number of the full list this delta is relative to
+#define NEIGHBORINFO_REMOVED_TAG 1002       // packed fixed32: neighbors that left since that full list
+#define NEIGHBORINFO_DELTA_SUPPORT_TAG 1003 // varint 1: the sender understands deltas, so others may send them
+
+/// How far the rebroadcasts of some relayers reached, see NeighborInfoModule::getCoverage()
+enum NeighborCoverage { COVERAGE_UNKNOWN, COVERAGE_PARTIAL, COVERAGE_COMPLETE };
+
 /*
  * Neighborinfo module for sending info on each node's 0-hop neighbors to the mesh
  */
 class NeighborInfoModule : public ProtobufModule<meshtastic_NeighborInfo>, private concurrency::OSThread
 {
-    std::vector<meshtastic_Neighbor> neighbors;
+  public:
+    /// The delta encoding fields of a NeighborInfo packet
+    struct DeltaFields {
+        enum { PLAIN, KEYFRAME, DELTA } kind;
+        uint16_t keyframe;
+        uint8_t numRemoved;
+        NodeNum removed[MAX_NUM_NEIGHBORS];
+        bool supportsDeltas;
+    };
+
+    static void readDeltaFields(const meshtastic_MeshPacket &p, DeltaFields &fields);
+
+    /**
+     * Is p a NeighborInfo delta?  We can only rebuild the full list of our direct neighbors, and the phone and MQTT don't
+     * know the delta fields, so they only get the full lists, which would otherwise look like neighbors went missing.
+     */
+    static bool isDelta(const meshtastic_MeshPacket &p);
+
+  private:
+    /// The neighbors of each of our neighbors, as they announced them in their own NeighborInfo packets
+    struct NeighborList {
+        NodeNum node_id;
+        uint8_t count;
+        NodeNum neighbors[MAX_NUM_NEIGHBORS];
+
+        /// The last full list it sent, which its deltas are relative to
+        bool hasKeyframe;
+        uint16_t keyframe;
+        uint8_t keyframeCount;
+        NodeNum keyframeNeighbors[MAX_NUM_NEIGHBORS];
+    };
+    std::vector<NeighborList> neighborLists;
+
+    /// The neighbor list of the node with this last byte of its node number, NULL if we have none or several
+    const NeighborList *findNeighborList(uint8_t lastByte);
+
+    static void appendDeltaFields(meshtastic_MeshPacket *p, const DeltaFields &fields);
+
+#if MESHTASTIC_NEIGHBORINFO_DELTA
+    /// The last full list we broadcast
+    meshtastic_NeighborInfo keyframe = meshtastic_NeighborInfo_init_zero;
+    uint16_t keyframeNumber;
+    uint8_t broadcastsSinceKeyframe = NEIGHBORINFO_KEYFRAME_INTERVAL; // so the first broadcast is a full list
+
+    /// When we last heard a node that doesn't understand deltas, and for how long after that we only send full lists
+    uint32_t noDeltaSupportHeardMsec = 0;
+    uint32_t fullListsForMsec = 0;
+
+    /**
+     * Cut our neighbor list down to the neighbors that joined, or whose SNR moved by NEIGHBORINFO_DELTA_SNR_DB, since the
+     * last full list we broadcast, and list those that left in fields.  Deltas are relative to the full list rather than
+     * to each other, so a receiver only needs the last full list to apply them.  Sends the full list instead when it is
+     * due, when the delta wouldn't be smaller, or when we recently heard a node that doesn't understand deltas.
+     *
+     * @return false if nothing changed, so there is nothing to send
+     */
+    bool encodeDelta(meshtastic_NeighborInfo *np, DeltaFields &fields);
+#endif
 
   public:
     /*
@@ -18,6 +109,14 @@ class NeighborInfoModule : public ProtobufModule<meshtastic_NeighborInfo>, priva
     /* Reset neighbor info after clearing nodeDB*/
     void resetNeighbors();
 
+    /**
+     * Did the rebroadcasts of these relayers reach all of our neighbors?  Relayers are identified by the last byte of their
+     * node number, like in the LoRa header.  Returns COVERAGE_UNKNOWN if we don't know our neighbors, or the neighbors of one
+     * of the relayers, or if one of those bytes is ambiguous.  Unless we are a router, a relayer we hear at
+     * COVERAGE_COLOCATED_SNR or better covers all of our neighbors.
+     */
+    NeighborCoverage getCoverage(const uint8_t *relayers, size_t numRelayers);
+
   protected:
     /*
      * Called to handle a particular incoming message
@@ -26,7 +125,7 @@ class NeighborInfoModule : public ProtobufModule<meshtastic_NeighborInfo>, priva
     virtual bool handleReceivedProtobuf(const meshtastic_MeshPacket &mp, meshtastic_NeighborInfo *nb) override;
 
     /*
-     * Collect neighbor info from the nodeDB's history, capping at a maximum number of entries and max time
+     * Collect neighbor info from the link table, the most recently heard neighbors first, capping at a maximum number of entries
      * @return the number of entries collected
      */
     uint32_t collectNeighborInfo(meshtastic_NeighborInfo *neighborInfo);
@@ -39,26 +138,28 @@ class NeighborInfoModule : public ProtobufModule<meshtastic_NeighborInfo>, priva
     /* Allocate a new NeighborInfo packet */
     meshtastic_NeighborInfo *allocateNeighborInfoPacket();
 
-    // Find a neighbor in our DB, create an empty neighbor if missing
-    meshtastic_Neighbor *getOrCreateNeighbor(NodeNum originalSender, NodeNum n, uint32_t node_broadcast_interval_secs, float snr);
-
     /*
      * Send info on our node's neighbors into the mesh
      */
     void sendNeighborInfo(NodeNum dest = NODENUM_BROADCAST, bool wantReplies = false);
 
-    /* update neighbors with subpacket sniffed from network */
+    /* the node that sent us this NeighborInfo packet is a neighbor, see LinkTable */
     void updateNeighbors(const meshtastic_MeshPacket &mp, const meshtastic_NeighborInfo *np);
 
+    /* remember the neighbors a neighbor of ours announced */
+    void updateNeighborList(const meshtastic_MeshPacket &mp, const meshtastic_NeighborInfo *np);
+
     /* update a NeighborInfo packet with our NodeNum as last_sent_by_id */
     void alterReceivedProtobuf(meshtastic_MeshPacket &p, meshtastic_NeighborInfo *n) override;
 
     /* Does our periodic broadcast */
     int32_t runOnce() override;
 
-    /* Override wantPacket to say we want to see all packets when enabled, not just those for our port number.
-      Exception is when the packet came via MQTT */
-    virtual bool wantPacket(const meshtastic_MeshPacket *p) override { return enabled && !p->via_mqtt; }
+    /* Ignore NeighborInfo packets that came via MQTT, their last_sent_by_id isn't a node we hear */
+    virtual bool wantPacket(const meshtastic_MeshPacket *p) override
+    {
+        return enabled && !p->via_mqtt && SinglePortModule::wantPacket(p);
+    }
 
     /* These are for debugging only */
     void printNeighborInfo(const char *header, const meshtastic_NeighborInfo *np);
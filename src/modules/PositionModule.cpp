@@ -14,6 +14,8 @@
 #include "meshtastic/atak.pb.h"
 #include "sleep.h"
 #include "target_specific.h"
+#include <pb_decode.h>
+#include <pb_encode.h>
 
 extern "C" {
 #include "mesh/compression/unishox2.h"
@@ -44,6 +46,8 @@ PositionModule::PositionModule()
 bool PositionModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp, meshtastic_Position *pptr)
 {
     auto p = *pptr;
+    if (!expandDelta(mp, p))
+        return false;
 
     // If inbound message is a replay (or spoof!) of our own messages, we shouldn't process
     // (why use second-hand sources for our own data?)
@@ -104,6 +108,114 @@ void PositionModule::alterReceivedProtobuf(meshtastic_MeshPacket &mp, meshtastic
     }
 }
 
+bool PositionModule::expandDelta(const meshtastic_MeshPacket &mp, meshtastic_Position &p)
+{
+    pb_istream_t stream = pb_istream_from_buffer(mp.decoded.payload.bytes, mp.decoded.payload.size);
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(&stream, &wireType, &tag, &eof)) {
+        if (tag != POSITION_DELTA_TAG || wireType != PB_WT_STRING) {
+            if (!pb_skip_field(&stream, wireType))
+                return true;
+            continue;
+        }
+
+        pb_istream_t delta;
+        uint32_t baseTime = 0, elapsed = 0;
+        int64_t dLat = 0, dLon = 0, dAlt = 0;
+        if (!pb_make_string_substream(&stream, &delta))
+            return false;
+        bool ok = pb_decode_varint32(&delta, &baseTime) && pb_decode_svarint(&delta, &dLat) && pb_decode_svarint(&delta, &dLon) &&
+                  pb_decode_svarint(&delta, &dAlt) && pb_decode_varint32(&delta, &elapsed);
+        pb_close_string_substream(&stream, &delta);
+
+        const meshtastic_NodeInfoLite *node = nodeDB->getMeshNode(getFrom(&mp));
+        if (!ok || !node || !node->has_position || (node->position.time & 0x3fff) != baseTime) {
+            LOG_DEBUG("Missed the position of 0x%x its delta is relative to, ignoring it\n", getFrom(&mp));
+            lastExpanded = {getFrom(&mp), mp.id, false, {}};
+            return false;
+        }
+
+        int64_t unit = (int64_t)1 << (p.precision_bits < 32 ? 32 - p.precision_bits : 0);
+        p.latitude_i = node->position.latitude_i + dLat * unit;
+        p.longitude_i = node->position.longitude_i + dLon * unit;
+        p.altitude = node->position.altitude + dAlt;
+        p.time = node->position.time + elapsed;
+        lastExpanded = {getFrom(&mp), mp.id, true, p};
+        return true;
+    }
+    return true;
+}
+
+bool PositionModule::expandForPhone(meshtastic_MeshPacket &mp)
+{
+    if (mp.which_payload_variant != meshtastic_MeshPacket_decoded_tag || mp.decoded.portnum != meshtastic_PortNum_POSITION_APP ||
+        mp.id != lastExpanded.id || getFrom(&mp) != lastExpanded.from)
+        return true;
+    if (!lastExpanded.expanded)
+        return false;
+    mp.decoded.payload.size = pb_encode_to_bytes(mp.decoded.payload.bytes, sizeof(mp.decoded.payload.bytes),
+                                                 &meshtastic_Position_msg, &lastExpanded.position);
+    return true;
+}
+
+bool PositionModule::isDelta(const meshtastic_MeshPacket &mp)
+{
+    if (mp.which_payload_variant != meshtastic_MeshPacket_decoded_tag || mp.decoded.portnum != meshtastic_PortNum_POSITION_APP)
+        return false;
+    pb_istream_t stream = pb_istream_from_buffer(mp.decoded.payload.bytes, mp.decoded.payload.size);
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(&stream, &wireType, &tag, &eof)) {
+        if (tag == POSITION_DELTA_TAG)
+            return true;
+        if (!pb_skip_field(&stream, wireType))
+            break;
+    }
+    return false;
+}
+
+#if MESHTASTIC_POSITION_DELTA
+void PositionModule::encodeDelta(meshtastic_MeshPacket *mp, const meshtastic_Position &p)
+{
+    meshtastic_Position base = lastSent;
+    lastSent = p;
+    if (++broadcastsSinceKeyframe >= POSITION_KEYFRAME_INTERVAL || !p.time || !base.time || p.time < base.time ||
+        p.precision_bits != base.precision_bits || (!base.latitude_i && !base.longitude_i)) {
+        broadcastsSinceKeyframe = 0;
+        return; // send it in full
+    }
+
+    // Coordinates truncated to the precision all end in the same bits, so the differences are multiples of the unit
+    int64_t unit = (int64_t)1 << (p.precision_bits < 32 ? 32 - p.precision_bits : 0);
+    uint8_t packed[32];
+    pb_ostream_t delta = pb_ostream_from_buffer(packed, sizeof(packed));
+    bool ok = pb_encode_varint(&delta, base.time & 0x3fff) &&
+              pb_encode_svarint(&delta, ((int64_t)p.latitude_i - base.latitude_i) / unit) &&
+              pb_encode_svarint(&delta, ((int64_t)p.longitude_i - base.longitude_i) / unit) &&
+              pb_encode_svarint(&delta, (int64_t)p.altitude - base.altitude) && pb_encode_varint(&delta, p.time - base.time);
+
+    meshtastic_Position rest = p;
+    rest.latitude_i = rest.longitude_i = rest.altitude = 0;
+    rest.time = 0;
+    pb_size_t size = pb_encode_to_bytes(mp->decoded.payload.bytes, sizeof(mp->decoded.payload.bytes), &meshtastic_Position_msg,
+                                        &rest);
+    pb_ostream_t stream = pb_ostream_from_buffer(mp->decoded.payload.bytes + size, sizeof(mp->decoded.payload.bytes) - size);
+    ok = ok && pb_encode_tag(&stream, PB_WT_STRING, POSITION_DELTA_TAG) && pb_encode_string(&stream, packed, delta.bytes_written);
+    if (ok) {
+        LOG_DEBUG("Sending position as a delta, %u bytes instead of %u\n", (unsigned)(size + stream.bytes_written),
+                  mp->decoded.payload.size);
+        mp->decoded.payload.size = size + stream.bytes_written;
+        lastExpanded = {nodeDB->getNodeNum(), mp->id, true, p};
+    } else {
+        mp->decoded.payload.size =
+            pb_encode_to_bytes(mp->decoded.payload.bytes, sizeof(mp->decoded.payload.bytes), &meshtastic_Position_msg, &p);
+    }
+}
+#endif
+
 void PositionModule::trySetRtc(meshtastic_Position p, bool isLocal)
 {
     struct timeval tv;
@@ -257,8 +369,12 @@ void PositionModule::sendOurPosition()
 void PositionModule::sendOurPosition(NodeNum dest, bool wantReplies, uint8_t channel)
 {
     // cancel any not yet sent (now stale) position packets
-    if (prevPacketId) // if we wrap around to zero, we'll simply fail to cancel in that rare case (no big deal)
-        service.cancelSending(prevPacketId);
+    // if we wrap around to zero, we'll simply fail to cancel in that rare case (no big deal)
+    if (prevPacketId && service.cancelSending(prevPacketId)) {
+#if MESHTASTIC_POSITION_DELTA
+        broadcastsSinceKeyframe = POSITION_KEYFRAME_INTERVAL; // nobody got the position our delta would be relative to
+#endif
+    }
 
     // Set's the class precision value for this particular packet
     if (channels.getByIndex(channel).settings.has_module_settings) {
@@ -274,6 +390,13 @@ void PositionModule::sendOurPosition(NodeNum dest, bool wantReplies, uint8_t cha
         LOG_DEBUG("allocReply returned a nullptr\n");
         return;
     }
+#if MESHTASTIC_POSITION_DELTA
+    // Only broadcasts count as lastSent, as replies and directed positions don't reach every node keeping it
+    meshtastic_Position sent;
+    if (dest == NODENUM_BROADCAST && p->decoded.portnum == meshtastic_PortNum_POSITION_APP &&
+        pb_decode_from_bytes(p->decoded.payload.bytes, p->decoded.payload.size, &meshtastic_Position_msg, &sent))
+        encodeDelta(p, sent);
+#endif
 
     p->to = dest;
     p->decoded.want_response = config.device.role == meshtastic_Config_DeviceConfig_Role_TRACKER ? false : wantReplies;
@@ -287,7 +410,18 @@ void PositionModule::sendOurPosition(NodeNum dest, bool wantReplies, uint8_t cha
     if (channel > 0)
         p->channel = channel;
 
-    service.sendToMesh(p, RX_SRC_LOCAL, true);
+    meshtastic_MeshPacket *full = nullptr;
+#if MESHTASTIC_POSITION_DELTA
+    // sendToMesh() would cc our phone the delta, which it can't expand, so it gets the full position instead
+    if (isDelta(*p)) {
+        full = packetPool.allocCopy(*p);
+        full->from = nodeDB->getNodeNum();
+        expandForPhone(*full);
+    }
+#endif
+    service.sendToMesh(p, RX_SRC_LOCAL, !full);
+    if (full)
+        service.sendToPhone(full);
 
     if ((config.device.role == meshtastic_Config_DeviceConfig_Role_TRACKER ||
          config.device.role == meshtastic_Config_DeviceConfig_Role_TAK_TRACKER) &&
@@ -387,8 +521,8 @@ struct SmartPosition PositionModule::getDistanceTraveledSinceLastSend(meshtastic
         Default::getConfiguredOrDefault(config.position.broadcast_smart_minimum_distance, 100);
 
     // Determine the distance in meters between two points on the globe
-    float distanceTraveledSinceLastSend = GeoCoord::latLongToMeter(
-        lastGpsLatitude * 1e-7, lastGpsLongitude * 1e-7, currentPosition.latitude_i * 1e-7, currentPosition.longitude_i * 1e-7);
+    float distanceTraveledSinceLastSend = GeoCoord::latLongToMeterFast(lastGpsLatitude, lastGpsLongitude,
+                                                                       currentPosition.latitude_i, currentPosition.longitude_i);
 
 #ifdef GPS_EXTRAVERBOSE
     LOG_DEBUG("--------LAST POSITION------------------------------------\n");
@@ -3,6 +3,25 @@
 #include "ProtobufModule.h"
 #include "concurrency/OSThread.h"
 
+/// Build with -DMESHTASTIC_POSITION_DELTA=1 to broadcast our position as a delta from the previous one, see
+/// PositionModule::encodeDelta()
+#ifndef MESHTASTIC_POSITION_DELTA
+#define MESHTASTIC_POSITION_DELTA 0
+#endif
+
+/// Broadcast the full position at least every this many broadcasts
+#ifndef POSITION_KEYFRAME_INTERVAL
+#define POSITION_KEYFRAME_INTERVAL 4
+#endif
+
+/**
+ * Position field number of a delta, as packed varints: the low 14 bits of the time of the position it is relative to, the
+ * latitude and longitude differences in units of the precision (zigzag), the altitude difference (zigzag) and the seconds
+ * elapsed.  It isn't part of the protobufs, so firmware that doesn't know it skips it and sees a position without
+ * coordinates.
+ */
+#define POSITION_DELTA_TAG 1000
+
 /**
  * Position module for sending/receiving positions into the mesh
  */
@@ -21,6 +40,20 @@ class PositionModule : public ProtobufModule<meshtastic_Position>, private concu
     /// We force a rebroadcast if the radio settings change
     uint32_t currentGeneration = 0;
 
+    /// The last delta we received or sent, so the phone and MQTT get the full position, or nothing if we couldn't expand it
+    struct {
+        NodeNum from;
+        PacketId id;
+        bool expanded;
+        meshtastic_Position position;
+    } lastExpanded = {};
+
+#if MESHTASTIC_POSITION_DELTA
+    /// The last position we sent, which receivers keep in their NodeDB
+    meshtastic_Position lastSent = meshtastic_Position_init_zero;
+    uint8_t broadcastsSinceKeyframe = POSITION_KEYFRAME_INTERVAL; // so the first broadcast is a full position
+#endif
+
   public:
     /** Constructor
      * name is for debugging output
@@ -35,6 +68,16 @@ class PositionModule : public ProtobufModule<meshtastic_Position>, private concu
 
     void handleNewPosition();
 
+    /**
+     * Replace a position delta we received with the full position we expanded it to, for the phone
+     *
+     * @return false if it is a delta we couldn't expand, which the phone must not get as it has no coordinates
+     */
+    bool expandForPhone(meshtastic_MeshPacket &mp);
+
+    /// Is mp a position delta, which has no coordinates of its own?
+    static bool isDelta(const meshtastic_MeshPacket &mp);
+
   protected:
     /** Called to handle a particular incoming message
 
@@ -58,6 +101,23 @@ class PositionModule : public ProtobufModule<meshtastic_Position>, private concu
     uint32_t precision;
     void sendLostAndFoundText();
 
+    /**
+     * Turn a position delta into the full position, relative to the sender's position in our NodeDB.  Leaves other
+     * positions as they are.
+     *
+     * @return false if it is a delta we can't apply, because we missed the position it is relative to
+     */
+    bool expandDelta(const meshtastic_MeshPacket &mp, meshtastic_Position &p);
+
+#if MESHTASTIC_POSITION_DELTA
+    /**
+     * Re-encode the position broadcast p in mp as a delta from lastSent, unless a full one is due, and make p lastSent.
+     * Deltas are chained, as receivers keep the last position in their NodeDB, so one that misses a broadcast ignores the
+     * deltas that follow until the next full position.  Only used when we have valid time, which identifies the base.
+     */
+    void encodeDelta(meshtastic_MeshPacket *mp, const meshtastic_Position &p);
+#endif
+
     const uint32_t minimumTimeThreshold =
         Default::getConfiguredOrDefaultMs(config.position.broadcast_smart_minimum_interval_secs, 30);
 };
@@ -4,6 +4,8 @@
 #include "Router.h"
 #include "configuration.h"
 #include "main.h"
+#include <pb_decode.h>
+#include <pb_encode.h>
 
 RoutingModule *routingModule;
 
@@ -40,10 +42,66 @@ void RoutingModule::sendAckNak(meshtastic_Routing_Error err, NodeNum to, PacketI
                                uint8_t hopLimit)
 {
     auto p = allocAckNak(err, to, idFrom, chIndex, hopStart, hopLimit);
+#if MESHTASTIC_ACK_AGGREGATION
+    appendAckedIds(p, NULL, 0); // tell the other side it can aggregate the ACKs it sends us
+#endif
 
     router->sendLocal(p); // we sometimes send directly to the local node
 }
 
+void RoutingModule::sendAcks(NodeNum to, const PacketId *ids, uint8_t numIds, ChannelIndex chIndex, uint8_t hopStart,
+                             uint8_t hopLimit)
+{
+    assert(numIds > 0 && numIds <= MAX_ACKED_IDS);
+    auto p = allocAckNak(meshtastic_Routing_Error_NONE, to, ids[numIds - 1], chIndex, hopStart, hopLimit);
+    appendAckedIds(p, ids, numIds - 1);
+
+    router->sendLocal(p);
+}
+
+void RoutingModule::appendAckedIds(meshtastic_MeshPacket *p, const PacketId *ids, uint8_t numIds)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(p->decoded.payload.bytes + p->decoded.payload.size,
+                                                 sizeof(p->decoded.payload.bytes) - p->decoded.payload.size);
+    bool ok = pb_encode_tag(&stream, PB_WT_STRING, ROUTING_ACKED_IDS_TAG) && pb_encode_varint(&stream, numIds * 4);
+    for (uint8_t i = 0; ok && i < numIds; i++)
+        ok = pb_encode_fixed32(&stream, &ids[i]);
+    if (ok)
+        p->decoded.payload.size += stream.bytes_written;
+}
+
+int RoutingModule::getAckedIds(const meshtastic_MeshPacket *p, PacketId *ids, uint8_t maxIds)
+{
+    if (p->which_payload_variant != meshtastic_MeshPacket_decoded_tag || p->decoded.portnum != meshtastic_PortNum_ROUTING_APP)
+        return -1;
+
+    pb_istream_t stream = pb_istream_from_buffer(p->decoded.payload.bytes, p->decoded.payload.size);
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(&stream, &wireType, &tag, &eof)) {
+        if (tag != ROUTING_ACKED_IDS_TAG || wireType != PB_WT_STRING) {
+            if (!pb_skip_field(&stream, wireType))
+                return -1;
+            continue;
+        }
+
+        uint32_t len;
+        if (!pb_decode_varint32(&stream, &len) || len % 4 != 0)
+            return -1;
+        int numIds = 0;
+        for (; len > 0; len -= 4) {
+            uint32_t id;
+            if (!pb_decode_fixed32(&stream, &id))
+                return -1;
+            if (numIds < maxIds)
+                ids[numIds++] = id;
+        }
+        return numIds;
+    }
+    return -1;
+}
+
 uint8_t RoutingModule::getHopLimitForResponse(uint8_t hopStart, uint8_t hopLimit)
 {
     if (hopStart != 0) {
@@ -2,6 +2,20 @@
 #include "Channels.h"
 #include "ProtobufModule.h"
 
+/// Build with -DMESHTASTIC_ACK_AGGREGATION=1 to acknowledge bursts of reliable packets with one ACK, see ReliableRouter
+#ifndef MESHTASTIC_ACK_AGGREGATION
+#define MESHTASTIC_ACK_AGGREGATION 0
+#endif
+
+/**
+ * Routing field number for the extra packet ids an aggregated ACK acknowledges, as packed fixed32s.  It isn't part of the
+ * protobufs, so firmware that doesn't know it skips it and only sees the ACK for request_id.
+ */
+#define ROUTING_ACKED_IDS_TAG 1000
+
+/// Most packet ids acknowledged by one ACK, including its request_id
+#define MAX_ACKED_IDS 8
+
 /**
  * Routing module for router control messages
  */
@@ -16,6 +30,21 @@ class RoutingModule : public ProtobufModule<meshtastic_Routing>
     void sendAckNak(meshtastic_Routing_Error err, NodeNum to, PacketId idFrom, ChannelIndex chIndex, uint8_t hopStart = 0,
                     uint8_t hopLimit = 0);
 
+    /**
+     * Acknowledge several packets from the same node with a single ACK.  The last id goes in request_id, the others in the
+     * ROUTING_ACKED_IDS_TAG field.  Only use this for nodes that sent us that field themselves, see getAckedIds().
+     */
+    void sendAcks(NodeNum to, const PacketId *ids, uint8_t numIds, ChannelIndex chIndex, uint8_t hopStart = 0,
+                  uint8_t hopLimit = 0);
+
+    /**
+     * Find the extra packet ids acked by a Routing packet from sendAcks()
+     *
+     * @return the number of ids stored in ids, or -1 if the packet doesn't have the field, i.e. the sender doesn't
+     * understand aggregated ACKs
+     */
+    static int getAckedIds(const meshtastic_MeshPacket *p, PacketId *ids, uint8_t maxIds);
+
     // Given the hopStart and hopLimit upon reception of a request, return the hop limit to use for the response
     uint8_t getHopLimitForResponse(uint8_t hopStart, uint8_t hopLimit);
 
@@ -34,6 +63,10 @@ class RoutingModule : public ProtobufModule<meshtastic_Routing>
 
     /// Override wantPacket to say we want to see all packets, not just those for our port number
     virtual bool wantPacket(const meshtastic_MeshPacket *p) override { return true; }
+
+  private:
+    /// Append the ROUTING_ACKED_IDS_TAG field to the encoded Routing message in p, even if numIds is 0
+    void appendAckedIds(meshtastic_MeshPacket *p, const PacketId *ids, uint8_t numIds);
 };
 
 extern RoutingModule *routingModule;
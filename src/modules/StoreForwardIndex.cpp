@@ -0,0 +1,119 @@
+#include "StoreForwardIndex.h"
+#include <algorithm>
+
+void StoreForwardIndex::init(StoreForwardIndexEntry *storage, uint32_t capacity)
+{
+    entries = storage;
+    this->capacity = storage ? capacity : 0;
+    nextSeq = 1;
+    chains.clear();
+}
+
+uint32_t StoreForwardIndex::add(uint32_t time, NodeNum from, NodeNum to, uint32_t location)
+{
+    if (!capacity)
+        return 0;
+
+    uint32_t seq = nextSeq++;
+    StoreForwardIndexEntry &e = at(seq);
+    if (seq > capacity) {
+        // Overwriting the oldest entry, which is the first one in its chain
+        auto old = chains.find(e.to);
+        if (e.nextSameTo)
+            old->second.first = e.nextSameTo;
+        else
+            chains.erase(old);
+    }
+
+    auto chain = chains.find(to);
+    if (chain != chains.end()) {
+        e.prevSameTo = chain->second.last;
+        at(chain->second.last).nextSameTo = seq;
+        chain->second.last = seq;
+    } else {
+        e.prevSameTo = 0;
+        chains[to] = {seq, seq};
+    }
+    e.nextSameTo = 0;
+
+    e.time = time;
+    e.from = from;
+    e.to = to;
+    e.location = location;
+    return seq;
+}
+
+const StoreForwardIndexEntry *StoreForwardIndex::get(uint32_t seq) const
+{
+    if (!capacity || seq < getOldestSeq() || seq >= nextSeq)
+        return nullptr;
+    return &at(seq);
+}
+
+uint32_t StoreForwardIndex::findWindowStart(uint32_t windowSecs, uint32_t now) const
+{
+    uint32_t low = getOldestSeq(), high = nextSeq;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (now - at(mid).time > windowSecs)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+uint32_t StoreForwardIndex::findFirstAfter(NodeNum to, uint32_t after) const
+{
+    auto chain = chains.find(to);
+    if (chain == chains.end() || chain->second.last <= after)
+        return 0;
+    if (chain->second.first > after)
+        return chain->second.first;
+
+    // The boundary lies somewhere in between.  Approach it from both ends of the chain, and scan the ring forward from it,
+    // until one of them gets there.  The scan wins when the chain is long and its messages are close together.
+    uint32_t older = chain->second.first, newer = chain->second.last;
+    for (uint32_t scan = after + 1;; scan++) {
+        if (at(scan).to == to)
+            return scan;
+        older = at(older).nextSameTo;
+        if (older > after)
+            return older;
+        uint32_t prev = at(newer).prevSameTo;
+        if (prev <= after)
+            return newer;
+        newer = prev;
+    }
+}
+
+uint32_t StoreForwardIndex::query(NodeNum client, uint32_t windowSecs, uint32_t now, uint32_t afterSeq, uint32_t *out,
+                                  uint32_t max) const
+{
+    if (!capacity)
+        return 0;
+
+    // Only messages newer than bound qualify.  A cursor from the future was handed out before our history was cleared.
+    uint32_t bound = findWindowStart(windowSecs, now) - 1;
+    if (afterSeq < nextSeq)
+        bound = std::max(bound, afterSeq);
+
+    uint32_t broadcasts = findFirstAfter(NODENUM_BROADCAST, bound);
+    uint32_t direct = client != NODENUM_BROADCAST ? findFirstAfter(client, bound) : 0;
+
+    // Merge both chains in order of arrival
+    uint32_t count = 0;
+    while (count < max && (broadcasts || direct)) {
+        uint32_t seq = (broadcasts && (!direct || broadcasts < direct)) ? broadcasts : direct;
+        const StoreForwardIndexEntry &e = at(seq);
+        if (seq == broadcasts)
+            broadcasts = e.nextSameTo;
+        else
+            direct = e.nextSameTo;
+
+        // Clients aren't interested in their own messages
+        if (e.from != client)
+            out[count++] = seq;
+    }
+    return count;
+}
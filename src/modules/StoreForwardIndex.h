@@ -0,0 +1,81 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include <unordered_map>
+
+/// What StoreForwardIndex keeps of every message
+struct StoreForwardIndexEntry {
+    uint32_t time; // seconds, on the clock of the storage backend
+    NodeNum from;
+    NodeNum to;
+    uint32_t location;   // where the storage backend keeps the message
+    uint32_t prevSameTo; // sequence numbers of the previous and next messages to the same destination, 0 if none
+    uint32_t nextSameTo;
+};
+
+/**
+ * Finds the messages of a store & forward history.  A ring buffer of index entries that overwrites the oldest one when
+ * full.
+ *
+ * Every message gets a sequence number, counting up from 1 and never reused, so clients can be given a cursor that stays
+ * valid when the ring wraps.  Messages to the same destination are chained together, which lets a query for one client
+ * visit only the broadcasts and the messages to that client.  As messages are added in time order, the ring itself is
+ * the time index: the start of a history window is found with a binary search.
+ *
+ * A query finds where it starts in each chain by walking in from both ends at once, so clients that are nearly caught
+ * up and clients asking for the first time are both cheap, while scanning forward from the client's cursor so a long
+ * chain costs no more than walking the ring from the cursor.  It then visits just the messages it returns.
+ */
+class StoreForwardIndex
+{
+  public:
+    /// Keep up to capacity entries in storage, which must stay valid for the life of this object
+    void init(StoreForwardIndexEntry *storage, uint32_t capacity);
+
+    /// Index a message, @return its sequence number
+    uint32_t add(uint32_t time, NodeNum from, NodeNum to, uint32_t location);
+
+    /// @return the entry with this sequence number, or nullptr if it was overwritten (or never existed)
+    const StoreForwardIndexEntry *get(uint32_t seq) const;
+
+    /**
+     * Find the messages a client asked for: broadcasts and messages to the client, not sent by the client itself, added
+     * within the last windowSecs and after the message numbered afterSeq.
+     *
+     * @param out receives the sequence numbers of the oldest max matching messages, oldest first
+     * @return the number of sequence numbers written to out
+     */
+    uint32_t query(NodeNum client, uint32_t windowSecs, uint32_t now, uint32_t afterSeq, uint32_t *out, uint32_t max) const;
+
+    /// Number of entries currently held
+    uint32_t getCount() const { return nextSeq - getOldestSeq(); }
+
+    /// Number of messages indexed, including the ones that were overwritten
+    uint32_t getTotal() const { return nextSeq - 1; }
+
+    uint32_t getCapacity() const { return capacity; }
+
+    uint32_t getOldestSeq() const { return nextSeq > capacity ? nextSeq - capacity : 1; }
+
+  private:
+    StoreForwardIndexEntry *entries = nullptr;
+    uint32_t capacity = 0;
+    uint32_t nextSeq = 1;
+
+    /// The oldest and newest message to a destination
+    struct Chain {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    /// The messages to each destination (NODENUM_BROADCAST included)
+    std::unordered_map<NodeNum, Chain> chains;
+
+    StoreForwardIndexEntry &at(uint32_t seq) const { return entries[seq % capacity]; }
+
+    /// @return the first message in the chain to this destination that is newer than the message numbered after, 0 if none
+    uint32_t findFirstAfter(NodeNum to, uint32_t after) const;
+
+    /// @return the first sequence number added at most windowSecs before now, nextSeq if there is none
+    uint32_t findWindowStart(uint32_t windowSecs, uint32_t now) const;
+};
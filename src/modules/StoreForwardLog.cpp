@@ -0,0 +1,185 @@
+#include "StoreForwardLog.h"
+
+#if defined(ARCH_PORTDUINO) && !MESHTASTIC_EXCLUDE_STOREFORWARD
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SF_LOG_SEGMENT_RECORDS 4096 // start a new segment file after this many messages
+#define SF_LOG_HEADER_BYTES 14      // time, from, to, channel and payload length
+
+StoreForwardLogStorage::StoreForwardLogStorage(const std::string &dir, uint32_t capacity) : dir(dir)
+{
+    entries = static_cast<StoreForwardIndexEntry *>(calloc(capacity, sizeof(StoreForwardIndexEntry)));
+    index.init(entries, capacity);
+    load();
+}
+
+StoreForwardLogStorage::~StoreForwardLogStorage()
+{
+    free(entries);
+}
+
+uint32_t StoreForwardLogStorage::getNow() const
+{
+    return time(NULL);
+}
+
+std::string StoreForwardLogStorage::segmentPath(uint32_t segment) const
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%08u.seg", segment);
+    return dir + "/" + name;
+}
+
+void StoreForwardLogStorage::load()
+{
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("Can't create S&F log directory %s: %s\n", dir.c_str(), strerror(errno));
+        return;
+    }
+
+    std::vector<uint32_t> found;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        uint32_t segment;
+        char suffix[8];
+        if (sscanf(entry->d_name, "%8u.%3s", &segment, suffix) == 2 && strcmp(suffix, "seg") == 0)
+            found.push_back(segment);
+    }
+    closedir(d);
+    std::sort(found.begin(), found.end());
+
+    for (uint32_t segment : found) {
+        uint32_t firstSeq = index.getTotal() + 1;
+        writeOffset = loadSegment(segment);
+        writeRecords = index.getTotal() + 1 - firstSeq;
+        segments.push_back({segment, firstSeq});
+    }
+
+    // A crash while appending leaves a partial record, cut it off so new ones are appended after the last good one
+    if (!segments.empty() && truncate(segmentPath(segments.back().number).c_str(), writeOffset) != 0)
+        LOG_WARN("Can't truncate S&F log segment: %s\n", strerror(errno));
+
+    dropOldSegments();
+    LOG_INFO("S&F log has %u segments, %u messages indexed\n", (unsigned)segments.size(), index.getCount());
+}
+
+uint32_t StoreForwardLogStorage::loadSegment(uint32_t segment)
+{
+    FILE *f = fopen(segmentPath(segment).c_str(), "rb");
+    if (!f)
+        return 0;
+
+    uint32_t offset = 0;
+    uint8_t header[SF_LOG_HEADER_BYTES];
+    uint8_t payload[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    while (fread(header, sizeof(header), 1, f) == 1) {
+        uint32_t recordTime, from, to;
+        memcpy(&recordTime, header, sizeof(recordTime));
+        memcpy(&from, header + 4, sizeof(from));
+        memcpy(&to, header + 8, sizeof(to));
+        uint8_t size = header[13];
+        if (size > sizeof(payload) || (size && fread(payload, size, 1, f) != 1))
+            break;
+
+        index.add(recordTime, from, to, offset);
+        offset += sizeof(header) + size;
+    }
+    fclose(f);
+    return offset;
+}
+
+void StoreForwardLogStorage::dropOldSegments()
+{
+    while (segments.size() > 1 && segments[1].firstSeq <= index.getOldestSeq()) {
+        unlink(segmentPath(segments.front().number).c_str());
+        segments.erase(segments.begin());
+    }
+}
+
+uint32_t StoreForwardLogStorage::add(NodeNum from, NodeNum to, uint8_t channel, const uint8_t *payload, pb_size_t size)
+{
+    if (!index.getCapacity())
+        return 0;
+
+    if (segments.empty() || writeRecords >= SF_LOG_SEGMENT_RECORDS) {
+        segments.push_back({segments.empty() ? 0 : segments.back().number + 1, index.getTotal() + 1});
+        writeOffset = 0;
+        writeRecords = 0;
+    }
+
+    FILE *f = fopen(segmentPath(segments.back().number).c_str(), "ab");
+    if (!f) {
+        LOG_ERROR("Can't open S&F log segment: %s\n", strerror(errno));
+        return 0;
+    }
+    uint32_t now = getNow();
+    uint8_t header[SF_LOG_HEADER_BYTES];
+    size = std::min<pb_size_t>(size, meshtastic_Constants_DATA_PAYLOAD_LEN);
+    memcpy(header, &now, sizeof(now));
+    memcpy(header + 4, &from, sizeof(from));
+    memcpy(header + 8, &to, sizeof(to));
+    header[12] = channel;
+    header[13] = size;
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1 && (size == 0 || fwrite(payload, size, 1, f) == 1);
+    fclose(f);
+    if (!ok) {
+        LOG_ERROR("Can't write S&F log record\n");
+        truncate(segmentPath(segments.back().number).c_str(), writeOffset);
+        return 0;
+    }
+
+    uint32_t seq = index.add(now, from, to, writeOffset);
+    writeOffset += sizeof(header) + size;
+    writeRecords++;
+    dropOldSegments();
+    return seq;
+}
+
+bool StoreForwardLogStorage::get(uint32_t seq, PacketHistoryStruct &record)
+{
+    const StoreForwardIndexEntry *e = index.get(seq);
+    if (!e)
+        return false;
+
+    // The last segment that starts at or before this message
+    auto segment = std::upper_bound(segments.begin(), segments.end(), seq,
+                                    [](uint32_t seq, const Segment &s) { return seq < s.firstSeq; });
+    if (segment == segments.begin())
+        return false;
+    --segment;
+
+    int fd = open(segmentPath(segment->number).c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Can't open S&F log segment: %s\n", strerror(errno));
+        return false;
+    }
+    uint8_t header[SF_LOG_HEADER_BYTES] = {0};
+    bool ok = pread(fd, header, sizeof(header), e->location) == (ssize_t)sizeof(header);
+    uint8_t size = header[13];
+    ok = ok && size <= sizeof(record.payload) &&
+         pread(fd, record.payload, size, e->location + sizeof(header)) == (ssize_t)size;
+    close(fd);
+    if (!ok) {
+        LOG_ERROR("Can't read S&F log record %u\n", seq);
+        return false;
+    }
+
+    record.time = e->time;
+    record.from = e->from;
+    record.to = e->to;
+    record.channel = header[12];
+    record.payload_size = size;
+    return true;
+}
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "StoreForwardStorage.h"
+#include "configuration.h"
+
+#ifdef ARCH_PORTDUINO
+#include <string>
+#include <vector>
+
+/**
+ * Keeps the store & forward history on disk, so a gateway can hold weeks of traffic and keep it across restarts.
+ *
+ * Messages are appended to numbered segment files in a directory, each record being
+ * [uint32 unix time][uint32 from][uint32 to][uint8 channel][uint8 payload length][payload].  A new segment is started
+ * every SF_LOG_SEGMENT_RECORDS messages, and the oldest one is deleted once all its messages fell out of the index.  Only
+ * the index is kept in RAM, so memory use is bounded by the capacity; payloads are read back from disk when sent.
+ */
+class StoreForwardLogStorage : public StoreForwardStorage
+{
+  public:
+    /**
+     * @param dir directory to keep the segment files in, created if needed
+     * @param capacity the number of messages to keep
+     */
+    StoreForwardLogStorage(const std::string &dir, uint32_t capacity);
+    virtual ~StoreForwardLogStorage();
+
+    virtual uint32_t add(NodeNum from, NodeNum to, uint8_t channel, const uint8_t *payload, pb_size_t size) override;
+    virtual bool get(uint32_t seq, PacketHistoryStruct &record) override;
+
+  protected:
+    virtual uint32_t getNow() const override;
+
+  private:
+    std::string dir;
+    StoreForwardIndexEntry *entries = nullptr;
+
+    struct Segment {
+        uint32_t number;
+        uint32_t firstSeq; // sequence number of the first message in it
+    };
+
+    /// Segment files currently on disk, oldest first
+    std::vector<Segment> segments;
+    /// Write offset and number of messages in the newest segment
+    uint32_t writeOffset = 0;
+    uint32_t writeRecords = 0;
+
+    std::string segmentPath(uint32_t segment) const;
+
+    /// Index the segments left by a previous run
+    void load();
+
+    /// Index the messages in one segment, @return the length of its valid part
+    uint32_t loadSegment(uint32_t segment);
+
+    /// Delete the oldest segments once none of their messages are indexed anymore
+    void dropOldSegments();
+};
+#endif
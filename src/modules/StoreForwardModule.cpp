@@ -12,13 +12,14 @@
  * @author Jm Casler
  * @date [Insert Date]
  */
+#include "configuration.h"
+#if (defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)) && !MESHTASTIC_EXCLUDE_STOREFORWARD
 #include "StoreForwardModule.h"
 #include "MeshService.h"
 #include "NodeDB.h"
 #include "RTC.h"
 #include "Router.h"
 #include "airtime.h"
-#include "configuration.h"
 #include "memGet.h"
 #include "mesh-pb-constants.h"
 #include "mesh/generated/meshtastic/storeforward.pb.h"
@@ -27,24 +28,30 @@
 #include <iterator>
 #include <map>
 
+#ifdef ARCH_PORTDUINO
+#include "StoreForwardLog.h"
+#include "platform/portduino/PortduinoGlue.h"
+
+// Messages kept by a native server, unless configured otherwise
+#define STOREFORWARD_NATIVE_RECORDS 10000
+#define STOREFORWARD_LOG_RECORDS 200000
+#endif
+
+// History replay bursts take up to the airtime of this many full size packets
+#define STOREFORWARD_REPLAY_BURST_PACKETS 2
+
+// The share of the channel (in percent) history replay gets even when the channel is nearly at the polite limit
+#define STOREFORWARD_REPLAY_MIN_SHARE 5.0f
+
 StoreForwardModule *storeForwardModule;
 
 int32_t StoreForwardModule::runOnce()
 {
-#ifdef ARCH_ESP32
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
     if (moduleConfig.store_forward.enabled && is_server) {
         // Send out the message queue.
         if (this->busy) {
-            // Only send packets if the channel is less than 25% utilized.
-            if (airTime->isTxAllowedChannelUtil(true)) {
-                storeForwardModule->sendPayload(this->busyTo, this->packetHistoryTXQueue_index);
-                if (this->packetHistoryTXQueue_index < packetHistoryTXQueue_size - 1) {
-                    this->packetHistoryTXQueue_index++;
-                } else {
-                    this->packetHistoryTXQueue_index = 0;
-                    this->busy = false;
-                }
-            }
+            return this->replayHistory();
         } else if (this->heartbeat && (millis() - lastHeartbeat > (heartbeatInterval * 1000)) &&
                    airTime->isTxAllowedChannelUtil(true)) {
             lastHeartbeat = millis();
@@ -63,33 +70,92 @@ int32_t StoreForwardModule::runOnce()
 }
 
 /**
- * Populates the PSRAM with data to be sent later when a device is out of range.
+ * Sends the next messages of the history being replayed, as many as the channel takes right now.
+ *
+ * Our transmissions are spread out so they take up no more of the channel than the polite utilization limit leaves after
+ * the traffic we hear.  Small messages are sent in bursts, up to the airtime of a few full size packets, and we wait for
+ * the TX queue to drain while it is more than half full, to leave room for the rest of the mesh.
+ *
+ * @return the delay in ms until the next messages can be sent
  */
-void StoreForwardModule::populatePSRAM()
+int32_t StoreForwardModule::replayHistory()
 {
+    if (!airTime->isTxAllowedChannelUtil(true))
+        return this->packetTimeMax;
+
+    uint32_t burstMsec =
+        STOREFORWARD_REPLAY_BURST_PACKETS * router->getPacketTime(meshtastic_Constants_DATA_PAYLOAD_LEN + sizeof(PacketHeader));
+    uint32_t airtimeMsec = 0;
+    meshtastic_QueueStatus qs = router->getQueueStatus();
+    while (this->packetHistoryTXQueue_index < this->packetHistoryTXQueue_size && qs.free > qs.maxlen / 2 &&
+           airtimeMsec < burstMsec) {
+        airtimeMsec += storeForwardModule->sendPayload(this->busyTo, this->packetHistoryTXQueue_index++);
+        qs.free--;
+    }
+
+    if (this->packetHistoryTXQueue_index >= this->packetHistoryTXQueue_size) {
+        this->packetHistoryTXQueue_index = 0;
+        this->busy = false;
+    }
+
+    if (!airtimeMsec) {
+        // Nothing sent, because the TX queue is busy (or we have no radio to ask for airtimes)
+        return burstMsec ? burstMsec : this->packetTimeMax;
+    }
+
+    float share = airTime->getPoliteChannelUtilPercent() - airTime->channelUtilizationPercent();
+    share = constrain(share, STOREFORWARD_REPLAY_MIN_SHARE, airTime->getPoliteChannelUtilPercent());
+    LOG_DEBUG("*** S&F - Sent %u ms of history, taking %.0f%% of the channel\n", airtimeMsec, share);
+    return airtimeMsec * (100 - share) / share;
+}
+
+/**
+ * Sets up the storage for the messages to be sent later when a device is out of range: PSRAM on the ESP32, and on native
+ * a log on disk if one is configured, RAM otherwise.
+ */
+bool StoreForwardModule::initStorage()
+{
+#ifdef ARCH_PORTDUINO
+    if (settingsStrings[storeforwardlogpath] != "") {
+        LOG_INFO("*** Store & Forward history is kept in %s\n", settingsStrings[storeforwardlogpath].c_str());
+        this->storage = new StoreForwardLogStorage(settingsStrings[storeforwardlogpath],
+                                                   this->records ? this->records : STOREFORWARD_LOG_RECORDS);
+    } else {
+        this->storage = new StoreForwardMemoryStorage(this->records ? this->records : STOREFORWARD_NATIVE_RECORDS);
+    }
+#else
     /*
     For PSRAM usage, see:
         https://learn.upesy.com/en/programmation/psram.html#psram-tab
     */
+    if (memGet.getPsramSize() == 0) {
+        LOG_INFO("*** Device doesn't have PSRAM.\n");
+        return false;
+    }
+    if (memGet.getFreePsram() < 1024 * 1024) {
+        LOG_INFO("*** Device has less than 1M of PSRAM free.\n");
+        return false;
+    }
 
     LOG_DEBUG("*** Before PSRAM initialization: heap %d/%d PSRAM %d/%d\n", memGet.getFreeHeap(), memGet.getHeapSize(),
               memGet.getFreePsram(), memGet.getPsramSize());
 
-    this->packetHistoryTXQueue =
-        static_cast<PacketHistoryStruct *>(ps_calloc(this->historyReturnMax, sizeof(PacketHistoryStruct)));
-
     /* Use a maximum of 2/3 the available PSRAM unless otherwise specified.
         Note: This needs to be done after every thing that would use PSRAM
     */
     uint32_t numberOfPackets =
-        (this->records ? this->records : (((memGet.getFreePsram() / 3) * 2) / sizeof(PacketHistoryStruct)));
-    this->records = numberOfPackets;
-
-    this->packetHistory = static_cast<PacketHistoryStruct *>(ps_calloc(numberOfPackets, sizeof(PacketHistoryStruct)));
+        (this->records ? this->records
+                       : (((memGet.getFreePsram() / 3) * 2) / (sizeof(PacketHistoryStruct) + sizeof(StoreForwardIndexEntry))));
+    this->storage = new StoreForwardMemoryStorage(numberOfPackets);
 
     LOG_DEBUG("*** After PSRAM initialization: heap %d/%d PSRAM %d/%d\n", memGet.getFreeHeap(), memGet.getHeapSize(),
               memGet.getFreePsram(), memGet.getPsramSize());
-    LOG_DEBUG("*** numberOfPackets for packetHistory - %u\n", numberOfPackets);
+#endif
+    this->records = this->storage->getCapacity();
+    LOG_DEBUG("*** numberOfPackets for packetHistory - %u\n", this->records);
+
+    this->packetHistoryTXQueue = static_cast<uint32_t *>(calloc(this->historyReturnMax, sizeof(uint32_t)));
+    return this->records && this->packetHistoryTXQueue;
 }
 
 /**
@@ -100,13 +166,14 @@ void StoreForwardModule::populatePSRAM()
  */
 void StoreForwardModule::historySend(uint32_t msAgo, uint32_t to)
 {
-    uint32_t lastIndex = lastRequest.find(to) != lastRequest.end() ? lastRequest[to] : 0;
-    uint32_t queueSize = storeForwardModule->historyQueueCreate(msAgo, to, &lastIndex);
+    uint32_t lastSeq = lastRequest.find(to) != lastRequest.end() ? lastRequest[to] : 0;
+    uint32_t queueSize = storeForwardModule->historyQueueCreate(msAgo, to, &lastSeq);
 
     if (queueSize) {
         LOG_INFO("*** S&F - Sending %u message(s)\n", queueSize);
         this->busy = true; // runOnce() will pickup the next steps once busy = true.
         this->busyTo = to;
+        setIntervalFromNow(0);
     } else {
         LOG_INFO("*** S&F - No history to send\n");
     }
@@ -115,65 +182,37 @@ void StoreForwardModule::historySend(uint32_t msAgo, uint32_t to)
     sf.which_variant = meshtastic_StoreAndForward_history_tag;
     sf.variant.history.history_messages = queueSize;
     sf.variant.history.window = msAgo;
-    sf.variant.history.last_request = lastIndex;
-    lastRequest[to] = lastIndex;
+    sf.variant.history.last_request = lastSeq;
+    lastRequest[to] = lastSeq;
     storeForwardModule->sendMessage(to, sf);
 }
 
 /**
  * Creates a new history queue with messages that were received within the specified time frame.
+ * The queue only references the records in the history, they are looked up again when sent.
  *
  * @param msAgo The number of milliseconds ago to start the history queue.
  * @param to The NodeNum of the recipient.
- * @param last_request_index The index in the packet history of the last request from this node.
- * @return The ID of the newly created history queue.
+ * @param last_request_seq The sequence number of the last record sent to this node, updated to the last one queued.
+ * @return The number of records queued.
  */
-uint32_t StoreForwardModule::historyQueueCreate(uint32_t msAgo, uint32_t to, uint32_t *last_request_index)
+uint32_t StoreForwardModule::historyQueueCreate(uint32_t msAgo, uint32_t to, uint32_t *last_request_seq)
 {
+    this->packetHistoryTXQueue_size =
+        this->storage->query(to, msAgo / 1000, *last_request_seq, this->packetHistoryTXQueue, this->historyReturnMax);
 
-    this->packetHistoryTXQueue_size = 0;
-    // If our history was cleared, ignore the last request index
-    uint32_t last_index = *last_request_index > this->packetHistoryCurrent ? 0 : *last_request_index;
-
-    for (uint32_t i = last_index; i < this->packetHistoryCurrent; i++) {
-        /*
-            LOG_DEBUG("SF historyQueueCreate\n");
-            LOG_DEBUG("SF historyQueueCreate - time %d\n", this->packetHistory[i].time);
-            LOG_DEBUG("SF historyQueueCreate - millis %d\n", millis());
-            LOG_DEBUG("SF historyQueueCreate - math %d\n", (millis() - msAgo));
-        */
-        if (this->packetHistoryTXQueue_size < this->historyReturnMax) {
-            if (this->packetHistory[i].time && (this->packetHistory[i].time < (millis() - msAgo))) {
-                /*  Copy the messages that were received by the router in the last msAgo
-                    to the packetHistoryTXQueue structure.
-                    Client not interested in packets from itself and only in broadcast packets or packets towards it. */
-                if (this->packetHistory[i].from != to &&
-                    (this->packetHistory[i].to == NODENUM_BROADCAST || this->packetHistory[i].to == to)) {
-                    this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].time = this->packetHistory[i].time;
-                    this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].to = this->packetHistory[i].to;
-                    this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].from = this->packetHistory[i].from;
-                    this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].channel = this->packetHistory[i].channel;
-                    this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].payload_size =
-                        this->packetHistory[i].payload_size;
-                    memcpy(this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].payload, this->packetHistory[i].payload,
-                           meshtastic_Constants_DATA_PAYLOAD_LEN);
-                    this->packetHistoryTXQueue_size++;
-                    *last_request_index = i + 1; // Set to one higher such that we don't send the same message again
-
-                    LOG_DEBUG("*** PacketHistoryStruct time=%d, msg=%s\n", this->packetHistory[i].time,
-                              this->packetHistory[i].payload);
-                }
-            }
-        } else {
+    if (this->packetHistoryTXQueue_size) {
+        // Set to the last one queued, such that we don't send the same messages again
+        *last_request_seq = this->packetHistoryTXQueue[this->packetHistoryTXQueue_size - 1];
+        if (this->packetHistoryTXQueue_size == this->historyReturnMax)
             LOG_WARN("*** S&F - Maximum history return reached.\n");
-            return this->packetHistoryTXQueue_size;
-        }
     }
     return this->packetHistoryTXQueue_size;
 }
 
 /**
  * Adds a mesh packet to the history buffer for store-and-forward functionality.
+ * When the buffer is full, the oldest message is overwritten.
  *
  * @param mp The mesh packet to add to the history buffer.
  */
@@ -181,24 +220,10 @@ void StoreForwardModule::historyAdd(const meshtastic_MeshPacket &mp)
 {
     const auto &p = mp.decoded;
 
-    if (this->packetHistoryCurrent == this->records) {
-        LOG_WARN("*** S&F - PSRAM Full. Starting overwrite now.\n");
-        this->packetHistoryCurrent = 0;
-        this->packetHistoryMax = 0;
-        for (auto &i : lastRequest) {
-            i.second = 0; // Clear the last request index for each client device
-        }
-    }
-
-    this->packetHistory[this->packetHistoryCurrent].time = millis();
-    this->packetHistory[this->packetHistoryCurrent].to = mp.to;
-    this->packetHistory[this->packetHistoryCurrent].channel = mp.channel;
-    this->packetHistory[this->packetHistoryCurrent].from = mp.from;
-    this->packetHistory[this->packetHistoryCurrent].payload_size = p.payload.size;
-    memcpy(this->packetHistory[this->packetHistoryCurrent].payload, p.payload.bytes, meshtastic_Constants_DATA_PAYLOAD_LEN);
+    if (this->storage->getTotal() == this->storage->getCapacity())
+        LOG_WARN("*** S&F - History full. Starting overwrite now.\n");
 
-    this->packetHistoryCurrent++;
-    this->packetHistoryMax++;
+    this->storage->add(mp.from, mp.to, mp.channel, p.payload.bytes, p.payload.size);
 }
 
 meshtastic_MeshPacket *StoreForwardModule::allocReply()
@@ -211,16 +236,23 @@ meshtastic_MeshPacket *StoreForwardModule::allocReply()
  * Sends a payload to a specified destination node using the store and forward mechanism.
  *
  * @param dest The destination node number.
- * @param packetHistory_index The index of the packet in the packet history buffer.
+ * @param packetHistoryTXQueue_index The index of the packet in the history TX queue.
+ * @return The airtime of the packet in ms, 0 if it wasn't sent.
  */
-void StoreForwardModule::sendPayload(NodeNum dest, uint32_t packetHistory_index)
+uint32_t StoreForwardModule::sendPayload(NodeNum dest, uint32_t packetHistoryTXQueue_index)
 {
+    PacketHistoryStruct record;
+    if (!this->storage->get(this->packetHistoryTXQueue[packetHistoryTXQueue_index], record)) {
+        LOG_WARN("*** S&F - Record was overwritten before it was sent\n");
+        return 0;
+    }
+
     LOG_INFO("*** Sending S&F Payload\n");
     meshtastic_MeshPacket *p = allocReply();
 
     p->to = dest;
-    p->from = this->packetHistoryTXQueue[packetHistory_index].from;
-    p->channel = this->packetHistoryTXQueue[packetHistory_index].channel;
+    p->from = record.from;
+    p->channel = record.channel;
 
     // Let's assume that if the router received the S&F request that the client is in range.
     //   TODO: Make this configurable.
@@ -228,10 +260,9 @@ void StoreForwardModule::sendPayload(NodeNum dest, uint32_t packetHistory_index)
 
     meshtastic_StoreAndForward sf = meshtastic_StoreAndForward_init_zero;
     sf.which_variant = meshtastic_StoreAndForward_text_tag;
-    sf.variant.text.size = this->packetHistoryTXQueue[packetHistory_index].payload_size;
-    memcpy(sf.variant.text.bytes, this->packetHistoryTXQueue[packetHistory_index].payload,
-           this->packetHistoryTXQueue[packetHistory_index].payload_size);
-    if (this->packetHistoryTXQueue[packetHistory_index].to == NODENUM_BROADCAST) {
+    sf.variant.text.size = record.payload_size;
+    memcpy(sf.variant.text.bytes, record.payload, record.payload_size);
+    if (record.to == NODENUM_BROADCAST) {
         sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_TEXT_BROADCAST;
     } else {
         sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_TEXT_DIRECT;
@@ -240,7 +271,9 @@ void StoreForwardModule::sendPayload(NodeNum dest, uint32_t packetHistory_index)
     p->decoded.payload.size =
         pb_encode_to_bytes(p->decoded.payload.bytes, sizeof(p->decoded.payload.bytes), &meshtastic_StoreAndForward_msg, &sf);
 
+    uint32_t airtimeMsec = router->getPacketTime(p);
     service.sendToMesh(p);
+    return airtimeMsec;
 }
 
 /**
@@ -294,8 +327,8 @@ void StoreForwardModule::statsSend(uint32_t to)
 
     sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_STATS;
     sf.which_variant = meshtastic_StoreAndForward_stats_tag;
-    sf.variant.stats.messages_total = this->packetHistoryMax;
-    sf.variant.stats.messages_saved = this->packetHistoryCurrent;
+    sf.variant.stats.messages_total = this->storage->getTotal();
+    sf.variant.stats.messages_saved = this->storage->getCount();
     sf.variant.stats.messages_max = this->records;
     sf.variant.stats.up_time = millis() / 1000;
     sf.variant.stats.requests = this->requests;
@@ -316,7 +349,7 @@ void StoreForwardModule::statsSend(uint32_t to)
  */
 ProcessMessage StoreForwardModule::handleReceived(const meshtastic_MeshPacket &mp)
 {
-#ifdef ARCH_ESP32
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
     if (moduleConfig.store_forward.enabled) {
 
         // The router node should not be sending messages as a client. Unless he is a ROUTER_CLIENT
@@ -346,7 +379,7 @@ ProcessMessage StoreForwardModule::handleReceived(const meshtastic_MeshPacket &m
                     }
                 } else {
                     storeForwardModule->historyAdd(mp);
-                    LOG_INFO("*** S&F stored. Message history contains %u records now.\n", this->packetHistoryCurrent);
+                    LOG_INFO("*** S&F stored. Message history contains %u records now.\n", this->storage->getCount());
                 }
             } else if (mp.decoded.portnum == meshtastic_PortNum_STORE_FORWARD_APP) {
                 auto &p = mp.decoded;
@@ -516,7 +549,7 @@ StoreForwardModule::StoreForwardModule()
       ProtobufModule("StoreForward", meshtastic_PortNum_STORE_FORWARD_APP, &meshtastic_StoreAndForward_msg)
 {
 
-#ifdef ARCH_ESP32
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
 
     isPromiscuous = true; // Brown chicken brown cow
 
@@ -535,38 +568,28 @@ StoreForwardModule::StoreForwardModule()
         if ((config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER) ||
             (config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT)) {
             LOG_INFO("*** Initializing Store & Forward Module in Router mode\n");
-            if (memGet.getPsramSize() > 0) {
-                if (memGet.getFreePsram() >= 1024 * 1024) {
-
-                    // Do the startup here
 
-                    // Maximum number of records to return.
-                    if (moduleConfig.store_forward.history_return_max)
-                        this->historyReturnMax = moduleConfig.store_forward.history_return_max;
+            // Maximum number of records to return.
+            if (moduleConfig.store_forward.history_return_max)
+                this->historyReturnMax = moduleConfig.store_forward.history_return_max;
 
-                    // Maximum time window for records to return (in minutes)
-                    if (moduleConfig.store_forward.history_return_window)
-                        this->historyReturnWindow = moduleConfig.store_forward.history_return_window;
+            // Maximum time window for records to return (in minutes)
+            if (moduleConfig.store_forward.history_return_window)
+                this->historyReturnWindow = moduleConfig.store_forward.history_return_window;
 
-                    // Maximum number of records to store in memory
-                    if (moduleConfig.store_forward.records)
-                        this->records = moduleConfig.store_forward.records;
+            // Maximum number of records to store
+            if (moduleConfig.store_forward.records)
+                this->records = moduleConfig.store_forward.records;
 
-                    // send heartbeat advertising?
-                    if (moduleConfig.store_forward.heartbeat)
-                        this->heartbeat = moduleConfig.store_forward.heartbeat;
-                    else
-                        this->heartbeat = false;
+            // send heartbeat advertising?
+            if (moduleConfig.store_forward.heartbeat)
+                this->heartbeat = moduleConfig.store_forward.heartbeat;
+            else
+                this->heartbeat = false;
 
-                    // Popupate PSRAM with our data structures.
-                    this->populatePSRAM();
-                    is_server = true;
-                } else {
-                    LOG_INFO("*** Device has less than 1M of PSRAM free.\n");
-                    LOG_INFO("*** Store & Forward Module - disabling server.\n");
-                }
+            if (this->initStorage()) {
+                is_server = true;
             } else {
-                LOG_INFO("*** Device doesn't have PSRAM.\n");
                 LOG_INFO("*** Store & Forward Module - disabling server.\n");
             }
 
@@ -579,4 +602,5 @@ StoreForwardModule::StoreForwardModule()
         disable();
     }
 #endif
-}
\ No newline at end of file
+}
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ProtobufModule.h"
+#include "StoreForwardStorage.h"
 #include "concurrency/OSThread.h"
 #include "mesh/generated/meshtastic/storeforward.pb.h"
 
@@ -9,35 +10,27 @@
 #include <functional>
 #include <unordered_map>
 
-struct PacketHistoryStruct {
-    uint32_t time;
-    uint32_t to;
-    uint32_t from;
-    uint8_t channel;
-    uint8_t payload[meshtastic_Constants_DATA_PAYLOAD_LEN];
-    pb_size_t payload_size;
-};
-
 class StoreForwardModule : private concurrency::OSThread, public ProtobufModule<meshtastic_StoreAndForward>
 {
     bool busy = 0;
     uint32_t busyTo = 0;
     char routerMessage[meshtastic_Constants_DATA_PAYLOAD_LEN] = {0};
 
-    PacketHistoryStruct *packetHistory = 0;
-    uint32_t packetHistoryCurrent = 0;
+    StoreForwardStorage *storage = nullptr;
+    uint32_t packetHistoryCurrent = 0; // Stats of the server, on a client
     uint32_t packetHistoryMax = 0;
 
-    PacketHistoryStruct *packetHistoryTXQueue = 0;
+    // Sequence numbers of the history records being sent
+    uint32_t *packetHistoryTXQueue = 0;
     uint32_t packetHistoryTXQueue_size = 0;
     uint32_t packetHistoryTXQueue_index = 0;
 
-    uint32_t packetTimeMax = 5000; // Interval between sending history packets as a server.
+    uint32_t packetTimeMax = 5000; // Interval between tries to send history packets while the channel is busy.
 
     bool is_client = false;
     bool is_server = false;
 
-    // Unordered_map stores the last request for each nodeNum (`to` field)
+    // Unordered_map stores the sequence number of the last record sent to each nodeNum (`to` field)
     std::unordered_map<NodeNum, uint32_t> lastRequest;
 
   public:
@@ -54,12 +47,12 @@ class StoreForwardModule : private concurrency::OSThread, public ProtobufModule<
     void statsSend(uint32_t to);
     void historySend(uint32_t msAgo, uint32_t to);
 
-    uint32_t historyQueueCreate(uint32_t msAgo, uint32_t to, uint32_t *last_request_index);
+    uint32_t historyQueueCreate(uint32_t msAgo, uint32_t to, uint32_t *last_request_seq);
 
     /**
      * Send our payload into the mesh
      */
-    void sendPayload(NodeNum dest = NODENUM_BROADCAST, uint32_t packetHistory_index = 0);
+    uint32_t sendPayload(NodeNum dest = NODENUM_BROADCAST, uint32_t packetHistoryTXQueue_index = 0);
     void sendMessage(NodeNum dest, const meshtastic_StoreAndForward &payload);
     void sendMessage(NodeNum dest, meshtastic_StoreAndForward_RequestResponse rr);
 
@@ -79,7 +72,10 @@ class StoreForwardModule : private concurrency::OSThread, public ProtobufModule<
     }
 
   private:
-    void populatePSRAM();
+    /// Set up the storage for our message history, @return false if this device can't hold one
+    bool initStorage();
+
+    int32_t replayHistory();
 
     // S&F Defaults
     uint32_t historyReturnMax = 25;     // Return maximum of 25 records by default.
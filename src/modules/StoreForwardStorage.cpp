@@ -0,0 +1,54 @@
+#include "configuration.h"
+#if (defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)) && !MESHTASTIC_EXCLUDE_STOREFORWARD
+#include "StoreForwardStorage.h"
+#include <algorithm>
+#include <string.h>
+
+StoreForwardMemoryStorage::StoreForwardMemoryStorage(uint32_t capacity)
+{
+#ifdef ARCH_ESP32
+    entries = static_cast<StoreForwardIndexEntry *>(ps_calloc(capacity, sizeof(StoreForwardIndexEntry)));
+    records = static_cast<PacketHistoryStruct *>(ps_calloc(capacity, sizeof(PacketHistoryStruct)));
+#else
+    entries = static_cast<StoreForwardIndexEntry *>(calloc(capacity, sizeof(StoreForwardIndexEntry)));
+    records = static_cast<PacketHistoryStruct *>(calloc(capacity, sizeof(PacketHistoryStruct)));
+#endif
+    index.init(entries && records ? entries : nullptr, capacity);
+}
+
+StoreForwardMemoryStorage::~StoreForwardMemoryStorage()
+{
+    free(entries);
+    free(records);
+}
+
+uint32_t StoreForwardMemoryStorage::getNow() const
+{
+    return millis() / 1000;
+}
+
+uint32_t StoreForwardMemoryStorage::add(NodeNum from, NodeNum to, uint8_t channel, const uint8_t *payload, pb_size_t size)
+{
+    uint32_t now = getNow();
+    uint32_t seq = index.add(now, from, to, 0);
+    if (!seq)
+        return 0;
+
+    PacketHistoryStruct &r = records[seq % index.getCapacity()];
+    r.time = now;
+    r.to = to;
+    r.from = from;
+    r.channel = channel;
+    r.payload_size = std::min<pb_size_t>(size, sizeof(r.payload));
+    memcpy(r.payload, payload, r.payload_size);
+    return seq;
+}
+
+bool StoreForwardMemoryStorage::get(uint32_t seq, PacketHistoryStruct &record)
+{
+    if (!index.get(seq))
+        return false;
+    record = records[seq % index.getCapacity()];
+    return true;
+}
+#endif
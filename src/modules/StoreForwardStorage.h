@@ -0,0 +1,68 @@
+#pragma once
+
+#include "StoreForwardIndex.h"
+#include "mesh-pb-constants.h"
+
+/// A message in the store & forward history
+struct PacketHistoryStruct {
+    uint32_t time;
+    uint32_t to;
+    uint32_t from;
+    uint8_t channel;
+    uint8_t payload[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    pb_size_t payload_size;
+};
+
+/**
+ * Where a store & forward server keeps its message history.  Backends store the messages, and share StoreForwardIndex to
+ * find them again.
+ */
+class StoreForwardStorage
+{
+  public:
+    virtual ~StoreForwardStorage() {}
+
+    /// Store a message, overwriting the oldest one when full.  @return its sequence number, 0 if it couldn't be stored
+    virtual uint32_t add(NodeNum from, NodeNum to, uint8_t channel, const uint8_t *payload, pb_size_t size) = 0;
+
+    /// Read back a stored message, @return false if it was overwritten (or never existed)
+    virtual bool get(uint32_t seq, PacketHistoryStruct &record) = 0;
+
+    /// See StoreForwardIndex::query(), for a window ending now
+    uint32_t query(NodeNum client, uint32_t windowSecs, uint32_t afterSeq, uint32_t *out, uint32_t max) const
+    {
+        return index.query(client, windowSecs, getNow(), afterSeq, out, max);
+    }
+
+    uint32_t getCount() const { return index.getCount(); }
+    uint32_t getTotal() const { return index.getTotal(); }
+    uint32_t getCapacity() const { return index.getCapacity(); }
+
+  protected:
+    StoreForwardIndex index;
+
+    /// The clock message times are kept in, in seconds
+    virtual uint32_t getNow() const = 0;
+};
+
+/**
+ * Keeps the history in RAM, in PSRAM on the ESP32.  It is lost on reboot.
+ */
+class StoreForwardMemoryStorage : public StoreForwardStorage
+{
+  public:
+    explicit StoreForwardMemoryStorage(uint32_t capacity);
+    virtual ~StoreForwardMemoryStorage();
+
+    virtual uint32_t add(NodeNum from, NodeNum to, uint8_t channel, const uint8_t *payload, pb_size_t size) override;
+    virtual bool get(uint32_t seq, PacketHistoryStruct &record) override;
+
+  protected:
+    virtual uint32_t getNow() const override;
+
+  private:
+    StoreForwardIndexEntry *entries = nullptr;
+
+    /// Stored in the same ring slots as their index entries
+    PacketHistoryStruct *records = nullptr;
+};
@@ -6,6 +6,7 @@
 #include "PowerFSM.h"
 #include "RTC.h"
 #include "Router.h"
+#include "TelemetryAggregator.h"
 #include "configuration.h"
 #include "main.h"
 #include <OLEDDisplay.h>
@@ -20,7 +21,7 @@ int32_t DeviceTelemetryModule::runOnce()
          ((uptimeLastMs - lastSentToMesh) >= Default::getConfiguredOrDefaultMs(moduleConfig.telemetry.device_update_interval))) &&
         airTime->isTxAllowedChannelUtil(config.device.role != meshtastic_Config_DeviceConfig_Role_SENSOR) &&
         airTime->isTxAllowedAirUtil() && config.device.role != meshtastic_Config_DeviceConfig_Role_REPEATER &&
-        config.device.role != meshtastic_Config_DeviceConfig_Role_CLIENT_HIDDEN) {
+        config.device.role != meshtastic_Config_DeviceConfig_Role_CLIENT_HIDDEN && !TelemetryAggregator::isBatching()) {
         sendTelemetry();
         lastSentToMesh = uptimeLastMs;
     } else if (service.isToPhoneQueueEmpty()) {
@@ -46,6 +47,11 @@ bool DeviceTelemetryModule::handleReceivedProtobuf(const meshtastic_MeshPacket &
                  t->variant.device_metrics.battery_level, t->variant.device_metrics.voltage);
 #endif
         nodeDB->updateTelemetry(getFrom(&mp), *t, RX_SRC_RADIO);
+    } else {
+        // Sensor nodes batching their telemetry send their device metrics along with the environment ones
+        meshtastic_Telemetry device;
+        if (TelemetryAggregator::readMetrics(mp, TELEMETRY_DEVICE_TAG, device))
+            nodeDB->updateTelemetry(getFrom(&mp), device, RX_SRC_RADIO);
     }
     return false; // Let others look at this message also if they want
 }
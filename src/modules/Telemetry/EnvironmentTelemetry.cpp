@@ -64,6 +64,7 @@ int32_t EnvironmentTelemetryModule::runOnce()
 
     if (!(moduleConfig.telemetry.environment_measurement_enabled || moduleConfig.telemetry.environment_screen_enabled)) {
         // If this module is not enabled, and the user doesn't want the display screen don't waste any OSThread time on it
+        TelemetryAggregator::setBatching(false);
         return disable();
     }
 
@@ -102,6 +103,7 @@ int32_t EnvironmentTelemetryModule::runOnce()
     } else {
         // if we somehow got to a second run of this module with measurement disabled, then just wait forever
         if (!moduleConfig.telemetry.environment_measurement_enabled) {
+            TelemetryAggregator::setBatching(false);
             return disable();
         } else {
             if (bme680Sensor.hasSensor())
@@ -109,6 +111,20 @@ int32_t EnvironmentTelemetryModule::runOnce()
         }
 
         uint32_t now = millis();
+#if MESHTASTIC_TELEMETRY_BATCHED
+        // One pass over all the sensors per phone interval, the mesh gets the statistics of the readings in one packet
+        if ((lastSentToPhone == 0) || ((now - lastSentToPhone) >= sendToPhoneIntervalMs)) {
+            sampleSensors();
+            lastSentToPhone = now;
+        }
+        if (((lastSentToMesh == 0) ||
+             ((now - lastSentToMesh) >= Default::getConfiguredOrDefaultMs(moduleConfig.telemetry.environment_update_interval))) &&
+            airTime->isTxAllowedChannelUtil(config.device.role != meshtastic_Config_DeviceConfig_Role_SENSOR) &&
+            airTime->isTxAllowedAirUtil()) {
+            sendBatch();
+            lastSentToMesh = now;
+        }
+#else
         if (((lastSentToMesh == 0) ||
              ((now - lastSentToMesh) >= Default::getConfiguredOrDefaultMs(moduleConfig.telemetry.environment_update_interval))) &&
             airTime->isTxAllowedChannelUtil(config.device.role != meshtastic_Config_DeviceConfig_Role_SENSOR) &&
@@ -122,6 +138,7 @@ int32_t EnvironmentTelemetryModule::runOnce()
             sendTelemetry(NODENUM_BROADCAST, true);
             lastSentToPhone = now;
         }
+#endif
     }
     return min(sendToPhoneIntervalMs, result);
 }
@@ -220,46 +237,88 @@ bool EnvironmentTelemetryModule::handleReceivedProtobuf(const meshtastic_MeshPac
     return false; // Let others look at this message also if they want
 }
 
-bool EnvironmentTelemetryModule::sendTelemetry(NodeNum dest, bool phoneOnly)
+bool EnvironmentTelemetryModule::getEnvironmentTelemetry(meshtastic_Telemetry *m)
 {
-    meshtastic_Telemetry m;
     bool valid = false;
-    m.time = getTime();
-    m.which_variant = meshtastic_Telemetry_environment_metrics_tag;
-
-    m.variant.environment_metrics.barometric_pressure = 0;
-    m.variant.environment_metrics.current = 0;
-    m.variant.environment_metrics.gas_resistance = 0;
-    m.variant.environment_metrics.relative_humidity = 0;
-    m.variant.environment_metrics.temperature = 0;
-    m.variant.environment_metrics.voltage = 0;
-    m.variant.environment_metrics.iaq = 0;
-    m.variant.environment_metrics.distance = 0;
+    m->time = getTime();
+    m->which_variant = meshtastic_Telemetry_environment_metrics_tag;
+
+    m->variant.environment_metrics.barometric_pressure = 0;
+    m->variant.environment_metrics.current = 0;
+    m->variant.environment_metrics.gas_resistance = 0;
+    m->variant.environment_metrics.relative_humidity = 0;
+    m->variant.environment_metrics.temperature = 0;
+    m->variant.environment_metrics.voltage = 0;
+    m->variant.environment_metrics.iaq = 0;
+    m->variant.environment_metrics.distance = 0;
 
     if (sht31Sensor.hasSensor())
-        valid = sht31Sensor.getMetrics(&m);
+        valid = sht31Sensor.getMetrics(m);
     if (lps22hbSensor.hasSensor())
-        valid = lps22hbSensor.getMetrics(&m);
+        valid = lps22hbSensor.getMetrics(m);
     if (shtc3Sensor.hasSensor())
-        valid = shtc3Sensor.getMetrics(&m);
+        valid = shtc3Sensor.getMetrics(m);
     if (bmp085Sensor.hasSensor())
-        valid = bmp085Sensor.getMetrics(&m);
+        valid = bmp085Sensor.getMetrics(m);
     if (bmp280Sensor.hasSensor())
-        valid = bmp280Sensor.getMetrics(&m);
+        valid = bmp280Sensor.getMetrics(m);
     if (bme280Sensor.hasSensor())
-        valid = bme280Sensor.getMetrics(&m);
+        valid = bme280Sensor.getMetrics(m);
     if (bme680Sensor.hasSensor())
-        valid = bme680Sensor.getMetrics(&m);
+        valid = bme680Sensor.getMetrics(m);
     if (mcp9808Sensor.hasSensor())
-        valid = mcp9808Sensor.getMetrics(&m);
+        valid = mcp9808Sensor.getMetrics(m);
     if (ina219Sensor.hasSensor())
-        valid = ina219Sensor.getMetrics(&m);
+        valid = ina219Sensor.getMetrics(m);
     if (ina260Sensor.hasSensor())
-        valid = ina260Sensor.getMetrics(&m);
+        valid = ina260Sensor.getMetrics(m);
     if (rcwl9620Sensor.hasSensor())
-        valid = rcwl9620Sensor.getMetrics(&m);
+        valid = rcwl9620Sensor.getMetrics(m);
+    return valid;
+}
+
+void EnvironmentTelemetryModule::sendPacket(meshtastic_MeshPacket *p, bool phoneOnly)
+{
+    if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR)
+        p->priority = meshtastic_MeshPacket_Priority_RELIABLE;
+    else
+        p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
+    // release previous packet before occupying a new spot
+    if (lastMeasurementPacket != nullptr)
+        packetPool.release(lastMeasurementPacket);
+
+    lastMeasurementPacket = packetPool.allocCopy(*p);
+    if (phoneOnly) {
+        LOG_INFO("Sending packet to phone\n");
+        service.sendToPhone(p);
+    } else {
+        LOG_INFO("Sending packet to mesh\n");
+        service.sendToMesh(p, RX_SRC_LOCAL, true);
+
+        if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR && config.power.is_power_saving) {
+            LOG_DEBUG("Starting next execution in 5 seconds and then going to sleep.\n");
+            sleepOnNextExecution = true;
+            setIntervalFromNow(5000);
+        }
+    }
+}
+
+bool EnvironmentTelemetryModule::sendTelemetry(NodeNum dest, bool phoneOnly)
+{
+    meshtastic_Telemetry m;
+    bool valid = getEnvironmentTelemetry(&m);
 
     if (valid) {
+#if MESHTASTIC_TELEMETRY_DEADBAND
+        if (!phoneOnly && dest == NODENUM_BROADCAST) {
+            if (deadband.shouldSend(m, millis())) {
+                deadband.sent(m, millis());
+            } else {
+                LOG_DEBUG("Environment readings within their deadbands, only sending them to the phone\n");
+                phoneOnly = true;
+            }
+        }
+#endif
         LOG_INFO("(Sending): barometric_pressure=%f, current=%f, gas_resistance=%f, relative_humidity=%f, temperature=%f\n",
                  m.variant.environment_metrics.barometric_pressure, m.variant.environment_metrics.current,
                  m.variant.environment_metrics.gas_resistance, m.variant.environment_metrics.relative_humidity,
@@ -272,30 +331,98 @@ bool EnvironmentTelemetryModule::sendTelemetry(NodeNum dest, bool phoneOnly)
         meshtastic_MeshPacket *p = allocDataProtobuf(m);
         p->to = dest;
         p->decoded.want_response = false;
-        if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR)
-            p->priority = meshtastic_MeshPacket_Priority_RELIABLE;
-        else
-            p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
-        // release previous packet before occupying a new spot
-        if (lastMeasurementPacket != nullptr)
-            packetPool.release(lastMeasurementPacket);
+        sendPacket(p, phoneOnly);
+    }
+    return valid;
+}
 
-        lastMeasurementPacket = packetPool.allocCopy(*p);
-        if (phoneOnly) {
-            LOG_INFO("Sending packet to phone\n");
-            service.sendToPhone(p);
-        } else {
-            LOG_INFO("Sending packet to mesh\n");
-            service.sendToMesh(p, RX_SRC_LOCAL, true);
+#if MESHTASTIC_TELEMETRY_BATCHED
+bool EnvironmentTelemetryModule::getPowerTelemetry(meshtastic_Telemetry *m)
+{
+    m->time = getTime();
+    m->which_variant = meshtastic_Telemetry_power_metrics_tag;
+    memset(&m->variant.power_metrics, 0, sizeof(m->variant.power_metrics));
+#if HAS_TELEMETRY && !defined(ARCH_PORTDUINO)
+    // The INA219 and INA260 are read with the environment sensors, PowerTelemetryModule initializes the INA3221
+    if (ina3221Sensor.hasSensor() && ina3221Sensor.isInitialized())
+        return ina3221Sensor.getMetrics(m);
+#endif
+    return false;
+}
 
-            if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR && config.power.is_power_saving) {
-                LOG_DEBUG("Starting next execution in 5 seconds and then going to sleep.\n");
-                sleepOnNextExecution = true;
-                setIntervalFromNow(5000);
-            }
-        }
+void EnvironmentTelemetryModule::sampleSensors()
+{
+    meshtastic_Telemetry environment, power;
+    bool hasEnvironment = getEnvironmentTelemetry(&environment);
+    bool hasPower = getPowerTelemetry(&power);
+    aggregator.addSample(hasEnvironment ? &environment.variant.environment_metrics : NULL,
+                         hasPower ? &power.variant.power_metrics : NULL);
+
+    // Only send to the phone while its queue is empty (phone assumed connected)
+    if (!service.isToPhoneQueueEmpty())
+        return;
+    if (hasEnvironment) {
+        meshtastic_MeshPacket *p = allocDataProtobuf(environment);
+        p->to = NODENUM_BROADCAST;
+        p->decoded.want_response = false;
+        sendPacket(p, true);
+    }
+    if (hasPower) {
+        meshtastic_MeshPacket *p = allocDataProtobuf(power);
+        p->to = NODENUM_BROADCAST;
+        p->decoded.want_response = false;
+        service.sendToPhone(p);
     }
-    return valid;
 }
 
+void EnvironmentTelemetryModule::sendBatch()
+{
+    // DeviceTelemetryModule leaves it to us to broadcast our device metrics, it keeps them up to date in the NodeDB
+    const meshtastic_NodeInfoLite *ourNode = nodeDB->getMeshNode(nodeDB->getNodeNum());
+    const meshtastic_DeviceMetrics *device = ourNode && ourNode->has_device_metrics ? &ourNode->device_metrics : NULL;
+
+    meshtastic_Telemetry m = meshtastic_Telemetry_init_zero;
+    m.time = getTime();
+    if (aggregator.getNumSamples() == 0) {
+        // No readings to send the statistics of, so only our device metrics, in a regular packet that isn't for our screen
+        if (!device)
+            return;
+        m.which_variant = meshtastic_Telemetry_device_metrics_tag;
+        m.variant.device_metrics = *device;
+        meshtastic_MeshPacket *p = allocDataProtobuf(m);
+        p->to = NODENUM_BROADCAST;
+        p->decoded.want_response = false;
+        p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
+        LOG_INFO("(Sending): no sensor readings, only device metrics\n");
+        service.sendToMesh(p, RX_SRC_LOCAL, true);
+        return;
+    }
+    aggregator.getMeans(m);
+
+#if MESHTASTIC_TELEMETRY_DEADBAND
+    // Keep adding up the readings when skipping, so the next batch has the statistics since the last one
+    meshtastic_Telemetry power = meshtastic_Telemetry_init_zero;
+    bool hasPower = aggregator.getPowerMeans(power);
+    uint32_t now = millis();
+    if (!deadband.shouldSend(m, now) && !(hasPower && deadband.shouldSend(power, now))) {
+        LOG_DEBUG("Readings within their deadbands, skipping this batch\n");
+        return;
+    }
+    deadband.sent(m, now);
+    if (hasPower)
+        deadband.sent(power, now);
+#endif
+
+    meshtastic_MeshPacket *p = allocDataProtobuf(m);
+    aggregator.appendFields(p, device);
+    LOG_INFO("(Sending): statistics of %u readings, in %u bytes\n", aggregator.getNumSamples(), p->decoded.payload.size);
+    aggregator.reset();
+
+    sensor_read_error_count = 0;
+    p->to = NODENUM_BROADCAST;
+    p->decoded.want_response = false;
+    sendPacket(p, false);
+}
+#endif
+
 #endif
\ No newline at end of file
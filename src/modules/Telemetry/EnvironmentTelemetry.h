@@ -6,6 +6,8 @@
 #include "../mesh/generated/meshtastic/telemetry.pb.h"
 #include "NodeDB.h"
 #include "ProtobufModule.h"
+#include "TelemetryAggregator.h"
+#include "TelemetryDeadband.h"
 #include <OLEDDisplay.h>
 #include <OLEDDisplayUi.h>
 
@@ -17,6 +19,7 @@ class EnvironmentTelemetryModule : private concurrency::OSThread, public Protobu
           ProtobufModule("EnvironmentTelemetry", meshtastic_PortNum_TELEMETRY_APP, &meshtastic_Telemetry_msg)
     {
         lastMeasurementPacket = nullptr;
+        TelemetryAggregator::setBatching(moduleConfig.telemetry.environment_measurement_enabled);
         setIntervalFromNow(10 * 1000);
     }
     virtual bool wantUIFrame() override;
@@ -38,6 +41,29 @@ class EnvironmentTelemetryModule : private concurrency::OSThread, public Protobu
     bool sendTelemetry(NodeNum dest = NODENUM_BROADCAST, bool wantReplies = false);
 
   private:
+    /// Read all environment sensors into m, false if there are none
+    bool getEnvironmentTelemetry(meshtastic_Telemetry *m);
+
+    /// Send a packet of ours into the mesh, or only to the phone, and keep it for our screen
+    void sendPacket(meshtastic_MeshPacket *p, bool phoneOnly);
+
+#if MESHTASTIC_TELEMETRY_DEADBAND
+    TelemetryDeadband deadband;
+#endif
+
+#if MESHTASTIC_TELEMETRY_BATCHED
+    TelemetryAggregator aggregator;
+
+    /// Read all power sensors into m, false if there are none
+    bool getPowerTelemetry(meshtastic_Telemetry *m);
+
+    /// Read all sensors in one pass for the aggregator, and send the readings to the phone
+    void sampleSensors();
+
+    /// Broadcast the statistics of the readings since the last batch, with our power and device metrics, in one packet
+    void sendBatch();
+#endif
+
     float CelsiusToFahrenheit(float c);
     bool firstTime = 1;
     meshtastic_MeshPacket *lastMeasurementPacket;
@@ -10,6 +10,7 @@
 #include "PowerTelemetry.h"
 #include "RTC.h"
 #include "Router.h"
+#include "TelemetryAggregator.h"
 #include "main.h"
 #include "power.h"
 #include "sleep.h"
@@ -67,6 +68,9 @@ int32_t PowerTelemetryModule::runOnce()
         // if we somehow got to a second run of this module with measurement disabled, then just wait forever
         if (!moduleConfig.telemetry.power_measurement_enabled)
             return disable();
+        // EnvironmentTelemetryModule reads our power sensors along with its own, and sends them in the same packets
+        if (TelemetryAggregator::isBatching())
+            return disable();
 
         uint32_t now = millis();
         if (((lastSentToMesh == 0) ||
@@ -186,6 +190,16 @@ bool PowerTelemetryModule::sendTelemetry(NodeNum dest, bool phoneOnly)
 #endif
 
     if (valid) {
+#if MESHTASTIC_TELEMETRY_DEADBAND
+        if (!phoneOnly && dest == NODENUM_BROADCAST) {
+            if (deadband.shouldSend(m, millis())) {
+                deadband.sent(m, millis());
+            } else {
+                LOG_DEBUG("Power readings within their deadbands, only sending them to the phone\n");
+                phoneOnly = true;
+            }
+        }
+#endif
         LOG_INFO("(Sending): ch1_voltage=%f, ch1_current=%f, ch2_voltage=%f, ch2_current=%f, "
                  "ch3_voltage=%f, ch3_current=%f\n",
                  m.variant.power_metrics.ch1_voltage, m.variant.power_metrics.ch1_current, m.variant.power_metrics.ch2_voltage,
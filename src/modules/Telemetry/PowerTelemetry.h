@@ -7,6 +7,7 @@
 #include "../mesh/generated/meshtastic/telemetry.pb.h"
 #include "NodeDB.h"
 #include "ProtobufModule.h"
+#include "TelemetryDeadband.h"
 #include <OLEDDisplay.h>
 #include <OLEDDisplayUi.h>
 
@@ -39,6 +40,9 @@ class PowerTelemetryModule : private concurrency::OSThread, public ProtobufModul
     bool sendTelemetry(NodeNum dest = NODENUM_BROADCAST, bool wantReplies = false);
 
   private:
+#if MESHTASTIC_TELEMETRY_DEADBAND
+    TelemetryDeadband deadband;
+#endif
     bool firstTime = 1;
     meshtastic_MeshPacket *lastMeasurementPacket;
     uint32_t sendToPhoneIntervalMs = SECONDS_IN_MINUTE * 1000; // Send to phone every minute
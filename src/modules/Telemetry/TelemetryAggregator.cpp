@@ -0,0 +1,231 @@
+#include "TelemetryAggregator.h"
+#include "MeshService.h"
+#include "NodeDB.h"
+#include "mesh-pb-constants.h"
+#include <pb_decode.h>
+#include <pb_encode.h>
+
+bool TelemetryAggregator::batching;
+
+static void toValues(const meshtastic_EnvironmentMetrics &m, float *v)
+{
+    v[0] = m.temperature;
+    v[1] = m.relative_humidity;
+    v[2] = m.barometric_pressure;
+    v[3] = m.gas_resistance;
+    v[4] = m.voltage;
+    v[5] = m.current;
+    v[6] = m.iaq;
+    v[7] = m.distance;
+}
+
+static void fromValues(const float *v, meshtastic_EnvironmentMetrics &m)
+{
+    m.temperature = v[0];
+    m.relative_humidity = v[1];
+    m.barometric_pressure = v[2];
+    m.gas_resistance = v[3];
+    m.voltage = v[4];
+    m.current = v[5];
+    m.iaq = lround(v[6]);
+    m.distance = v[7];
+}
+
+static void toValues(const meshtastic_PowerMetrics &m, float *v)
+{
+    v[0] = m.ch1_voltage;
+    v[1] = m.ch1_current;
+    v[2] = m.ch2_voltage;
+    v[3] = m.ch2_current;
+    v[4] = m.ch3_voltage;
+    v[5] = m.ch3_current;
+}
+
+static void fromValues(const float *v, meshtastic_PowerMetrics &m)
+{
+    m.ch1_voltage = v[0];
+    m.ch1_current = v[1];
+    m.ch2_voltage = v[2];
+    m.ch2_current = v[3];
+    m.ch3_voltage = v[4];
+    m.ch3_current = v[5];
+}
+
+void TelemetryAggregator::add(Stat *stats, const float *values, size_t count, uint16_t numBefore)
+{
+    for (size_t i = 0; i < count; i++) {
+        Stat &s = stats[i];
+        if (numBefore == 0) {
+            s = {values[i], values[i], values[i]};
+            continue;
+        }
+        s.min = values[i] < s.min ? values[i] : s.min;
+        s.max = values[i] > s.max ? values[i] : s.max;
+        s.sum += values[i];
+    }
+}
+
+void TelemetryAggregator::addSample(const meshtastic_EnvironmentMetrics *environment, const meshtastic_PowerMetrics *power)
+{
+    float values[NUM_ENVIRONMENT];
+    if (environment) {
+        toValues(*environment, values);
+        add(this->environment, values, NUM_ENVIRONMENT, numEnvironment++);
+    }
+    if (power) {
+        toValues(*power, values);
+        add(this->power, values, NUM_POWER, numPower++);
+    }
+}
+
+void TelemetryAggregator::getMeans(meshtastic_Telemetry &t) const
+{
+    float values[NUM_ENVIRONMENT] = {0};
+    for (size_t i = 0; numEnvironment && i < NUM_ENVIRONMENT; i++)
+        values[i] = environment[i].sum / numEnvironment;
+    t.which_variant = meshtastic_Telemetry_environment_metrics_tag;
+    fromValues(values, t.variant.environment_metrics);
+}
+
+bool TelemetryAggregator::getPowerMeans(meshtastic_Telemetry &t) const
+{
+    float values[NUM_POWER];
+    for (size_t i = 0; numPower && i < NUM_POWER; i++)
+        values[i] = power[i].sum / numPower;
+    t.which_variant = meshtastic_Telemetry_power_metrics_tag;
+    if (numPower)
+        fromValues(values, t.variant.power_metrics);
+    return numPower > 0;
+}
+
+static void appendMessage(meshtastic_MeshPacket *p, uint32_t tag, const pb_msgdesc_t *fields, const void *msg)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(p->decoded.payload.bytes + p->decoded.payload.size,
+                                                 TELEMETRY_BATCHED_MAX_PAYLOAD - p->decoded.payload.size);
+    if (pb_encode_tag(&stream, PB_WT_STRING, tag) && pb_encode_submessage(&stream, fields, msg))
+        p->decoded.payload.size += stream.bytes_written;
+}
+
+void TelemetryAggregator::appendFields(meshtastic_MeshPacket *p, const meshtastic_DeviceMetrics *device) const
+{
+    if (p->decoded.payload.size >= TELEMETRY_BATCHED_MAX_PAYLOAD)
+        return;
+
+    float values[NUM_ENVIRONMENT];
+    meshtastic_PowerMetrics powerMetrics;
+    meshtastic_EnvironmentMetrics environmentMetrics;
+
+    meshtastic_Telemetry means;
+    if (getPowerMeans(means))
+        appendMessage(p, TELEMETRY_POWER_TAG, &meshtastic_PowerMetrics_msg, &means.variant.power_metrics);
+    if (device)
+        appendMessage(p, TELEMETRY_DEVICE_TAG, &meshtastic_DeviceMetrics_msg, device);
+
+    pb_ostream_t stream = pb_ostream_from_buffer(p->decoded.payload.bytes + p->decoded.payload.size,
+                                                 TELEMETRY_BATCHED_MAX_PAYLOAD - p->decoded.payload.size);
+    if (pb_encode_tag(&stream, PB_WT_VARINT, TELEMETRY_SAMPLES_TAG) && pb_encode_varint(&stream, getNumSamples()))
+        p->decoded.payload.size += stream.bytes_written;
+
+    // With a single reading the minimums and maximums are the means
+    if (numEnvironment > 1) {
+        for (size_t i = 0; i < NUM_ENVIRONMENT; i++)
+            values[i] = environment[i].min;
+        fromValues(values, environmentMetrics);
+        appendMessage(p, TELEMETRY_ENV_MIN_TAG, &meshtastic_EnvironmentMetrics_msg, &environmentMetrics);
+        for (size_t i = 0; i < NUM_ENVIRONMENT; i++)
+            values[i] = environment[i].max;
+        fromValues(values, environmentMetrics);
+        appendMessage(p, TELEMETRY_ENV_MAX_TAG, &meshtastic_EnvironmentMetrics_msg, &environmentMetrics);
+    }
+    if (numPower > 1) {
+        for (size_t i = 0; i < NUM_POWER; i++)
+            values[i] = power[i].min;
+        fromValues(values, powerMetrics);
+        appendMessage(p, TELEMETRY_POWER_MIN_TAG, &meshtastic_PowerMetrics_msg, &powerMetrics);
+        for (size_t i = 0; i < NUM_POWER; i++)
+            values[i] = power[i].max;
+        fromValues(values, powerMetrics);
+        appendMessage(p, TELEMETRY_POWER_MAX_TAG, &meshtastic_PowerMetrics_msg, &powerMetrics);
+    }
+}
+
+void TelemetryAggregator::reset()
+{
+    numEnvironment = 0;
+    numPower = 0;
+}
+
+bool TelemetryAggregator::readMetrics(const meshtastic_MeshPacket &mp, uint32_t tag, meshtastic_Telemetry &t)
+{
+    if (mp.which_payload_variant != meshtastic_MeshPacket_decoded_tag || mp.decoded.portnum != meshtastic_PortNum_TELEMETRY_APP)
+        return false;
+
+    const pb_msgdesc_t *fields;
+    pb_size_t variant;
+    switch (tag) {
+    case TELEMETRY_POWER_TAG:
+    case TELEMETRY_POWER_MIN_TAG:
+    case TELEMETRY_POWER_MAX_TAG:
+        fields = &meshtastic_PowerMetrics_msg;
+        variant = meshtastic_Telemetry_power_metrics_tag;
+        break;
+    case TELEMETRY_DEVICE_TAG:
+        fields = &meshtastic_DeviceMetrics_msg;
+        variant = meshtastic_Telemetry_device_metrics_tag;
+        break;
+    case TELEMETRY_ENV_MIN_TAG:
+    case TELEMETRY_ENV_MAX_TAG:
+        fields = &meshtastic_EnvironmentMetrics_msg;
+        variant = meshtastic_Telemetry_environment_metrics_tag;
+        break;
+    default:
+        return false;
+    }
+
+    pb_istream_t stream = pb_istream_from_buffer(mp.decoded.payload.bytes, mp.decoded.payload.size);
+    pb_wire_type_t wireType;
+    uint32_t fieldTag;
+    bool eof;
+    while (pb_decode_tag(&stream, &wireType, &fieldTag, &eof)) {
+        if (fieldTag != tag || wireType != PB_WT_STRING) {
+            if (!pb_skip_field(&stream, wireType))
+                return false;
+            continue;
+        }
+
+        // The time is that of the batch
+        if (!pb_decode_from_bytes(mp.decoded.payload.bytes, mp.decoded.payload.size, &meshtastic_Telemetry_msg, &t))
+            return false;
+        memset(&t.variant, 0, sizeof(t.variant));
+        t.which_variant = variant;
+        pb_istream_t metrics;
+        if (!pb_make_string_substream(&stream, &metrics))
+            return false;
+        bool ok = pb_decode(&metrics, fields, &t.variant);
+        pb_close_string_substream(&stream, &metrics);
+        return ok;
+    }
+    return false;
+}
+
+const uint32_t TelemetryAggregator::unbatchedTags[2] = {TELEMETRY_POWER_TAG, TELEMETRY_DEVICE_TAG};
+
+meshtastic_MeshPacket *TelemetryAggregator::allocUnbatched(const meshtastic_MeshPacket &mp, uint32_t tag)
+{
+    meshtastic_Telemetry t;
+    if (!readMetrics(mp, tag, t))
+        return NULL;
+    meshtastic_MeshPacket *p = packetPool.allocCopy(mp);
+    p->decoded.payload.size =
+        pb_encode_to_bytes(p->decoded.payload.bytes, sizeof(p->decoded.payload.bytes), &meshtastic_Telemetry_msg, &t);
+    return p;
+}
+
+void TelemetryAggregator::sendUnbatchedToPhone(const meshtastic_MeshPacket &mp)
+{
+    for (uint32_t tag : unbatchedTags) {
+        meshtastic_MeshPacket *p = allocUnbatched(mp, tag);
+        if (p)
+            service.sendToPhone(p);
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "../mesh/generated/meshtastic/telemetry.pb.h"
+#include "MeshTypes.h"
+#include "configuration.h"
+
+/// Build with -DMESHTASTIC_TELEMETRY_BATCHED=1 for EnvironmentTelemetryModule to read all sensors in one pass, and broadcast
+/// one packet per interval with the statistics of all of them, see TelemetryAggregator
+#ifndef MESHTASTIC_TELEMETRY_BATCHED
+#define MESHTASTIC_TELEMETRY_BATCHED 0
+#endif
+
+/// Most bytes of a batched Telemetry payload, so the Data message holding it still fits a LoRa frame
+#define TELEMETRY_BATCHED_MAX_PAYLOAD 220
+
+/**
+ * Telemetry field numbers for batched packets.  They aren't part of the protobufs, so firmware and clients that don't know
+ * them skip them and only see the mean environment metrics.
+ */
+#define TELEMETRY_POWER_TAG 1000     // PowerMetrics: mean over the interval
+#define TELEMETRY_DEVICE_TAG 1001    // DeviceMetrics: at the end of the interval
+#define TELEMETRY_SAMPLES_TAG 1002   // varint: number of sensor readings the statistics are over
+#define TELEMETRY_ENV_MIN_TAG 1003   // EnvironmentMetrics: minimum over the interval
+#define TELEMETRY_ENV_MAX_TAG 1004   // EnvironmentMetrics: maximum over the interval
+#define TELEMETRY_POWER_MIN_TAG 1005 // PowerMetrics: minimum over the interval
+#define TELEMETRY_POWER_MAX_TAG 1006 // PowerMetrics: maximum over the interval
+
+/**
+ * Minimum, maximum and mean of the sensor readings over a telemetry interval, so a sensor node can read its sensors often
+ * and still send a single packet per interval.  The packet is a regular environment Telemetry with the means, with the
+ * power and device metrics and the minimums and maximums appended as extra fields.
+ *
+ * The power metrics are those of the INA3221.  The INA219 and INA260 are only sent as the environment voltage and current,
+ * as PowerTelemetryModule, which also sent them as power metrics, is disabled while batching.
+ */
+class TelemetryAggregator
+{
+  public:
+    /// Add the readings of one pass over the sensors, either can be NULL if we have no such sensor
+    void addSample(const meshtastic_EnvironmentMetrics *environment, const meshtastic_PowerMetrics *power);
+
+    uint16_t getNumSamples() const { return numEnvironment > numPower ? numEnvironment : numPower; }
+
+    /// Set t to the mean environment metrics since the last reset
+    void getMeans(meshtastic_Telemetry &t) const;
+
+    /// Set t to the mean power metrics since the last reset, false if we have no power sensor
+    bool getPowerMeans(meshtastic_Telemetry &t) const;
+
+    /**
+     * Append the mean power metrics, the device metrics (if not NULL), and the minimums and maximums to p, whose payload is
+     * the encoding of getMeans().  Fields that don't fit in TELEMETRY_BATCHED_MAX_PAYLOAD are left out, the least
+     * important last.
+     */
+    void appendFields(meshtastic_MeshPacket *p, const meshtastic_DeviceMetrics *device) const;
+
+    void reset();
+
+    /// Set t to the metrics a batched packet carries in the field tag, false if it has none
+    static bool readMetrics(const meshtastic_MeshPacket &mp, uint32_t tag, meshtastic_Telemetry &t);
+
+    /// Clients only understand one kind of metrics per packet, so they get these fields of a batched packet in packets of
+    /// their own: the power and device metrics
+    static const uint32_t unbatchedTags[2];
+
+    /// @return a copy of the batched packet mp carrying just the metrics in the field tag, NULL if it has none.  It keeps
+    /// mp's id, the caller releases it to packetPool.
+    static meshtastic_MeshPacket *allocUnbatched(const meshtastic_MeshPacket &mp, uint32_t tag);
+
+    /// Send the phone the power and device metrics of a batched packet in packets of their own
+    static void sendUnbatchedToPhone(const meshtastic_MeshPacket &mp);
+
+    /// Is a live EnvironmentTelemetryModule batching our readings, sending our power and device metrics along with its own?
+    static bool isBatching() { return batching; }
+
+    /// Called by EnvironmentTelemetryModule when it starts or stops batching
+    static void setBatching(bool on) { batching = MESHTASTIC_TELEMETRY_BATCHED && on; }
+
+  private:
+    struct Stat {
+        float min, max, sum;
+    };
+
+    static const size_t NUM_ENVIRONMENT = 8, NUM_POWER = 6;
+    Stat environment[NUM_ENVIRONMENT];
+    Stat power[NUM_POWER];
+    uint16_t numEnvironment = 0, numPower = 0;
+
+    static bool batching;
+
+    static void add(Stat *stats, const float *values, size_t count, uint16_t numBefore);
+};
@@ -0,0 +1,55 @@
+#include "TelemetryDeadband.h"
+#include <math.h>
+
+static bool moved(float value, float last, float deadband)
+{
+    return fabsf(value - last) >= deadband;
+}
+
+TelemetryDeadband::Last *TelemetryDeadband::getLast(const meshtastic_Telemetry &t)
+{
+    switch (t.which_variant) {
+    case meshtastic_Telemetry_environment_metrics_tag:
+        return &environment;
+    case meshtastic_Telemetry_power_metrics_tag:
+        return &power;
+    default:
+        return NULL;
+    }
+}
+
+bool TelemetryDeadband::shouldSend(const meshtastic_Telemetry &t, uint32_t nowMsec)
+{
+    const Last *last = getLast(t);
+    if (!last || !last->valid || nowMsec - last->sentMsec >= TELEMETRY_DEADBAND_MAX_SILENCE_SECS * 1000UL)
+        return true;
+
+    if (t.which_variant == meshtastic_Telemetry_environment_metrics_tag) {
+        const meshtastic_EnvironmentMetrics &m = t.variant.environment_metrics, &l = last->telemetry.variant.environment_metrics;
+        return moved(m.temperature, l.temperature, TELEMETRY_DEADBAND_TEMPERATURE) ||
+               moved(m.relative_humidity, l.relative_humidity, TELEMETRY_DEADBAND_HUMIDITY) ||
+               moved(m.barometric_pressure, l.barometric_pressure, TELEMETRY_DEADBAND_PRESSURE) ||
+               moved(m.gas_resistance, l.gas_resistance, TELEMETRY_DEADBAND_GAS_RESISTANCE) ||
+               moved(m.voltage, l.voltage, TELEMETRY_DEADBAND_VOLTAGE) ||
+               moved(m.current, l.current, TELEMETRY_DEADBAND_CURRENT) || moved(m.iaq, l.iaq, TELEMETRY_DEADBAND_IAQ) ||
+               moved(m.distance, l.distance, TELEMETRY_DEADBAND_DISTANCE);
+    }
+
+    const meshtastic_PowerMetrics &m = t.variant.power_metrics, &l = last->telemetry.variant.power_metrics;
+    return moved(m.ch1_voltage, l.ch1_voltage, TELEMETRY_DEADBAND_VOLTAGE) ||
+           moved(m.ch1_current, l.ch1_current, TELEMETRY_DEADBAND_CURRENT) ||
+           moved(m.ch2_voltage, l.ch2_voltage, TELEMETRY_DEADBAND_VOLTAGE) ||
+           moved(m.ch2_current, l.ch2_current, TELEMETRY_DEADBAND_CURRENT) ||
+           moved(m.ch3_voltage, l.ch3_voltage, TELEMETRY_DEADBAND_VOLTAGE) ||
+           moved(m.ch3_current, l.ch3_current, TELEMETRY_DEADBAND_CURRENT);
+}
+
+void TelemetryDeadband::sent(const meshtastic_Telemetry &t, uint32_t nowMsec)
+{
+    Last *last = getLast(t);
+    if (!last)
+        return;
+    last->valid = true;
+    last->sentMsec = nowMsec;
+    last->telemetry = t;
+}
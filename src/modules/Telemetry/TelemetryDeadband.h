@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../mesh/generated/meshtastic/telemetry.pb.h"
+#include "configuration.h"
+
+/// Build with -DMESHTASTIC_TELEMETRY_DEADBAND=1 for the environment and power telemetry modules to skip broadcasts whose
+/// readings barely changed, see TelemetryDeadband
+#ifndef MESHTASTIC_TELEMETRY_DEADBAND
+#define MESHTASTIC_TELEMETRY_DEADBAND 0
+#endif
+
+/// Broadcast telemetry at least this often, even when nothing changed, so the mesh knows the sensor is alive
+#ifndef TELEMETRY_DEADBAND_MAX_SILENCE_SECS
+#define TELEMETRY_DEADBAND_MAX_SILENCE_SECS (3 * 60 * 60)
+#endif
+
+/// How much each metric must change since the last broadcast to be worth another one
+#ifndef TELEMETRY_DEADBAND_TEMPERATURE
+#define TELEMETRY_DEADBAND_TEMPERATURE 0.5f // °C
+#endif
+#ifndef TELEMETRY_DEADBAND_HUMIDITY
+#define TELEMETRY_DEADBAND_HUMIDITY 2.0f // %
+#endif
+#ifndef TELEMETRY_DEADBAND_PRESSURE
+#define TELEMETRY_DEADBAND_PRESSURE 1.0f // hPa
+#endif
+#ifndef TELEMETRY_DEADBAND_GAS_RESISTANCE
+#define TELEMETRY_DEADBAND_GAS_RESISTANCE 1.0f // MOhm
+#endif
+#ifndef TELEMETRY_DEADBAND_VOLTAGE
+#define TELEMETRY_DEADBAND_VOLTAGE 0.1f // V
+#endif
+#ifndef TELEMETRY_DEADBAND_CURRENT
+#define TELEMETRY_DEADBAND_CURRENT 10.0f // mA
+#endif
+#ifndef TELEMETRY_DEADBAND_IAQ
+#define TELEMETRY_DEADBAND_IAQ 25
+#endif
+#ifndef TELEMETRY_DEADBAND_DISTANCE
+#define TELEMETRY_DEADBAND_DISTANCE 10.0f // mm
+#endif
+
+/**
+ * Decides whether fresh sensor readings are worth broadcasting: only when one of the metrics moved past its deadband since
+ * the last broadcast of the same kind of metrics, or that broadcast is TELEMETRY_DEADBAND_MAX_SILENCE_SECS old.
+ *
+ * It is all or nothing per packet: Telemetry fields have no presence, so a metric left out would read as 0.
+ */
+class TelemetryDeadband
+{
+  public:
+    /// Should these environment or power metrics be broadcast?
+    bool shouldSend(const meshtastic_Telemetry &t, uint32_t nowMsec);
+
+    /// These metrics were broadcast, the next ones are compared to them
+    void sent(const meshtastic_Telemetry &t, uint32_t nowMsec);
+
+  private:
+    struct Last {
+        bool valid = false;
+        uint32_t sentMsec;
+        meshtastic_Telemetry telemetry;
+    };
+    Last environment, power;
+
+    Last *getLast(const meshtastic_Telemetry &t);
+};
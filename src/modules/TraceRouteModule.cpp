@@ -1,5 +1,8 @@
 #include "TraceRouteModule.h"
 #include "MeshService.h"
+#ifdef ARCH_PORTDUINO
+#include "platform/portduino/TopologyGraph.h"
+#endif
 
 TraceRouteModule *traceRouteModule;
 
@@ -8,6 +11,17 @@ bool TraceRouteModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp, m
     // Only handle a response
     if (mp.decoded.request_id) {
         printRoute(r, mp.to, mp.from);
+#ifdef ARCH_PORTDUINO
+        topologyGraph.onRoute(mp.to, r->route, r->route_count, mp.from, millis() / 1000);
+#endif
+
+        // The route lists the relays from us to the destination, the first of them is the neighbor to send through
+        if (mp.to == nodeDB->getNodeNum()) {
+            uint8_t nextHop = (r->route_count ? r->route[0] : mp.from) & 0xff;
+            router->learnNextHop(mp.from, nextHop);
+            for (uint8_t i = 0; i < r->route_count; i++)
+                router->learnNextHop(r->route[i], nextHop);
+        }
     }
 
     return false; // let it be handled by RoutingModule
@@ -8,7 +8,14 @@
 #include "mesh/Router.h"
 #include "mesh/generated/meshtastic/mqtt.pb.h"
 #include "mesh/generated/meshtastic/telemetry.pb.h"
+#include "modules/NeighborInfoModule.h"
+#if !MESHTASTIC_EXCLUDE_GPS
+#include "modules/PositionModule.h"
+#endif
 #include "modules/RoutingModule.h"
+#if HAS_TELEMETRY
+#include "modules/Telemetry/TelemetryAggregator.h"
+#endif
 #if defined(ARCH_ESP32)
 #include "../mesh/generated/meshtastic/paxcount.pb.h"
 #endif
@@ -19,7 +26,12 @@
 #include <WiFi.h>
 #endif
 #include "Default.h"
+#ifdef ARCH_PORTDUINO
+#include "platform/portduino/PortduinoGlue.h"
+#endif
+#include <algorithm>
 #include <assert.h>
+#include <pb_encode.h>
 
 const int reconnectMax = 5;
 
@@ -128,6 +140,15 @@ void MQTT::onReceive(char *topic, byte *payload, size_t length)
         }
         delete json_value;
     } else {
+#if MQTT_WILDCARD_SUBSCRIBE
+        // We subscribed to every channel, so drop traffic for channels we don't downlink before decoding it
+        if (strncmp(topic, cryptTopic.c_str(), cryptTopic.length()) == 0) {
+            const char *channelId = topic + cryptTopic.length();
+            const char *end = strchr(channelId, '/');
+            if (findDownlinkChannel(channelId, end ? end - channelId : strlen(channelId)) < 0)
+                return;
+        }
+#endif
         if (length == 0) {
             LOG_WARN("Empty MQTT payload received, topic %s!\n", topic);
             return;
@@ -135,8 +156,8 @@ void MQTT::onReceive(char *topic, byte *payload, size_t length)
             LOG_ERROR("Invalid MQTT service envelope, topic %s, len %u!\n", topic, length);
             return;
         } else {
-            meshtastic_Channel ch = channels.getByName(e.channel_id);
             if (strcmp(e.gateway_id, owner.id) == 0) {
+                meshtastic_Channel ch = channels.getByName(e.channel_id);
                 // Generate an implicit ACK towards ourselves (handled and processed only locally!) for this message.
                 // We do this because packets are not rebroadcasted back into MQTT anymore and we assume that at least one node
                 // receives it when we get our own packet back. Then we'll stop our retransmissions.
@@ -145,21 +166,37 @@ void MQTT::onReceive(char *topic, byte *payload, size_t length)
                 else
                     LOG_INFO("Ignoring downlink message we originally sent.\n");
             } else {
-                // Find channel by channel_id and check downlink_enabled
-                if (strcmp(e.channel_id, channels.getGlobalId(ch.index)) == 0 && e.packet && ch.settings.downlink_enabled) {
+                // Find channel by channel_id, our table only has the channels with downlink_enabled
+                int chIndex = e.channel_id ? findDownlinkChannel(e.channel_id, strlen(e.channel_id)) : -1;
+                if (chIndex >= 0 && e.packet) {
                     LOG_INFO("Received MQTT topic %s, len=%u\n", topic, length);
-                    meshtastic_MeshPacket *p = packetPool.allocCopy(*e.packet);
-                    p->via_mqtt = true; // Mark that the packet was received via MQTT
+                    downlinkReceived++;
+
+                    // Cheap checks first, so a broker echo storm doesn't make us decrypt packets we have already seen.  Our own
+                    // packets still go to the router, which takes them as an implicit ack.
+                    if (downlinkHistory.wasSeenRecently(e.packet, false) ||
+                        (router && getFrom(e.packet) != nodeDB->getNodeNum() && router->wasSeenRecently(e.packet, false))) {
+                        LOG_DEBUG("Ignoring duplicate MQTT downlink packet\n");
+                        downlinkDuplicate++;
+                    } else if (e.packet->to != nodeDB->getNodeNum() && !allowDownlink(chIndex)) {
+                        LOG_WARN("MQTT downlink rate limit reached on channel %d, dropping\n", chIndex);
+                        downlinkRateLimited++;
+                    } else {
+                        downlinkHistory.wasSeenRecently(e.packet); // only now, so a rate limited packet may come again
+                        meshtastic_MeshPacket *p = packetPool.allocCopy(*e.packet);
+                        p->via_mqtt = true; // Mark that the packet was received via MQTT
 
-                    if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
-                        p->channel = ch.index;
-                    }
+                        if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
+                            p->channel = chIndex;
+                        }
 
-                    // ignore messages if we don't have the channel key
-                    if (router && perhapsDecode(p))
-                        router->enqueueReceivedMessage(p);
-                    else
-                        packetPool.release(p);
+                        // ignore messages if we don't have the channel key
+                        if (router && perhapsDecode(p)) {
+                            downlinkInjected++;
+                            router->enqueueReceivedMessage(p);
+                        } else
+                            packetPool.release(p);
+                    }
                 }
             }
         }
@@ -170,6 +207,32 @@ void MQTT::onReceive(char *topic, byte *payload, size_t length)
     }
 }
 
+bool MQTT::allowDownlink(ChannelIndex chIndex)
+{
+    if (MQTT_DOWNLINK_BURST == 0)
+        return true;
+    if (chIndex >= MAX_NUM_CHANNELS)
+        return false;
+
+    DownlinkBucket &bucket = downlinkBuckets[chIndex];
+    uint32_t now = millis();
+    if (bucket.lastRefillMsec == 0) {
+        bucket.tokens = MQTT_DOWNLINK_BURST;
+        bucket.lastRefillMsec = now;
+    }
+
+    uint32_t refills = (now - bucket.lastRefillMsec) / MQTT_DOWNLINK_REFILL_MSECS;
+    if (refills > 0) {
+        bucket.tokens = std::min<uint32_t>(bucket.tokens + refills, MQTT_DOWNLINK_BURST);
+        bucket.lastRefillMsec += refills * MQTT_DOWNLINK_REFILL_MSECS;
+    }
+
+    if (bucket.tokens == 0)
+        return false;
+    bucket.tokens--;
+    return true;
+}
+
 void mqttInit()
 {
     new MQTT();
@@ -192,12 +255,25 @@ MQTT::MQTT() : concurrency::OSThread("mqtt"), mqttQueue(MAX_MQTT_QUEUE)
             cryptTopic = moduleConfig.mqtt.root + cryptTopic;
             jsonTopic = moduleConfig.mqtt.root + jsonTopic;
             mapTopic = moduleConfig.mqtt.root + mapTopic;
+            mapAggregateTopic = moduleConfig.mqtt.root + mapAggregateTopic;
         } else {
             statusTopic = "msh" + statusTopic;
             cryptTopic = "msh" + cryptTopic;
             jsonTopic = "msh" + jsonTopic;
             mapTopic = "msh" + mapTopic;
+            mapAggregateTopic = "msh" + mapAggregateTopic;
+        }
+
+#ifdef ARCH_PORTDUINO
+        if (settingsStrings[mqttoutboxpath] != "") {
+            LOG_INFO("MQTT spooling to outbox %s while disconnected\n", settingsStrings[mqttoutboxpath].c_str());
+            outbox = new MQTTOutbox(settingsStrings[mqttoutboxpath], (uint64_t)settingsMap[mqttoutboxmaxmb] * 1024 * 1024,
+                                    settingsMap[mqttoutboxmaxagehours] * 60 * 60);
+            outboxReplayPerSecond = std::max(1, settingsMap[mqttoutboxreplaypersecond]);
         }
+#endif
+
+        rebuildDownlinkChannels();
 
         if (moduleConfig.mqtt.map_reporting_enabled && moduleConfig.mqtt.has_map_report_settings) {
             map_position_precision = Default::getConfiguredOrDefault(moduleConfig.mqtt.map_report_settings.position_precision,
@@ -358,22 +434,76 @@ void MQTT::reconnect()
 void MQTT::sendSubscriptions()
 {
 #ifdef HAS_NETWORKING
+#if MQTT_WILDCARD_SUBSCRIBE
+    // One subscription for all channels, onReceive() demuxes by channel ID
+    if (!downlinkChannels.empty()) {
+        std::string topic = cryptTopic + "#";
+        LOG_INFO("Subscribing to %s\n", topic.c_str());
+        pubSub.subscribe(topic.c_str(), 1); // FIXME, is QOS 1 right?
+#ifndef ARCH_NRF52                          // JSON is not supported on nRF52, see issue #2804
+        if (moduleConfig.mqtt.json_enabled == true) {
+            std::string topicDecoded = jsonTopic + "#";
+            LOG_INFO("Subscribing to %s\n", topicDecoded.c_str());
+            pubSub.subscribe(topicDecoded.c_str(), 1); // FIXME, is QOS 1 right?
+        }
+#endif // ARCH_NRF52
+    }
+#else
+    for (const auto &ch : downlinkChannels) {
+        std::string topic = cryptTopic + ch.id + "/#";
+        LOG_INFO("Subscribing to %s\n", topic.c_str());
+        pubSub.subscribe(topic.c_str(), 1); // FIXME, is QOS 1 right?
+#ifndef ARCH_NRF52                          // JSON is not supported on nRF52, see issue #2804
+        if (moduleConfig.mqtt.json_enabled == true) {
+            std::string topicDecoded = jsonTopic + ch.id + "/#";
+            LOG_INFO("Subscribing to %s\n", topicDecoded.c_str());
+            pubSub.subscribe(topicDecoded.c_str(), 1); // FIXME, is QOS 1 right?
+        }
+#endif // ARCH_NRF52
+    }
+#endif
+#endif
+}
+
+void MQTT::rebuildDownlinkChannels()
+{
+    downlinkChannels.clear();
     size_t numChan = channels.getNumChannels();
     for (size_t i = 0; i < numChan; i++) {
         const auto &ch = channels.getByIndex(i);
         if (ch.settings.downlink_enabled) {
-            std::string topic = cryptTopic + channels.getGlobalId(i) + "/#";
-            LOG_INFO("Subscribing to %s\n", topic.c_str());
-            pubSub.subscribe(topic.c_str(), 1); // FIXME, is QOS 1 right?
-#ifndef ARCH_NRF52                              // JSON is not supported on nRF52, see issue #2804
-            if (moduleConfig.mqtt.json_enabled == true) {
-                std::string topicDecoded = jsonTopic + channels.getGlobalId(i) + "/#";
-                LOG_INFO("Subscribing to %s\n", topicDecoded.c_str());
-                pubSub.subscribe(topicDecoded.c_str(), 1); // FIXME, is QOS 1 right?
-            }
-#endif // ARCH_NRF52
+            DownlinkChannel dc;
+            dc.id = channels.getGlobalId(i);
+            dc.index = i;
+            downlinkChannels.push_back(dc);
         }
     }
+    std::sort(downlinkChannels.begin(), downlinkChannels.end());
+}
+
+int MQTT::findDownlinkChannel(const char *channelId, size_t len) const
+{
+    size_t lo = 0, hi = downlinkChannels.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = downlinkChannels[mid].id.compare(0, std::string::npos, channelId, len);
+        if (cmp == 0)
+            return downlinkChannels[mid].index;
+        else if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
+}
+
+void MQTT::onChannelsChanged()
+{
+    rebuildDownlinkChannels();
+#ifdef HAS_NETWORKING
+    // Subscribe to any newly downlinked channels, the broker ignores subscriptions we already have
+    if (isConnectedDirectly())
+        sendSubscriptions();
 #endif
 }
 
@@ -402,10 +532,15 @@ int32_t MQTT::runOnce()
     bool wantConnection = wantsLink();
 
     perhapsReportToMap();
+#if MQTT_MAP_AGGREGATE
+    perhapsReportAggregateToMap();
+#endif
 
     // If connected poll rapidly, otherwise only occasionally check for a wifi connection change and ability to contact server
     if (moduleConfig.mqtt.proxy_to_client_enabled) {
-        publishQueuedMessages();
+        // Hand the phone as many queued envelopes as it has room for, rather than one per run
+        while (!mqttQueue.isEmpty() && service.hasRoomForMqttClientProxyMessage(proxyMessagesPerEnvelope()))
+            publishQueuedMessages();
         return 200;
     }
 #ifdef HAS_NETWORKING
@@ -429,6 +564,8 @@ int32_t MQTT::runOnce()
             pubSub.disconnect();
         }
 
+        perhapsReplayOutbox();
+
         powerFSM.trigger(EVENT_CONTACT_FROM_PHONE); // Suppress entering light sleep (because that would turn off bluetooth)
         return 20;
     }
@@ -474,11 +611,31 @@ void MQTT::publishQueuedMessages()
     }
 }
 
+int MQTT::proxyMessagesPerEnvelope()
+{
+#ifndef ARCH_NRF52 // JSON is not supported on nRF52, see issue #2804
+    if (moduleConfig.mqtt.json_enabled)
+        return 2; // the envelope and its JSON
+#endif
+    return 1;
+}
+
+bool MQTT::canPublishToClientProxy()
+{
+    return moduleConfig.mqtt.proxy_to_client_enabled && mqttQueue.isEmpty() &&
+           service.hasRoomForMqttClientProxyMessage(proxyMessagesPerEnvelope());
+}
+
 void MQTT::onSend(const meshtastic_MeshPacket &mp, const meshtastic_MeshPacket &mp_decoded, ChannelIndex chIndex)
 {
     if (mp.via_mqtt)
         return; // Don't send messages that came from MQTT back into MQTT
 
+    if (NeighborInfoModule::isDelta(mp_decoded)) {
+        LOG_DEBUG("MQTT onSend - Ignoring NeighborInfo delta, only full lists are published\n");
+        return;
+    }
+
     auto &ch = channels.getByIndex(chIndex);
 
     if (&mp_decoded.decoded && strcmp(moduleConfig.mqtt.address, default_mqtt_address) == 0 &&
@@ -488,58 +645,170 @@ void MQTT::onSend(const meshtastic_MeshPacket &mp, const meshtastic_MeshPacket &
         return;
     }
 
+    // A position delta has no coordinates of its own, so publish the full position it expands to
+    const meshtastic_MeshPacket *decoded = &mp_decoded;
+    meshtastic_MeshPacket *expanded = nullptr;
+#if !MESHTASTIC_EXCLUDE_GPS
+    if (PositionModule::isDelta(mp_decoded)) {
+        expanded = packetPool.allocCopy(mp_decoded);
+        if (!positionModule || !positionModule->expandForPhone(*expanded)) {
+            LOG_DEBUG("MQTT onSend - Ignoring position delta we couldn't expand\n");
+            packetPool.release(expanded);
+            return;
+        }
+        decoded = expanded;
+    }
+#endif
+#if MQTT_MAP_AGGREGATE
+    rememberPublicPosition(*decoded, chIndex);
+#endif
+    if (expanded && moduleConfig.mqtt.encryption_enabled) {
+        // Encrypting the full position under the delta's packet id would reuse its nonce, so those aren't published at all
+        LOG_DEBUG("MQTT onSend - Ignoring encrypted position delta\n");
+        packetPool.release(expanded);
+        return;
+    }
+
     if (ch.settings.uplink_enabled) {
-        const char *channelId = channels.getGlobalId(chIndex); // FIXME, for now we just use the human name for the channel
+        publishUplink(mp, decoded, chIndex);
+#if HAS_TELEMETRY
+        // MQTT clients, like the phone, only decode the device and power metrics of a batched packet in packets of their own.
+        // Those keep the batch's packet id, so they aren't published encrypted, which would reuse its nonce.
+        for (uint32_t tag : TelemetryAggregator::unbatchedTags) {
+            meshtastic_MeshPacket *unbatched =
+                moduleConfig.mqtt.encryption_enabled ? NULL : TelemetryAggregator::allocUnbatched(*decoded, tag);
+            if (unbatched) {
+                publishUplink(*unbatched, unbatched, chIndex);
+                packetPool.release(unbatched);
+            }
+        }
+#endif
+    }
+    if (expanded)
+        packetPool.release(expanded);
+}
 
-        meshtastic_ServiceEnvelope *env = mqttPool.allocZeroed();
-        env->channel_id = (char *)channelId;
-        env->gateway_id = owner.id;
+void MQTT::publishUplink(const meshtastic_MeshPacket &mp, const meshtastic_MeshPacket *decoded, ChannelIndex chIndex)
+{
+    const char *channelId = channels.getGlobalId(chIndex); // FIXME, for now we just use the human name for the channel
 
-        LOG_DEBUG("MQTT onSend - Publishing ");
-        if (moduleConfig.mqtt.encryption_enabled) {
-            env->packet = (meshtastic_MeshPacket *)&mp;
-            LOG_DEBUG("encrypted message\n");
-        } else {
-            env->packet = (meshtastic_MeshPacket *)&mp_decoded;
-            LOG_DEBUG("portnum %i message\n", env->packet->decoded.portnum);
-        }
+    meshtastic_ServiceEnvelope *env = mqttPool.allocZeroed();
+    env->channel_id = (char *)channelId;
+    env->gateway_id = owner.id;
 
-        if (moduleConfig.mqtt.proxy_to_client_enabled || this->isConnectedDirectly()) {
-            // FIXME - this size calculation is super sloppy, but it will go away once we dynamically alloc meshpackets
-            static uint8_t bytes[meshtastic_MeshPacket_size + 64];
-            size_t numBytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_ServiceEnvelope_msg, env);
+    LOG_DEBUG("MQTT onSend - Publishing ");
+    if (moduleConfig.mqtt.encryption_enabled) {
+        env->packet = (meshtastic_MeshPacket *)&mp;
+        LOG_DEBUG("encrypted message\n");
+    } else {
+        env->packet = (meshtastic_MeshPacket *)decoded;
+        LOG_DEBUG("portnum %i message\n", env->packet->decoded.portnum);
+    }
 
-            std::string topic = cryptTopic + channelId + "/" + owner.id;
-            LOG_DEBUG("MQTT Publish %s, %u bytes\n", topic.c_str(), numBytes);
+    if (!isOutboxPending() && (canPublishToClientProxy() || this->isConnectedDirectly())) {
+        // FIXME - this size calculation is super sloppy, but it will go away once we dynamically alloc meshpackets
+        static uint8_t bytes[meshtastic_MeshPacket_size + 64];
+        size_t numBytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_ServiceEnvelope_msg, env);
+
+        std::string topic = cryptTopic + channelId + "/" + owner.id;
+        LOG_DEBUG("MQTT Publish %s, %u bytes\n", topic.c_str(), numBytes);
 
-            publish(topic.c_str(), bytes, numBytes, false);
+        publish(topic.c_str(), bytes, numBytes, false);
 
 #ifndef ARCH_NRF52 // JSON is not supported on nRF52, see issue #2804
-            if (moduleConfig.mqtt.json_enabled) {
-                // handle json topic
-                auto jsonString = this->meshPacketToJson((meshtastic_MeshPacket *)&mp_decoded);
-                if (jsonString.length() != 0) {
-                    std::string topicJson = jsonTopic + channelId + "/" + owner.id;
-                    LOG_INFO("JSON publish message to %s, %u bytes: %s\n", topicJson.c_str(), jsonString.length(),
-                             jsonString.c_str());
-                    publish(topicJson.c_str(), jsonString.c_str(), false);
-                }
+        if (moduleConfig.mqtt.json_enabled) {
+            // handle json topic
+            auto jsonString = this->meshPacketToJson((meshtastic_MeshPacket *)decoded);
+            if (jsonString.length() != 0) {
+                std::string topicJson = jsonTopic + channelId + "/" + owner.id;
+                LOG_INFO("JSON publish message to %s, %u bytes: %s\n", topicJson.c_str(), jsonString.length(),
+                         jsonString.c_str());
+                publish(topicJson.c_str(), jsonString.c_str(), false);
             }
+        }
 #endif // ARCH_NRF52
-        } else {
-            LOG_INFO("MQTT not connected, queueing packet\n");
-            if (mqttQueue.numFree() == 0) {
-                LOG_WARN("NOTE: MQTT queue is full, discarding oldest\n");
-                meshtastic_ServiceEnvelope *d = mqttQueue.dequeuePtr(0);
-                if (d)
-                    mqttPool.release(d);
-            }
-            // make a copy of serviceEnvelope and queue it
-            meshtastic_ServiceEnvelope *copied = mqttPool.allocCopy(*env);
-            assert(mqttQueue.enqueue(copied, 0));
+    } else if (moduleConfig.mqtt.proxy_to_client_enabled || !spoolToOutbox(env, decoded)) {
+        LOG_INFO("MQTT not connected or client proxy busy, queueing packet\n");
+        if (mqttQueue.numFree() == 0) {
+            LOG_WARN("NOTE: MQTT queue is full, discarding oldest\n");
+            meshtastic_ServiceEnvelope *d = mqttQueue.dequeuePtr(0);
+            if (d)
+                mqttPool.release(d);
         }
-        mqttPool.release(env);
+        // make a copy of serviceEnvelope and queue it
+        meshtastic_ServiceEnvelope *copied = mqttPool.allocCopy(*env);
+        assert(mqttQueue.enqueue(copied, 0));
+    }
+    mqttPool.release(env);
+}
+
+/// Reduce a coordinate to the given number of bits of precision, centered in the resulting box (same as in PositionModule)
+static int32_t reduceMapPrecision(int32_t coord, uint32_t precision)
+{
+    if (precision < 32 && precision > 0) {
+        coord &= (UINT32_MAX << (32 - precision));
+        coord += (1 << (31 - precision));
     }
+    return coord;
+}
+
+bool MQTT::spoolToOutbox(const meshtastic_ServiceEnvelope *env, const meshtastic_MeshPacket *decoded)
+{
+#ifdef ARCH_PORTDUINO
+    if (outbox) {
+        static uint8_t bytes[meshtastic_MeshPacket_size + 64];
+        size_t numBytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_ServiceEnvelope_msg, env);
+
+        std::string topic = cryptTopic + env->channel_id + "/" + owner.id;
+        LOG_INFO("MQTT spooling %u bytes to outbox\n", numBytes);
+        if (!outbox->append(topic.c_str(), bytes, numBytes))
+            LOG_WARN("NOTE: MQTT outbox write failed, discarding packet\n");
+
+        // The JSON is spooled as a record of its own, as it can't be made from an encrypted envelope on replay
+        if (moduleConfig.mqtt.json_enabled) {
+            auto jsonString = this->meshPacketToJson((meshtastic_MeshPacket *)decoded);
+            std::string topicJson = jsonTopic + env->channel_id + "/" + owner.id;
+            if (jsonString.length() != 0 &&
+                !outbox->append(topicJson.c_str(), (const uint8_t *)jsonString.c_str(), jsonString.length()))
+                LOG_WARN("NOTE: MQTT outbox write failed, discarding JSON\n");
+        }
+        return true;
+    }
+#endif
+    return false;
+}
+
+bool MQTT::isOutboxPending()
+{
+#ifdef ARCH_PORTDUINO
+    // The outbox is only spooled to and replayed on direct connections
+    return outbox && !moduleConfig.mqtt.proxy_to_client_enabled && !outbox->isEmpty();
+#else
+    return false;
+#endif
+}
+
+void MQTT::perhapsReplayOutbox()
+{
+#ifdef ARCH_PORTDUINO
+    if (!outbox || outbox->isEmpty())
+        return;
+
+    // Catch up on at most one second worth of replays, no matter how long ago we last ran
+    uint32_t now = millis();
+    uint32_t budget =
+        std::min<uint64_t>((uint64_t)(now - lastOutboxReplay) * outboxReplayPerSecond / 1000, outboxReplayPerSecond);
+    if (budget == 0)
+        return;
+    lastOutboxReplay = now;
+
+    size_t numReplayed = outbox->replay(budget, [this](const char *topic, const uint8_t *payload, size_t length) {
+        return publish(topic, payload, length, false);
+    });
+    if (numReplayed > 0)
+        LOG_DEBUG("MQTT replayed %u messages from outbox, %llu bytes left\n", numReplayed,
+                  (unsigned long long)outbox->getSpooledBytes());
+#endif
 }
 
 void MQTT::perhapsReportToMap()
@@ -583,15 +852,8 @@ void MQTT::perhapsReportToMap()
         mapReport.has_default_channel = channels.hasDefaultChannel();
 
         // Set position with precision (same as in PositionModule)
-        if (map_position_precision < 32 && map_position_precision > 0) {
-            mapReport.latitude_i = localPosition.latitude_i & (UINT32_MAX << (32 - map_position_precision));
-            mapReport.longitude_i = localPosition.longitude_i & (UINT32_MAX << (32 - map_position_precision));
-            mapReport.latitude_i += (1 << (31 - map_position_precision));
-            mapReport.longitude_i += (1 << (31 - map_position_precision));
-        } else {
-            mapReport.latitude_i = localPosition.latitude_i;
-            mapReport.longitude_i = localPosition.longitude_i;
-        }
+        mapReport.latitude_i = reduceMapPrecision(localPosition.latitude_i, map_position_precision);
+        mapReport.longitude_i = reduceMapPrecision(localPosition.longitude_i, map_position_precision);
         mapReport.altitude = localPosition.altitude;
         mapReport.position_precision = map_position_precision;
 
@@ -916,4 +1178,99 @@ bool MQTT::isValidJsonEnvelope(JSONObject &json)
            (json["from"]->AsNumber() == nodeDB->getNodeNum()) &&            // only accept message if the "from" is us
            (json.find("type") != json.end()) && json["type"]->IsString() && // should specify a type
            (json.find("payload") != json.end());                            // should have a payload
-}
\ No newline at end of file
+}
+
+#if MQTT_MAP_AGGREGATE
+#define MAP_AGGREGATE_ONLINE_SECS (60 * 60 * 2) // same as NodeDB, only report nodes heard in the last 2 hrs
+
+void MQTT::rememberPublicPosition(const meshtastic_MeshPacket &mp_decoded, ChannelIndex chIndex)
+{
+    meshtastic_Position pos;
+    if (mp_decoded.which_payload_variant != meshtastic_MeshPacket_decoded_tag ||
+        mp_decoded.decoded.portnum != meshtastic_PortNum_POSITION_APP || getFrom(&mp_decoded) == nodeDB->getNodeNum() ||
+        !channels.isPublic(chIndex) ||
+        !pb_decode_from_bytes(mp_decoded.decoded.payload.bytes, mp_decoded.decoded.payload.size, &meshtastic_Position_msg, &pos))
+        return;
+    if (!pos.latitude_i && !pos.longitude_i) {
+        publicPositions.erase(getFrom(&mp_decoded));
+        return;
+    }
+    // Firmware from before position precision always sent the full position
+    publicPositions[getFrom(&mp_decoded)] = {
+        {pos.latitude_i, pos.longitude_i, pos.altitude}, pos.time, pos.precision_bits ? pos.precision_bits : 32};
+}
+
+void MQTT::perhapsReportAggregateToMap()
+{
+    if (!moduleConfig.mqtt.map_reporting_enabled || !(moduleConfig.mqtt.proxy_to_client_enabled || isConnectedDirectly()))
+        return;
+
+    if (millis() - last_aggregate_report_to_map < map_publish_interval_msecs || map_position_precision == 0)
+        return;
+    last_aggregate_report_to_map = millis();
+
+    // Periodically send every node again, so a map backend that (re)started in between gets the full picture
+    bool keyframe = (aggregateReportCount++ % MAP_AGGREGATE_KEYFRAME_INTERVAL) == 0;
+    if (keyframe) {
+        lastAggregatePositions.clear(); // Also forgets nodes which dropped out of our NodeDB
+        for (auto it = publicPositions.begin(); it != publicPositions.end();)
+            it = nodeDB->getMeshNode(it->first) ? std::next(it) : publicPositions.erase(it);
+    }
+    std::string topic = mapAggregateTopic + owner.id;
+
+    static uint8_t bytes[MAX_MAP_AGGREGATE_BYTES];
+    pb_ostream_t stream = pb_ostream_from_buffer(bytes, sizeof(bytes));
+    // What the message we are building reports, only taken as reported once it is published
+    std::vector<std::pair<NodeNum, ReportedPosition>> batch;
+    auto publishBatch = [&]() {
+        LOG_INFO("MQTT Publish aggregated map report of %u nodes to %s\n", (unsigned)batch.size(), topic.c_str());
+        if (publish(topic.c_str(), bytes, stream.bytes_written, false))
+            for (auto &reported : batch)
+                lastAggregatePositions[reported.first] = reported.second;
+        stream = pb_ostream_from_buffer(bytes, sizeof(bytes));
+        batch.clear();
+    };
+
+    for (auto &entry : publicPositions) {
+        const meshtastic_NodeInfoLite *node = nodeDB->getMeshNode(entry.first);
+        // Nodes heard via MQTT are reported by their own gateway
+        if (!node || node->via_mqtt || sinceLastSeen(node) >= MAP_AGGREGATE_ONLINE_SECS)
+            continue;
+
+        // Never more precise than the node itself broadcast it
+        uint32_t precision = std::min(map_position_precision, entry.second.precision_bits);
+        ReportedPosition pos;
+        pos.latitude_i = reduceMapPrecision(entry.second.position.latitude_i, precision);
+        pos.longitude_i = reduceMapPrecision(entry.second.position.longitude_i, precision);
+        pos.altitude = entry.second.position.altitude;
+
+        auto last = lastAggregatePositions.find(node->num);
+        if (!keyframe && last != lastAggregatePositions.end() && last->second.latitude_i == pos.latitude_i &&
+            last->second.longitude_i == pos.longitude_i && last->second.altitude == pos.altitude)
+            continue; // Unchanged since our previous report
+
+        // Only the node number and the (precision reduced) position, everything else the backend gets from MapReports
+        meshtastic_NodeInfo info = meshtastic_NodeInfo_init_default;
+        info.num = node->num;
+        info.last_heard = node->last_heard;
+        info.has_position = true;
+        info.position.latitude_i = pos.latitude_i;
+        info.position.longitude_i = pos.longitude_i;
+        info.position.altitude = pos.altitude;
+        info.position.time = entry.second.time;
+        info.position.precision_bits = precision;
+
+        size_t infoSize = 0;
+        pb_get_encoded_size(&infoSize, &meshtastic_NodeInfo_msg, &info);
+        if (stream.bytes_written + infoSize + 2 > sizeof(bytes)) // +2 for the length prefix
+            publishBatch();
+        if (pb_encode_ex(&stream, &meshtastic_NodeInfo_msg, &info, PB_ENCODE_DELIMITED))
+            batch.push_back({node->num, pos});
+        else
+            LOG_ERROR("Can't encode aggregated map report entry reason='%s'\n", PB_GET_ERROR(&stream));
+    }
+
+    if (!batch.empty())
+        publishBatch();
+}
+#endif
@@ -4,8 +4,12 @@
 
 #include "concurrency/OSThread.h"
 #include "mesh/Channels.h"
+#include "mesh/PacketHistory.h"
 #include "mesh/generated/meshtastic/mqtt.pb.h"
 #include "mqtt/JSON.h"
+#ifdef ARCH_PORTDUINO
+#include "mqtt/MQTTOutbox.h"
+#endif
 #if HAS_WIFI
 #include <WiFiClient.h>
 #define HAS_NETWORKING 1
@@ -22,8 +26,33 @@
 #include <PubSubClient.h>
 #endif
 
+#include <unordered_map>
+#include <vector>
+
 #define MAX_MQTT_QUEUE 16
 
+// Build with -DMQTT_DOWNLINK_BURST=10 (for example) to limit how many downlinked packets per channel we inject into the mesh
+// with a token bucket, to protect our airtime.  Packets addressed to us are never limited.  0 means no limit.
+#ifndef MQTT_DOWNLINK_BURST
+#define MQTT_DOWNLINK_BURST 0 // max packets a channel may inject back-to-back
+#endif
+#ifndef MQTT_DOWNLINK_REFILL_MSECS
+#define MQTT_DOWNLINK_REFILL_MSECS (6 * 1000) // one more packet allowed per channel every 6 secs
+#endif
+
+// Gateways can also publish the positions of the nodes they hear, batched into one message per map report interval.  Only
+// positions the nodes broadcast on a public channel are published, and never more precisely than they broadcast them.
+#ifndef MQTT_MAP_AGGREGATE
+#define MQTT_MAP_AGGREGATE 0
+#endif
+#define MAX_MAP_AGGREGATE_BYTES 400       // fits the PubSubClient buffer and a client proxy payload
+#define MAP_AGGREGATE_KEYFRAME_INTERVAL 8 // every Nth aggregated report lists all nodes, not only the changed ones
+
+// Subscribe to all channels with a single wildcard topic and demux in firmware, only sensible on private brokers
+#ifndef MQTT_WILDCARD_SUBSCRIBE
+#define MQTT_WILDCARD_SUBSCRIBE 0
+#endif
+
 /**
  * Our wrapper/singleton for sending/receiving MQTT "udp" packets.  This object isolates the MQTT protocol implementation from
  * the two components that use it: MQTTPlugin and MQTTSimInterface.
@@ -75,6 +104,12 @@ class MQTT : private concurrency::OSThread
 
     void start() { setIntervalFromNow(0); };
 
+    /// Called when our channel config changed, rebuilds the topic->channel table and subscriptions
+    void onChannelsChanged();
+
+    /// Downlink statistics, exposed for monitoring
+    uint32_t downlinkReceived = 0, downlinkDuplicate = 0, downlinkRateLimited = 0, downlinkInjected = 0;
+
   protected:
     PointerQueue<meshtastic_ServiceEnvelope> mqttQueue;
 
@@ -87,6 +122,7 @@ class MQTT : private concurrency::OSThread
     std::string cryptTopic = "/2/e/";     // msh/2/e/CHANNELID/NODEID
     std::string jsonTopic = "/2/json/";   // msh/2/json/CHANNELID/NODEID
     std::string mapTopic = "/2/map/";     // For protobuf-encoded MapReport messages
+    std::string mapAggregateTopic = "/2/mapagg/"; // msh/2/mapagg/NODEID, length-delimited NodeInfo positions
 
     // For map reporting (only applies when enabled)
     const uint32_t default_map_position_precision = 14;         // defaults to max. offset of ~1459m
@@ -95,6 +131,59 @@ class MQTT : private concurrency::OSThread
     uint32_t map_position_precision = default_map_position_precision;
     uint32_t map_publish_interval_msecs = default_map_publish_interval_secs * 1000;
 
+#if MQTT_MAP_AGGREGATE
+    // For aggregated map reporting, the positions we last published for every node
+    struct ReportedPosition {
+        int32_t latitude_i;
+        int32_t longitude_i;
+        int32_t altitude;
+    };
+    std::unordered_map<NodeNum, ReportedPosition> lastAggregatePositions;
+    // The positions other nodes broadcast on a public channel, the only ones we may report, at the precision they chose
+    struct PublicPosition {
+        ReportedPosition position;
+        uint32_t time;
+        uint32_t precision_bits;
+    };
+    std::unordered_map<NodeNum, PublicPosition> publicPositions;
+    uint32_t last_aggregate_report_to_map = 0;
+    uint32_t aggregateReportCount = 0;
+#endif
+
+    /// Packets we already received via downlink, checked before we spend time decrypting them (separate from the router's
+    /// history, so the router still gets to see the first copy)
+    PacketHistory downlinkHistory;
+
+    struct DownlinkBucket {
+        uint32_t tokens;
+        uint32_t lastRefillMsec;
+    };
+    DownlinkBucket downlinkBuckets[MAX_NUM_CHANNELS] = {};
+
+    /// Return true if the channel's token bucket allows injecting another downlinked packet into the mesh, or there is no limit
+    bool allowDownlink(ChannelIndex chIndex);
+
+#ifdef ARCH_PORTDUINO
+    /// Optional disk spool for uplink messages while the broker is unreachable (native only)
+    MQTTOutbox *outbox = nullptr;
+    uint32_t outboxReplayPerSecond = 0;
+    uint32_t lastOutboxReplay = 0;
+#endif
+
+    /// Publish decoded on the uplink of channel chIndex, or mp, its encrypted form, if encryption is enabled.  Spooled or
+    /// queued while we can't publish.
+    void publishUplink(const meshtastic_MeshPacket &mp, const meshtastic_MeshPacket *decoded, ChannelIndex chIndex);
+
+    /// Spool an envelope we can't publish right now to the outbox, with its JSON made from decoded if that is enabled, return
+    /// false if we have no outbox
+    bool spoolToOutbox(const meshtastic_ServiceEnvelope *env, const meshtastic_MeshPacket *decoded);
+
+    /// Replay spooled envelopes at the configured rate once we are connected again
+    void perhapsReplayOutbox();
+
+    /// Are spooled envelopes still waiting to be replayed?  New ones then go after them, to keep them in order
+    bool isOutboxPending();
+
     /** return true if we have a channel that wants uplink/downlink or map reporting is enabled
      */
     bool wantsLink() const;
@@ -103,6 +192,21 @@ class MQTT : private concurrency::OSThread
      */
     void sendSubscriptions();
 
+    /// A channel with downlink enabled, by its global channel ID
+    struct DownlinkChannel {
+        std::string id;
+        ChannelIndex index;
+
+        bool operator<(const DownlinkChannel &other) const { return id < other.id; }
+    };
+    /// Sorted by id, so incoming topics can be matched to a channel with a binary search
+    std::vector<DownlinkChannel> downlinkChannels;
+
+    void rebuildDownlinkChannels();
+
+    /// Return the index of the downlink enabled channel with this (not necessarily null terminated) ID, or -1 if none
+    int findDownlinkChannel(const char *channelId, size_t len) const;
+
     /// Callback for direct mqtt subscription messages
     static void mqttCallback(char *topic, byte *payload, unsigned int length);
 
@@ -115,9 +219,25 @@ class MQTT : private concurrency::OSThread
     void publishStatus();
     void publishQueuedMessages();
 
+    /** With the client proxy, the phone drains the proxy queue at its own pace.  Only hand it a new envelope while there is
+     * room and nothing older is still waiting in mqttQueue, so envelopes keep their order instead of being discarded.
+     */
+    bool canPublishToClientProxy();
+
+    /// Number of client proxy messages publishing one envelope takes, as with JSON enabled it is published twice
+    static int proxyMessagesPerEnvelope();
+
     // Check if we should report unencrypted information about our node for consumption by a map
     void perhapsReportToMap();
 
+#if MQTT_MAP_AGGREGATE
+    // Check if we should report the positions of the nodes we hear for consumption by a map, in a single message
+    void perhapsReportAggregateToMap();
+
+    // Remember the position in mp_decoded if it was sent on a public channel, for perhapsReportAggregateToMap()
+    void rememberPublicPosition(const meshtastic_MeshPacket &mp_decoded, ChannelIndex chIndex);
+#endif
+
     // returns true if this is a valid JSON envelope which we accept on downlink
     bool isValidJsonEnvelope(JSONObject &json);
 
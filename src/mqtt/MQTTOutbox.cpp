@@ -0,0 +1,223 @@
+#include "MQTTOutbox.h"
+
+#ifdef ARCH_PORTDUINO
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MQTT_OUTBOX_SEGMENT_BYTES (1024 * 1024) // start a new segment file once the current one reaches 1 MB
+#define MQTT_OUTBOX_HEADER_BYTES 9              // length, time and topic length
+
+MQTTOutbox::MQTTOutbox(const std::string &dir, uint64_t maxBytes, uint32_t maxAgeSecs)
+    : dir(dir), maxBytes(maxBytes), maxAgeSecs(maxAgeSecs)
+{
+    load();
+}
+
+std::string MQTTOutbox::segmentPath(uint32_t segment) const
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%08u.seg", segment);
+    return dir + "/" + name;
+}
+
+void MQTTOutbox::load()
+{
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("Can't create MQTT outbox directory %s: %s\n", dir.c_str(), strerror(errno));
+        return;
+    }
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        uint32_t segment;
+        char suffix[8];
+        if (sscanf(entry->d_name, "%8u.%3s", &segment, suffix) == 2 && strcmp(suffix, "seg") == 0) {
+            struct stat st;
+            if (stat(segmentPath(segment).c_str(), &st) == 0) {
+                segments.push_back(segment);
+                spooledBytes += st.st_size;
+            }
+        }
+    }
+    closedir(d);
+    std::sort(segments.begin(), segments.end());
+
+    if (segments.empty())
+        return;
+
+    struct stat st;
+    if (stat(segmentPath(segments.back()).c_str(), &st) == 0)
+        writeOffset = st.st_size;
+
+    FILE *f = fopen((dir + "/cursor").c_str(), "rb");
+    if (f) {
+        uint32_t cursor[2];
+        if (fread(cursor, sizeof(cursor), 1, f) == 1 && cursor[0] == segments.front())
+            readOffset = cursor[1];
+        fclose(f);
+    }
+    LOG_INFO("MQTT outbox has %u segments, %llu bytes spooled\n", (unsigned)segments.size(), (unsigned long long)spooledBytes);
+}
+
+void MQTTOutbox::saveCursor()
+{
+    FILE *f = fopen((dir + "/cursor").c_str(), "wb");
+    if (f) {
+        uint32_t cursor[2] = {segments.empty() ? 0 : segments.front(), readOffset};
+        fwrite(cursor, sizeof(cursor), 1, f);
+        fclose(f);
+    }
+}
+
+void MQTTOutbox::dropOldestSegment()
+{
+    unmapSegment();
+    std::string path = segmentPath(segments.front());
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0)
+        spooledBytes -= std::min<uint64_t>(spooledBytes, st.st_size);
+    unlink(path.c_str());
+
+    segments.erase(segments.begin());
+    readOffset = 0;
+    if (segments.empty()) {
+        writeOffset = 0;
+        spooledBytes = 0;
+    }
+}
+
+bool MQTTOutbox::append(const char *topic, const uint8_t *payload, size_t length)
+{
+    size_t topicLen = strlen(topic);
+    if (topicLen > UINT8_MAX)
+        return false;
+
+    if (segments.empty() || writeOffset >= MQTT_OUTBOX_SEGMENT_BYTES) {
+        segments.push_back(segments.empty() ? 0 : segments.back() + 1);
+        writeOffset = 0;
+    }
+
+    FILE *f = fopen(segmentPath(segments.back()).c_str(), "ab");
+    if (!f) {
+        LOG_ERROR("Can't open MQTT outbox segment: %s\n", strerror(errno));
+        return false;
+    }
+    uint8_t header[MQTT_OUTBOX_HEADER_BYTES];
+    uint32_t recordLen = MQTT_OUTBOX_HEADER_BYTES - sizeof(uint32_t) + topicLen + length;
+    uint32_t now = time(NULL);
+    memcpy(header, &recordLen, sizeof(recordLen));
+    memcpy(header + 4, &now, sizeof(now));
+    header[8] = topicLen;
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1 && fwrite(topic, topicLen, 1, f) == 1 &&
+              (length == 0 || fwrite(payload, length, 1, f) == 1);
+    fclose(f);
+    if (!ok) {
+        LOG_ERROR("Can't write MQTT outbox record\n");
+        return false;
+    }
+
+    writeOffset += sizeof(recordLen) + recordLen;
+    spooledBytes += sizeof(recordLen) + recordLen;
+
+    // Never discard the segment we are writing to, a single segment is much smaller than any sensible cap
+    while (spooledBytes > maxBytes && segments.size() > 1) {
+        LOG_WARN("MQTT outbox is full, discarding oldest segment\n");
+        dropOldestSegment();
+    }
+    return true;
+}
+
+void MQTTOutbox::unmapSegment()
+{
+    if (map)
+        munmap((void *)map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+}
+
+size_t MQTTOutbox::replay(size_t maxRecords, const ReplayCallback &cb)
+{
+    size_t consumed = 0;
+    uint32_t now = time(NULL);
+    bool stopped = false;
+    size_t startSegments = segments.size();
+    uint32_t startOffset = readOffset;
+
+    while (consumed < maxRecords && !segments.empty() && !stopped) {
+        // Map the oldest segment once, and again only if it is also the one we append to and it grew since
+        if (!map || (segments.size() == 1 && mapSize < writeOffset)) {
+            unmapSegment();
+            int fd = open(segmentPath(segments.front()).c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                if (fd >= 0)
+                    close(fd);
+                dropOldestSegment();
+                continue;
+            }
+            if (st.st_size > 0) {
+                void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED) {
+                    LOG_ERROR("Can't map MQTT outbox segment: %s\n", strerror(errno));
+                    close(fd);
+                    break;
+                }
+                map = (const uint8_t *)mapped;
+                mapSize = st.st_size;
+            }
+            close(fd); // the mapping stays valid without it
+        }
+
+        while (consumed < maxRecords && readOffset < mapSize) {
+            uint32_t recordLen, recordTime;
+            if (mapSize - readOffset < MQTT_OUTBOX_HEADER_BYTES) {
+                readOffset = mapSize; // Truncated record, e.g. from a crash while writing
+                break;
+            }
+            memcpy(&recordLen, map + readOffset, sizeof(recordLen));
+            memcpy(&recordTime, map + readOffset + 4, sizeof(recordTime));
+            uint8_t topicLen = map[readOffset + 8];
+            if (recordLen < MQTT_OUTBOX_HEADER_BYTES - sizeof(uint32_t) + topicLen ||
+                mapSize - readOffset - sizeof(uint32_t) < recordLen) {
+                readOffset = mapSize;
+                break;
+            }
+
+            if (maxAgeSecs == 0 || now - recordTime <= maxAgeSecs) {
+                char topic[UINT8_MAX + 1];
+                memcpy(topic, map + readOffset + MQTT_OUTBOX_HEADER_BYTES, topicLen);
+                topic[topicLen] = 0;
+                const uint8_t *payload = map + readOffset + MQTT_OUTBOX_HEADER_BYTES + topicLen;
+                size_t payloadLen = recordLen - (MQTT_OUTBOX_HEADER_BYTES - sizeof(uint32_t)) - topicLen;
+                if (!cb(topic, payload, payloadLen)) {
+                    stopped = true;
+                    break;
+                }
+                consumed++;
+            }
+            readOffset += sizeof(uint32_t) + recordLen;
+        }
+
+        // Everything in this segment was sent (or expired), unless it is the one we are still appending to
+        if (readOffset >= mapSize && (segments.size() > 1 || readOffset >= writeOffset))
+            dropOldestSegment();
+        else if (readOffset >= mapSize)
+            break;
+    }
+
+    if (segments.size() != startSegments || readOffset != startOffset)
+        saveCursor();
+    return consumed;
+}
+#endif
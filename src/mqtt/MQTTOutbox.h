@@ -0,0 +1,72 @@
+#pragma once
+
+#include "configuration.h"
+
+#ifdef ARCH_PORTDUINO
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * A disk backed spool for uplink MQTT messages, used while the broker is unreachable.
+ *
+ * Messages are appended to numbered segment files in a directory.  Each record is
+ * [uint32 length][uint32 unix time][uint8 topic length][topic][payload], where length covers everything after itself.
+ * Segments are read back through mmap, each mapped once while it is being replayed, and deleted once fully replayed.  The
+ * position of the oldest unsent record is kept in a small cursor file, so spooled messages survive a restart of meshtasticd.
+ */
+class MQTTOutbox
+{
+  public:
+    /// Called for every replayed record, return false to stop (e.g. because the broker went away again)
+    typedef std::function<bool(const char *topic, const uint8_t *payload, size_t length)> ReplayCallback;
+
+    /**
+     * @param dir directory to keep the segment files in, created if needed
+     * @param maxBytes once the spool grows beyond this, the oldest segments are discarded
+     * @param maxAgeSecs records older than this are discarded instead of replayed (0 to keep forever)
+     */
+    MQTTOutbox(const std::string &dir, uint64_t maxBytes, uint32_t maxAgeSecs);
+
+    ~MQTTOutbox() { unmapSegment(); }
+
+    /// Append a message to the end of the spool, return false if it could not be written
+    bool append(const char *topic, const uint8_t *payload, size_t length);
+
+    /// Replay up to maxRecords of the oldest messages in order, return the number of records consumed
+    size_t replay(size_t maxRecords, const ReplayCallback &cb);
+
+    bool isEmpty() const { return segments.empty(); }
+
+    uint64_t getSpooledBytes() const { return spooledBytes; }
+
+  private:
+    std::string dir;
+    uint64_t maxBytes;
+    uint32_t maxAgeSecs;
+
+    /// Segment numbers currently on disk, oldest first
+    std::vector<uint32_t> segments;
+    /// Read offset within the oldest segment
+    uint32_t readOffset = 0;
+    /// Write offset within the newest segment
+    uint32_t writeOffset = 0;
+    uint64_t spooledBytes = 0;
+
+    /// The oldest segment, mapped for replaying
+    const uint8_t *map = nullptr;
+    size_t mapSize = 0;
+
+    std::string segmentPath(uint32_t segment) const;
+
+    void unmapSegment();
+
+    /// Find the existing segments and cursor from a previous run
+    void load();
+    void saveCursor();
+
+    /// Delete the oldest segment, losing any records left in it
+    void dropOldestSegment();
+};
+#endif
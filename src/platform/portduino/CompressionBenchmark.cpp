@@ -0,0 +1,120 @@
+#include "CompressionBenchmark.h"
+#include "mesh/Router.h"
+#include "mesh/compression/unishox2.h"
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+#define COMPRESSION_BENCHMARK_RUNS 1000
+#define COMPRESSION_BENCHMARK_RANDOM 10000
+
+/// Chat, status reports, coordinates, a URL, a small JSON blob, emoji and some non-English text
+static const char *corpus[] = {
+    "ok",
+    "Yes",
+    "On my way",
+    "Copy that",
+    "test",
+    "Testing 1 2 3",
+    "Good morning everyone!",
+    "Anyone on the mesh tonight?",
+    "Heading to the trailhead now, should be there in 20 minutes",
+    "I'm at the north parking lot, blue truck",
+    "Signal is weak here, moving up the ridge",
+    "Can you hear me? Reply if you get this.",
+    "Battery at 40%, switching to power save",
+    "Meet at the summit at 14:30",
+    "Roger, will relay to base",
+    "Lost GPS fix, last known position near the lake",
+    "Weather turning bad, clouds rolling in from the west. Suggest we head back.",
+    "Node 7 is back online after the firmware update",
+    "Thanks for the help today!",
+    "Where is everyone? I'm at camp 2.",
+    "Checking in from the fire lookout, all clear.",
+    "Need water resupply at checkpoint 3, about 10 liters",
+    "Packet received, SNR -12.5 RSSI -118",
+    "Hello from Berlin! Greetings to the mesh.",
+    "Does anyone have a spare 18650 cell?",
+    "The road is closed past mile marker 42, take the detour via Old Mill Rd",
+    "ETA 15 min",
+    "Stay safe out there",
+    "Arrived home safely, good night all",
+    "Setting up a solar repeater on the hill this weekend, any volunteers?",
+    "Radio check: loud and clear",
+    "Traffic is heavy on highway 1, expect delays",
+    "Happy birthday Sam!! \xF0\x9F\x8E\x89",
+    "\xC2\xBF"
+    "Alguien me escucha? Estoy en la caba\xC3\xB1"
+    "a.",
+    "Ich bin gleich da, warte kurz",
+    "{\"temp\":21.5,\"hum\":48,\"bat\":3.92}",
+    "https://meshtastic.org/docs/getting-started",
+    "QTH grid FN31pr, running 1W on LongFast",
+    "N 47.6062 W 122.3321",
+    "lol",
+    "\xF0\x9F\x91\x8D",
+};
+
+static void setText(meshtastic_Data &d, const char *text)
+{
+    memset(&d, 0, sizeof(d));
+    d.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
+    d.payload.size = strlen(text);
+    memcpy(d.payload.bytes, text, d.payload.size);
+}
+
+void runCompressionBenchmark()
+{
+    size_t count = sizeof(corpus) / sizeof(corpus[0]), compressed = 0, bytesIn = 0, bytesOut = 0, failed = 0;
+    double compressMicros = 0, decompressMicros = 0;
+    meshtastic_Data d;
+
+    for (auto text : corpus) {
+        setText(d, text);
+        bytesIn += d.payload.size;
+        perhapsCompress(&d);
+        bytesOut += d.payload.size;
+        if (d.portnum != meshtastic_PortNum_TEXT_MESSAGE_COMPRESSED_APP)
+            continue;
+        compressed++;
+        if (!perhapsDecompress(&d) || d.payload.size != strlen(text) || memcmp(d.payload.bytes, text, d.payload.size)) {
+            printf("Doesn't round-trip: %s\n", text);
+            failed++;
+        }
+    }
+
+    for (int run = 0; run < COMPRESSION_BENCHMARK_RUNS; run++) {
+        for (auto text : corpus) {
+            setText(d, text);
+            auto start = std::chrono::steady_clock::now();
+            perhapsCompress(&d);
+            auto middle = std::chrono::steady_clock::now();
+            if (d.portnum == meshtastic_PortNum_TEXT_MESSAGE_COMPRESSED_APP)
+                perhapsDecompress(&d);
+            auto end = std::chrono::steady_clock::now();
+            compressMicros += std::chrono::duration<double, std::micro>(middle - start).count();
+            decompressMicros += std::chrono::duration<double, std::micro>(end - middle).count();
+        }
+    }
+
+    // A corrupt or hostile payload must not decompress past the end of the buffer
+    std::mt19937 rng(1);
+    char junk[meshtastic_Constants_DATA_PAYLOAD_LEN], out[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    size_t overflowing = 0;
+    for (int i = 0; i < COMPRESSION_BENCHMARK_RANDOM; i++) {
+        for (auto &c : junk)
+            c = (char)rng();
+        if (unishox2_decompress_simple_olen(junk, sizeof(junk), out, sizeof(out)) > (int)sizeof(out))
+            overflowing++;
+    }
+
+    printf("%u messages, %u compressed, %u failed to round-trip\n", (unsigned)count, (unsigned)compressed, (unsigned)failed);
+    printf("Payload bytes: %u -> %u (%.1f%% saved)\n", (unsigned)bytesIn, (unsigned)bytesOut,
+           100.0 * (bytesIn - bytesOut) / bytesIn);
+    printf("Compress %.2f us, decompress %.2f us per message\n", compressMicros / (COMPRESSION_BENCHMARK_RUNS * count),
+           decompressMicros / (COMPRESSION_BENCHMARK_RUNS * compressed));
+    printf("%u of %u random %u-byte payloads would overflow an unbounded decompressor\n", (unsigned)overflowing,
+           COMPRESSION_BENCHMARK_RANDOM, (unsigned)sizeof(junk));
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+/**
+ * Compress a corpus of typical mesh text messages the way perhapsEncode() does, check they round-trip, check the bounded
+ * decompressor on random payloads, and print a report.  Run with --compress-bench.
+ */
+void runCompressionBenchmark();
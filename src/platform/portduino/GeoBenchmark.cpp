@@ -0,0 +1,85 @@
+#include "GeoBenchmark.h"
+#include "gps/GeoCoord.h"
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#define GEO_BENCHMARK_PAIRS 200000
+
+/// Below this distance the rounding of latLongToMeter() itself dominates, so relative errors aren't meaningful
+#define GEO_BENCHMARK_MIN_METERS 100
+
+struct GeoPair {
+    int32_t lat1, lon1, lat2, lon2;
+};
+
+/// Point b at a distance and initial bearing (radians) from a, on the same sphere as latLongToMeter()
+static GeoPair makePair(double lat, double lon, double bearing, double meters)
+{
+    double d = meters / 6366000, lat1 = toRadians(lat), lon1 = toRadians(lon);
+    double lat2 = asin(sin(lat1) * cos(d) + cos(lat1) * sin(d) * cos(bearing));
+    double lon2 = lon1 + atan2(sin(bearing) * sin(d) * cos(lat1), cos(d) - sin(lat1) * sin(lat2));
+    double lon2Deg = fmod(toDegrees(lon2) + 540, 360) - 180;
+    return {(int32_t)lround(lat * 1e7), (int32_t)lround(lon * 1e7), (int32_t)lround(toDegrees(lat2) * 1e7),
+            (int32_t)lround(lon2Deg * 1e7)};
+}
+
+template <typename F> static double nanosPerCall(const std::vector<GeoPair> &pairs, F f)
+{
+    volatile float sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto &p : pairs)
+        sink = sink + f(p);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / pairs.size();
+}
+
+void runGeoBenchmark()
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> latitude(-GEO_FAST_MAX_LATITUDE, GEO_FAST_MAX_LATITUDE), longitude(-180, 180),
+        bearing(-PI, PI), meters(0, GEO_FAST_MAX_METERS / 1.5); // so east and north both stay within the limit
+
+    std::vector<GeoPair> pairs;
+    for (int i = 0; i < GEO_BENCHMARK_PAIRS; i++)
+        pairs.push_back(makePair(latitude(rng), longitude(rng), bearing(rng), meters(rng)));
+
+    double maxMeters = 0, maxRelative = 0, sumRelative = 0, maxDegrees = 0;
+    size_t counted = 0;
+    for (auto &p : pairs) {
+        double exact = GeoCoord::latLongToMeter(p.lat1 * 1e-7, p.lon1 * 1e-7, p.lat2 * 1e-7, p.lon2 * 1e-7);
+        double fast = GeoCoord::latLongToMeterFast(p.lat1, p.lon1, p.lat2, p.lon2);
+        maxMeters = std::max(maxMeters, fabs(fast - exact));
+        if (exact < GEO_BENCHMARK_MIN_METERS)
+            continue;
+        double relative = fabs(fast - exact) / exact;
+        maxRelative = std::max(maxRelative, relative);
+        sumRelative += relative;
+        counted++;
+
+        double b = GeoCoord::bearing(p.lat1 * 1e-7, p.lon1 * 1e-7, p.lat2 * 1e-7, p.lon2 * 1e-7);
+        double diff = fabs(GeoCoord::bearingFast(p.lat1, p.lon1, p.lat2, p.lon2) - b);
+        maxDegrees = std::max(maxDegrees, toDegrees(std::min(diff, 2 * PI - diff)));
+    }
+
+    printf("%u pairs of points up to %.0f m apart, between latitudes -%d and %d\n", (unsigned)pairs.size(),
+           GEO_FAST_MAX_METERS / 1.5, GEO_FAST_MAX_LATITUDE, GEO_FAST_MAX_LATITUDE);
+    printf("Distance error: max %.2f m, max %.4f%% and mean %.4f%% over %u m\n", maxMeters, maxRelative * 100,
+           counted ? sumRelative * 100 / counted : 0, GEO_BENCHMARK_MIN_METERS);
+    printf("Bearing error: max %.3f degrees over %u m\n", maxDegrees, GEO_BENCHMARK_MIN_METERS);
+
+    double exactDistance = nanosPerCall(pairs, [](const GeoPair &p) {
+        return GeoCoord::latLongToMeter(p.lat1 * 1e-7, p.lon1 * 1e-7, p.lat2 * 1e-7, p.lon2 * 1e-7);
+    });
+    double fastDistance =
+        nanosPerCall(pairs, [](const GeoPair &p) { return GeoCoord::latLongToMeterFast(p.lat1, p.lon1, p.lat2, p.lon2); });
+    double exactBearing = nanosPerCall(
+        pairs, [](const GeoPair &p) { return GeoCoord::bearing(p.lat1 * 1e-7, p.lon1 * 1e-7, p.lat2 * 1e-7, p.lon2 * 1e-7); });
+    double fastBearing =
+        nanosPerCall(pairs, [](const GeoPair &p) { return GeoCoord::bearingFast(p.lat1, p.lon1, p.lat2, p.lon2); });
+    printf("Distance: exact %.1f ns, fast %.1f ns per call (%.1fx)\n", exactDistance, fastDistance,
+           exactDistance / fastDistance);
+    printf("Bearing: exact %.1f ns, fast %.1f ns per call (%.1fx)\n", exactBearing, fastBearing, exactBearing / fastBearing);
+}
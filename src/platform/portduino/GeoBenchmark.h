@@ -0,0 +1,7 @@
+#pragma once
+
+/**
+ * Compare the accuracy and speed of GeoCoord's fast distance and bearing with the exact ones, on random pairs of points up to
+ * GEO_FAST_MAX_METERS apart, and print a report.  Run with --geo-bench.
+ */
+void runGeoBenchmark();
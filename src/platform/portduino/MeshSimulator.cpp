@@ -0,0 +1,658 @@
+#include "MeshSimulator.h"
+#include "PortduinoGlue.h"
+#include "configuration.h"
+#include "mesh-pb-constants.h"
+
+#include "yaml-cpp/yaml.h"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+
+/// Interfering signals this far below the demodulation floor are ignored entirely
+#define SIM_INTERFERENCE_MARGIN_DB 10
+
+/// Encrypted size of a routing ACK (portnum, empty Routing payload and request_id)
+#define SIM_ACK_PAYLOAD_BYTES 12
+
+/// Same as ReliableRouter, the first transmission plus two retransmissions
+#define SIM_NUM_RETRANSMISSIONS 2
+
+/// How many neighbors a NeighborInfo packet lists (MAX_NUM_NEIGHBORS)
+#define SIM_ANNOUNCED_NEIGHBORS 10
+
+/// COVERAGE_COLOCATED_SNR
+#define SIM_COLOCATED_SNR 10
+
+template <typename T> static T getSetting(const YAML::Node &section, const char *key, T fallback)
+{
+    if (section && section[key])
+        return section[key].as<T>(fallback);
+    return fallback;
+}
+
+static meshtastic_Config_DeviceConfig_Role parseRole(const std::string &name)
+{
+    if (name == "ROUTER")
+        return meshtastic_Config_DeviceConfig_Role_ROUTER;
+    if (name == "ROUTER_CLIENT")
+        return meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT;
+    if (name == "REPEATER")
+        return meshtastic_Config_DeviceConfig_Role_REPEATER;
+    if (name == "CLIENT_MUTE")
+        return meshtastic_Config_DeviceConfig_Role_CLIENT_MUTE;
+    return meshtastic_Config_DeviceConfig_Role_CLIENT;
+}
+
+static bool isRouterRole(meshtastic_Config_DeviceConfig_Role role)
+{
+    return role == meshtastic_Config_DeviceConfig_Role_ROUTER || role == meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT ||
+           role == meshtastic_Config_DeviceConfig_Role_REPEATER;
+}
+
+/// A PacketHistory on the simulation's virtual clock, so its records expire as they would on a real node
+class SimPacketHistory : public PacketHistory
+{
+    const uint64_t &now;
+
+  public:
+    explicit SimPacketHistory(const uint64_t &now) : now(now) {}
+
+  protected:
+    virtual uint32_t getTimeMsec() override { return (uint32_t)now; }
+};
+
+MeshSimulator::Modem::Modem(float bandwidth, uint8_t spreadFactor, uint8_t codingRate)
+{
+    bw = bandwidth;
+    sf = spreadFactor;
+    cr = codingRate;
+    slotTimeMsec = 8.5 * pow(2, sf) / bw + 0.2 + 0.4 + 7;
+    computePacketTimeTable();
+}
+
+ErrorCode MeshSimulator::Modem::send(meshtastic_MeshPacket *p)
+{
+    packetPool.release(p);
+    return ERRNO_DISABLED;
+}
+
+uint32_t MeshSimulator::getSendDelayMsec(const Node &n)
+{
+    // The simulator doesn't track channel utilization, the adaptive window has its own view of the load
+    return n.contention->getTxDelayMsec(0, modem->getSlotTimeMsec());
+}
+
+uint32_t MeshSimulator::getFloodDelayMsec(const Node &n, float snr)
+{
+    return n.contention->getTxDelayMsecWeighted(0, snr, isRouterRole(n.role), modem->getSlotTimeMsec());
+}
+
+void MeshSimulator::Frame::toPacket(meshtastic_MeshPacket &p) const
+{
+    p = meshtastic_MeshPacket_init_zero;
+    p.from = from;
+    p.to = to;
+    p.id = id;
+    p.hop_limit = hopLimit;
+    p.which_payload_variant = meshtastic_MeshPacket_encrypted_tag;
+    p.encrypted.size = length - sizeof(PacketHeader);
+}
+
+MeshSimulator::MeshSimulator() {}
+
+bool MeshSimulator::loadScenario(const char *path)
+{
+    YAML::Node scenario;
+    try {
+        scenario = YAML::LoadFile(path);
+    } catch (YAML::Exception &e) {
+        std::cout << "Could not open " << path << " because of error: " << e.what() << std::endl;
+        return false;
+    }
+
+    try {
+        const YAML::Node sim = scenario["Simulation"];
+        seed = getSetting<uint32_t>(sim, "Seed", seed);
+        durationMsec = getSetting<uint64_t>(sim, "DurationSecs", durationMsec / 1000) * 1000;
+        numNodes = getSetting<uint32_t>(sim, "Nodes", numNodes);
+        areaMeters = getSetting<float>(sim, "AreaMeters", areaMeters);
+        routerFraction = getSetting<float>(sim, "RouterFraction", routerFraction);
+        hopLimit = getSetting<uint32_t>(sim, "HopLimit", hopLimit);
+        messagesPerMinute = getSetting<float>(sim, "MessagesPerMinute", messagesPerMinute);
+        unicastFraction = getSetting<float>(sim, "UnicastFraction", unicastFraction);
+        payloadBytes = std::min<uint32_t>(getSetting<uint32_t>(sim, "PayloadBytes", payloadBytes),
+                                          MAX_RHPACKETLEN - sizeof(PacketHeader));
+        nextHopRouting = getSetting<bool>(sim, "NextHopRouting", nextHopRouting);
+        adaptiveContentionWindow = getSetting<std::string>(sim, "ContentionWindow", "fixed") == "adaptive";
+        coverageSuppression = getSetting<bool>(sim, "CoverageSuppression", coverageSuppression);
+        reportPath = getSetting<std::string>(sim, "ReportPath", reportPath);
+
+        const YAML::Node radio = scenario["Radio"];
+        float bandwidth = getSetting<float>(radio, "Bandwidth", 250);
+        uint8_t spreadFactor = getSetting<uint32_t>(radio, "SpreadFactor", 11);
+        uint8_t codingRate = getSetting<uint32_t>(radio, "CodingRate", 5);
+        txPowerDbm = getSetting<float>(radio, "TxPowerDbm", txPowerDbm);
+        referenceLossDb = getSetting<float>(radio, "ReferenceLossDb", referenceLossDb);
+        pathLossExponent = getSetting<float>(radio, "PathLossExponent", pathLossExponent);
+        shadowingSigmaDb = getSetting<float>(radio, "ShadowingSigmaDb", shadowingSigmaDb);
+        noiseFloorDbm = getSetting<float>(radio, "NoiseFloorDbm", noiseFloorDbm);
+        captureThresholdDb = getSetting<float>(radio, "CaptureThresholdDb", captureThresholdDb);
+
+        modem.reset(new Modem(bandwidth, spreadFactor, codingRate));
+        // Semtech's demodulation limit is -7.5 dB at SF7, and 2.5 dB lower for every step in spreading factor
+        snrFloor = -7.5f - 2.5f * (spreadFactor - 7);
+
+        rng.seed(seed);
+        randomSeed(seed); // the contention delays in RadioInterface use random()
+
+        const YAML::Node nodeList = scenario["NodeList"];
+        if (nodeList && nodeList.IsSequence())
+            numNodes = nodeList.size();
+
+        std::uniform_real_distribution<float> coord(0, areaMeters);
+        std::uniform_real_distribution<float> unit(0, 1);
+        nodes.resize(numNodes);
+        for (uint32_t i = 0; i < numNodes; i++) {
+            Node &n = nodes[i];
+            n.num = i + 1;
+            n.history.reset(new SimPacketHistory(now));
+            if (adaptiveContentionWindow)
+                n.contention.reset(new AdaptiveContentionWindow());
+            else
+                n.contention.reset(new FixedContentionWindow());
+            if (nodeList && nodeList.IsSequence()) {
+                n.x = getSetting<float>(nodeList[i], "X", 0);
+                n.y = getSetting<float>(nodeList[i], "Y", 0);
+                n.role = parseRole(getSetting<std::string>(nodeList[i], "Role", "CLIENT"));
+            } else {
+                n.x = coord(rng);
+                n.y = coord(rng);
+                n.role = unit(rng) < routerFraction ? meshtastic_Config_DeviceConfig_Role_ROUTER
+                                                    : meshtastic_Config_DeviceConfig_Role_CLIENT;
+            }
+        }
+    } catch (YAML::Exception &e) {
+        std::cout << "Invalid simulation scenario " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    if (numNodes < 2) {
+        std::cout << "A simulation needs at least two nodes" << std::endl;
+        return false;
+    }
+
+    buildLinks();
+    return true;
+}
+
+void MeshSimulator::buildLinks()
+{
+    std::normal_distribution<float> shadowing(0, shadowingSigmaDb);
+
+    for (uint32_t i = 0; i < numNodes; i++) {
+        for (uint32_t j = i + 1; j < numNodes; j++) {
+            float dx = nodes[i].x - nodes[j].x, dy = nodes[i].y - nodes[j].y;
+            float distance = std::max(1.0f, sqrtf(dx * dx + dy * dy));
+            // Shadowing is drawn once per pair, so links are symmetric and stable for the whole run
+            float loss = referenceLossDb + 10 * pathLossExponent * log10f(distance) + shadowing(rng);
+            float rssi = txPowerDbm - loss;
+            float snr = rssi - noiseFloorDbm;
+            if (snr < snrFloor - SIM_INTERFERENCE_MARGIN_DB)
+                continue;
+
+            bool decodable = snr >= snrFloor;
+            nodes[i].links.push_back({j, rssi, snr, decodable});
+            nodes[j].links.push_back({i, rssi, snr, decodable});
+        }
+    }
+
+    size_t neighbors = 0;
+    for (auto &n : nodes) {
+        std::vector<Link> heard;
+        for (auto &l : n.links)
+            if (l.decodable)
+                heard.push_back(l);
+        n.contention->setNeighborCount(heard.size()); // what NodeDB would tell the radio after a while
+        neighbors += heard.size();
+
+        std::sort(heard.begin(), heard.end(), [](const Link &a, const Link &b) { return a.snr > b.snr; });
+        for (size_t i = 0; i < heard.size() && i < SIM_ANNOUNCED_NEIGHBORS; i++)
+            n.announced.push_back(heard[i].to);
+    }
+    LOG_INFO("Simulating %u nodes with %.1f neighbors on average\n", numNodes, (float)neighbors / numNodes);
+}
+
+void MeshSimulator::schedule(uint64_t timeMsec, EventType type, uint32_t node, uint32_t arg)
+{
+    events.push({timeMsec, nextSeq++, type, node, arg});
+}
+
+void MeshSimulator::run()
+{
+    // Messages arrive as a Poisson process over the whole mesh
+    std::exponential_distribution<double> interArrival(messagesPerMinute / 60000.0);
+    if (messagesPerMinute > 0)
+        schedule((uint64_t)interArrival(rng), EVENT_GENERATE, 0);
+
+    while (!events.empty()) {
+        Event e = events.top();
+        events.pop();
+        now = e.timeMsec;
+
+        switch (e.type) {
+        case EVENT_GENERATE:
+            if (now >= durationMsec)
+                break; // stop generating, but let the floods already in flight finish
+            generateMessage();
+            schedule(now + 1 + (uint64_t)interArrival(rng), EVENT_GENERATE, 0);
+            break;
+        case EVENT_TX_TIMER:
+            onTxTimer(e.node, e.arg);
+            break;
+        case EVENT_RX_END:
+            onRxEnd(e.node, e.arg);
+            break;
+        case EVENT_RETRANSMIT:
+            onRetransmit(e.arg);
+            break;
+        }
+    }
+}
+
+void MeshSimulator::generateMessage()
+{
+    std::uniform_int_distribution<uint32_t> pickNode(0, numNodes - 1);
+    std::uniform_real_distribution<float> unit(0, 1);
+
+    Message m;
+    m.origin = pickNode(rng);
+    m.to = NODENUM_BROADCAST;
+    if (unit(rng) < unicastFraction) {
+        uint32_t dest;
+        do {
+            dest = pickNode(rng);
+        } while (dest == m.origin);
+        m.to = nodes[dest].num;
+    }
+    m.frame = {nodes[m.origin].num, m.to, nextPacketId++, hopLimit, (uint8_t)(payloadBytes + sizeof(PacketHeader))};
+    m.createdMsec = now;
+    m.seenBy.assign(numNodes, false);
+    m.seenBy[m.origin] = true;
+    messages.push_back(m);
+    uint32_t message = messages.size() - 1;
+
+    meshtastic_MeshPacket p;
+    m.frame.toPacket(p);
+
+    Node &n = nodes[m.origin];
+    n.originated++;
+    n.history->wasSeenRecently(&p); // like FloodingRouter::send(), so we ignore our own packet coming back
+    uint32_t delay = getSendDelayMsec(n);
+    enqueueTx(m.origin, message, m.frame, delay);
+
+    // Direct messages are sent with want_ack
+    if (m.to != NODENUM_BROADCAST) {
+        messages[message].awaitingAck = true;
+        messages[message].retransmissionsLeft = SIM_NUM_RETRANSMISSIONS;
+        scheduleRetransmit(message, delay + modem->getRetransmissionMsec(&p));
+    }
+}
+
+void MeshSimulator::onRetransmit(uint32_t message)
+{
+    Message &m = messages[message];
+    if (!m.awaitingAck || now != m.retransmitMsec)
+        return; // acked, or rescheduled
+    Node &n = nodes[m.origin];
+    n.contention->onAckResult(false);
+    if (m.retransmissionsLeft == 0) {
+        m.awaitingAck = false; // ReliableRouter would report a MAX_RETRANSMIT nak now
+        return;
+    }
+    m.retransmissionsLeft--;
+
+    // NextHopRouter::fallBackToFlooding(), the retransmission floods
+    n.nextHops.forget(m.to);
+
+    meshtastic_MeshPacket p;
+    m.frame.toPacket(p);
+    uint32_t delay = getSendDelayMsec(n);
+    enqueueTx(m.origin, message, m.frame, delay);
+    scheduleRetransmit(message, delay + modem->getRetransmissionMsec(&p));
+}
+
+void MeshSimulator::scheduleRetransmit(uint32_t message, uint32_t delayMsec)
+{
+    Message &m = messages[message];
+    m.retransmitMsec = now + delayMsec;
+    schedule(m.retransmitMsec, EVENT_RETRANSMIT, m.origin, message);
+}
+
+uint8_t MeshSimulator::chooseNextHop(const Node &n, const Frame &f) const
+{
+    if (!nextHopRouting || f.to == NODENUM_BROADCAST || n.floodedRelays.contains(f.from, f.id))
+        return NO_NEXT_HOP_PREFERENCE;
+    return n.nextHops.get(f.to, now);
+}
+
+void MeshSimulator::enqueueTx(uint32_t node, uint32_t message, const Frame &f, uint32_t delayMsec)
+{
+    uint32_t token = nextToken++;
+    nodes[node].txQueue.push_back({token, message, f, {}});
+    schedule(now + delayMsec, EVENT_TX_TIMER, node, token);
+}
+
+bool MeshSimulator::cancelTx(uint32_t node, NodeNum from, PacketId id)
+{
+    auto &queue = nodes[node].txQueue;
+    for (auto it = queue.begin(); it != queue.end(); ++it) {
+        if (it->frame.from == from && it->frame.id == id) {
+            queue.erase(it); // the timer event stays queued, but won't find its token anymore
+            nodes[node].cancelled++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MeshSimulator::isChannelBusy(const Node &n) const
+{
+    if (n.txUntil > now)
+        return true;
+    for (auto &r : n.receptions)
+        if (r.decodable)
+            return true;
+    return false;
+}
+
+void MeshSimulator::onTxTimer(uint32_t node, uint32_t token)
+{
+    Node &n = nodes[node];
+    auto it = std::find_if(n.txQueue.begin(), n.txQueue.end(), [token](const PendingTx &t) { return t.token == token; });
+    if (it == n.txQueue.end())
+        return; // cancelled
+
+    if (isChannelBusy(n)) {
+        // Like RadioLibInterface, just try again a little later
+        schedule(now + getSendDelayMsec(n), EVENT_TX_TIMER, node, token);
+        return;
+    }
+
+    Transmission t = {node, it->message, it->frame};
+    n.txQueue.erase(it);
+    // Like RadioInterface::beginSending()
+    t.frame.nextHop = chooseNextHop(n, t.frame);
+    t.frame.relayNode = n.num & 0xff;
+    messages[t.message].transmissions++;
+    transmissions.push_back(t);
+    uint32_t index = transmissions.size() - 1;
+
+    uint32_t airtime = modem->getPacketTime(t.frame.length);
+    n.txUntil = now + airtime;
+    n.transmitted++;
+    n.airtimeMsec += airtime;
+    // We can't hear anything while transmitting
+    for (auto &r : n.receptions)
+        r.corrupted = true;
+
+    for (auto &l : n.links) {
+        Node &rx = nodes[l.to];
+        if (rx.txUntil > now)
+            continue; // half duplex
+
+        Reception incoming = {index, l.rssi, l.snr, l.decodable, false};
+        for (auto &r : rx.receptions) {
+            // Whichever signal is stronger by the capture threshold survives the overlap, otherwise both are lost
+            if (incoming.rssi < r.rssi + captureThresholdDb)
+                incoming.corrupted = true;
+            if (r.rssi < incoming.rssi + captureThresholdDb)
+                r.corrupted = true;
+        }
+        rx.receptions.push_back(incoming);
+        schedule(n.txUntil, EVENT_RX_END, l.to, index);
+    }
+}
+
+void MeshSimulator::onRxEnd(uint32_t node, uint32_t transmission)
+{
+    Node &n = nodes[node];
+    auto it = std::find_if(n.receptions.begin(), n.receptions.end(),
+                           [transmission](const Reception &r) { return r.transmission == transmission; });
+    if (it == n.receptions.end())
+        return;
+
+    Reception r = *it;
+    n.receptions.erase(it);
+    if (!r.decodable)
+        return;
+    if (r.corrupted) {
+        n.rxCollided++;
+        n.contention->onFrameReceived(false);
+        return;
+    }
+
+    n.rxGood++;
+    n.contention->onFrameReceived(true);
+    handleReceived(node, transmissions[transmission], r.snr);
+}
+
+void MeshSimulator::handleReceived(uint32_t node, const Transmission &t, float snr)
+{
+    Node &n = nodes[node];
+    const Frame &f = t.frame;
+    Message &m = messages[t.message];
+    meshtastic_MeshPacket p;
+    f.toPacket(p);
+
+    // ReliableRouter::shouldFilterReceived(), someone relaying our own message is an implicit ack, unless it is the next hop
+    // of a directed message, then we wait for the real ack a while longer
+    if (f.from == n.num && f.requestId == 0 && m.awaitingAck) {
+        if (f.to != NODENUM_BROADCAST && chooseNextHop(n, m.frame) != NO_NEXT_HOP_PREFERENCE) {
+            scheduleRetransmit(t.message, modem->getRetransmissionMsec(&p) * (f.hopLimit + 1));
+        } else {
+            m.awaitingAck = false;
+            n.contention->onAckResult(true);
+        }
+    }
+
+    // NextHopRouter::shouldFilterReceived(), a flood of a packet we held back our relay for must be relayed after all
+    bool fallbackFlood = nextHopRouting && f.to != NODENUM_BROADCAST && f.nextHop == NO_NEXT_HOP_PREFERENCE &&
+                         n.skippedRelays.take(f.from, f.id);
+    // Also there, a flood of a directed packet we relayed means our next hop didn't get it through
+    if (nextHopRouting && !fallbackFlood && f.to != NODENUM_BROADCAST && f.nextHop == NO_NEXT_HOP_PREFERENCE &&
+        n.relayed.contains(f.from, f.id) && !n.floodedRelays.contains(f.from, f.id)) {
+        n.floodedRelays.add(f.from, f.id);
+        n.nextHops.forget(f.to);
+    }
+    if (fallbackFlood) {
+        n.floodedRelays.add(f.from, f.id);
+    } else if (n.history->wasSeenRecently(&p)) {
+        // FloodingRouter::shouldFilterReceived()
+        n.duplicates++;
+        n.contention->onPacketHeard(true);
+        auto pending = std::find_if(n.txQueue.begin(), n.txQueue.end(),
+                                    [&f](const PendingTx &tx) { return tx.frame.from == f.from && tx.frame.id == f.id; });
+        bool covered = false;
+        if (coverageSuppression && pending != n.txQueue.end() && !pending->relayers.empty()) {
+            if (std::find(pending->relayers.begin(), pending->relayers.end(), t.sender) == pending->relayers.end())
+                pending->relayers.push_back(t.sender);
+            covered = isCovered(node, pending->relayers);
+        }
+        if (covered || !isRouterRole(n.role))
+            cancelTx(node, f.from, f.id);
+        // ReliableRouter resends the implicit ack when the origin repeats a packet we relayed already
+        bool isRepeated = f.hopLimit == hopLimit && f.from != n.num && f.to != n.num;
+        if (isRepeated && f.requestId == 0 && m.awaitingAck && !n.skippedRelays.contains(f.from, f.id)) {
+            Frame tosend = f;
+            tosend.hopLimit--;
+            enqueueTx(node, t.message, tosend, getSendDelayMsec(n));
+        }
+        return;
+    }
+
+    n.contention->onPacketHeard(false);
+    if (f.requestId != 0) {
+        if (f.to == n.num && !m.acked) {
+            m.acked = true;
+            if (m.awaitingAck)
+                n.contention->onAckResult(true);
+            m.awaitingAck = false;
+        }
+    } else if (!m.seenBy[node]) {
+        m.seenBy[node] = true;
+        m.reached++;
+        m.latencySum += now - m.createdMsec;
+        if (f.to == n.num) {
+            m.delivered = true;
+            m.latencyMsec = now - m.createdMsec;
+        }
+    }
+
+    // NextHopRouter::sniffReceived(), learn from packets heard directly and from replies
+    if (nextHopRouting && f.relayNode != 0 && f.from != n.num) {
+        bool heardDirectly = f.hopLimit == hopLimit;
+        bool isReply = f.requestId != 0 && (f.to == n.num || n.relayed.contains(f.to, f.requestId));
+        if (heardDirectly || isReply)
+            n.nextHops.learn(f.from, f.relayNode, now);
+    }
+
+    // ReliableRouter::sniffReceived(), ack a direct message
+    if (f.to == n.num && f.requestId == 0) {
+        Frame ack = {n.num, f.from, nextPacketId++, hopLimit, (uint8_t)(SIM_ACK_PAYLOAD_BYTES + sizeof(PacketHeader))};
+        ack.requestId = f.id;
+        meshtastic_MeshPacket ackPacket;
+        ack.toPacket(ackPacket);
+        n.history->wasSeenRecently(&ackPacket);
+        enqueueTx(node, t.message, ack, getSendDelayMsec(n));
+    }
+
+    // FloodingRouter::sniffReceived()
+    if (f.to != n.num && f.hopLimit > 0 && f.from != n.num && n.role != meshtastic_Config_DeviceConfig_Role_CLIENT_MUTE) {
+        if (nextHopRouting && f.to != NODENUM_BROADCAST && f.nextHop != NO_NEXT_HOP_PREFERENCE &&
+            f.nextHop != (n.num & 0xff)) {
+            // NextHopRouter::shouldRelay(), another node is the next hop
+            n.skippedRelays.add(f.from, f.id);
+            n.skipped++;
+        } else {
+            Frame tosend = f;
+            tosend.hopLimit--;
+            enqueueTx(node, t.message, tosend, getFloodDelayMsec(n, snr));
+            n.txQueue.back().relayers.push_back(t.sender);
+            n.relayed.add(f.from, f.id);
+        }
+    }
+}
+
+bool MeshSimulator::isCovered(uint32_t node, const std::vector<uint32_t> &relayers) const
+{
+    const Node &n = nodes[node];
+    // Relayers are only known by the last byte of their node number, which two of our neighbors may share
+    for (auto r : relayers) {
+        uint8_t lastByte = nodes[r].num & 0xff;
+        if (std::count_if(n.links.begin(), n.links.end(), [&](const Link &l) {
+                return l.decodable && (nodes[l.to].num & 0xff) == lastByte;
+            }) > 1)
+            return false;
+    }
+
+    // Routers don't take a strong relayer's word for it, see NeighborInfoModule::getCoverage()
+    for (auto r : relayers)
+        for (auto &l : n.links)
+            if (!isRouterRole(n.role) && l.to == r && l.snr >= SIM_COLOCATED_SNR)
+                return true;
+
+    for (auto neighbor : n.announced) {
+        bool covered = false;
+        for (auto r : relayers) {
+            const auto &reached = nodes[r].announced;
+            covered |= neighbor == r || std::find(reached.begin(), reached.end(), neighbor) != reached.end();
+        }
+        if (!covered)
+            return false;
+    }
+    return true;
+}
+
+void MeshSimulator::printReport()
+{
+    uint32_t broadcasts = 0, unicasts = 0, delivered = 0, reached = 0, acked = 0, unicastTransmissions = 0;
+    double broadcastCoverage = 0;
+    uint64_t broadcastLatency = 0;
+    std::vector<uint64_t> latencies;
+    for (auto &m : messages) {
+        if (m.to == NODENUM_BROADCAST) {
+            broadcasts++;
+            broadcastCoverage += (double)m.reached / (numNodes - 1);
+            broadcastLatency += m.latencySum;
+            reached += m.reached;
+        } else {
+            unicasts++;
+            acked += m.acked;
+            unicastTransmissions += m.transmissions;
+            if (m.delivered) {
+                delivered++;
+                latencies.push_back(m.latencyMsec);
+            }
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    uint64_t airtime = 0;
+    uint32_t transmitted = 0, collided = 0, duplicates = 0, cancelled = 0, skipped = 0;
+    for (auto &n : nodes) {
+        airtime += n.airtimeMsec;
+        transmitted += n.transmitted;
+        collided += n.rxCollided;
+        duplicates += n.duplicates;
+        cancelled += n.cancelled;
+        skipped += n.skipped;
+    }
+
+    printf("Simulated %.1f minutes of a %u node mesh (seed %u), %s routing, %s contention window\n", now / 60000.0, numNodes,
+           seed, nextHopRouting ? "next hop" : "flooding", nodes[0].contention->getName());
+    printf("Messages: %u broadcast, %u unicast\n", broadcasts, unicasts);
+    if (broadcasts)
+        printf("Broadcast coverage: %.1f%%, mean latency %llu ms\n", 100 * broadcastCoverage / broadcasts,
+               (unsigned long long)(reached ? broadcastLatency / reached : 0));
+    if (unicasts)
+        printf("Unicast delivery ratio: %.1f%%, ACK ratio %.1f%%, %.1f transmissions per unicast (including ACKs)\n",
+               100.0 * delivered / unicasts, 100.0 * acked / unicasts, (double)unicastTransmissions / unicasts);
+    if (!latencies.empty())
+        printf("Unicast latency: median %llu ms, 95th percentile %llu ms\n",
+               (unsigned long long)latencies[latencies.size() / 2], (unsigned long long)latencies[latencies.size() * 95 / 100]);
+    printf("Transmissions: %u (%.1f per message), %llu ms total airtime\n", transmitted,
+           messages.empty() ? 0.0 : (double)transmitted / messages.size(), (unsigned long long)airtime);
+    printf("Receptions lost to collisions: %u, duplicates heard: %u, rebroadcasts cancelled: %u\n", collided, duplicates,
+           cancelled);
+    if (nextHopRouting)
+        printf("Relays skipped because another node was the next hop: %u\n", skipped);
+
+    if (reportPath.empty())
+        return;
+    FILE *f = fopen(reportPath.c_str(), "w");
+    if (!f) {
+        printf("Can't write simulation report %s\n", reportPath.c_str());
+        return;
+    }
+    fprintf(f, "node,x,y,role,originated,transmitted,airtime_ms,rx_good,rx_collided,duplicates,cancelled\n");
+    for (auto &n : nodes)
+        fprintf(f, "%u,%.0f,%.0f,%d,%u,%u,%llu,%u,%u,%u,%u\n", n.num, n.x, n.y, n.role, n.originated, n.transmitted,
+                (unsigned long long)n.airtimeMsec, n.rxGood, n.rxCollided, n.duplicates, n.cancelled);
+    fclose(f);
+    printf("Per node results written to %s\n", reportPath.c_str());
+}
+
+int runMeshSimulation(const char *scenarioPath)
+{
+    // Per packet debug logging from thousands of virtual nodes would dominate the run time
+    if (settingsMap[logoutputlevel] > level_info)
+        settingsMap[logoutputlevel] = level_info;
+
+    MeshSimulator sim;
+    if (!sim.loadScenario(scenarioPath))
+        return EXIT_FAILURE;
+    sim.run();
+    sim.printReport();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "mesh/ContentionWindow.h"
+#include "mesh/NextHopRouter.h"
+#include "mesh/PacketHistory.h"
+#include "mesh/RadioInterface.h"
+
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * A deterministic discrete-event simulator for flooding studies, run with `meshtasticd --sim scenario.yaml`.
+ *
+ * Every virtual node has its own PacketHistory, on the virtual clock, and transmit queue and makes the same rebroadcast decisions as
+ * FloodingRouter (filter duplicates, cancel our pending rebroadcast when a duplicate is overheard, SNR weighted
+ * contention delay).  Airtime and contention delays come from the real RadioInterface code, so changes there are
+ * reflected directly.  Nodes are connected by a log-distance path loss model with per link shadowing, and overlapping
+ * receptions collide unless one of them is stronger by the capture threshold.
+ *
+ * Unicast messages are acknowledged by their destination and retransmitted like ReliableRouter does.  With
+ * `NextHopRouting: true` in the scenario, nodes also learn next hops and direct unicasts like NextHopRouter, so the two
+ * can be compared on the same topology and traffic.  `CoverageSuppression: true` makes nodes cancel their rebroadcast
+ * once the relayers they heard reached all their neighbors, as FloodingRouter does with NeighborInfo when built with
+ * MESHTASTIC_COVERAGE_SUPPRESSION.  The
+ * ContentionWindow policy is chosen by the scenario as well, every node runs its own instance and feeds it what that
+ * node observes.
+ *
+ * Time is virtual, so a 500 node mesh running for an hour completes in seconds.  All scenario randomness comes from
+ * the scenario seed, so the same scenario always produces the same report.
+ */
+class MeshSimulator
+{
+  public:
+    MeshSimulator();
+
+    /// Read the scenario file and build the topology, return false if it could not be parsed
+    bool loadScenario(const char *path);
+
+    /// Run the scenario to completion
+    void run();
+
+    /// Print the aggregate results, and write per node results to the report file if one was configured
+    void printReport();
+
+  private:
+    /// A RadioInterface which is never attached to hardware, used for the airtime and contention delay math
+    class Modem : public RadioInterface
+    {
+      public:
+        Modem(float bandwidth, uint8_t spreadFactor, uint8_t codingRate);
+
+        virtual ErrorCode send(meshtastic_MeshPacket *p) override;
+
+        uint32_t getSlotTimeMsec() const { return slotTimeMsec; }
+    };
+
+    struct Link {
+        uint32_t to; // index of the receiving node
+        float rssi;
+        float snr;
+        bool decodable; // strong enough to be demodulated, weaker links only add interference
+    };
+
+    /// The header fields the routing decisions look at, a full meshtastic_MeshPacket per transmission would be wasteful
+    struct Frame {
+        NodeNum from;
+        NodeNum to;
+        PacketId id;
+        uint8_t hopLimit;
+        uint8_t length;         // total length on air, including the header
+        PacketId requestId = 0; // for ACKs, the id of the packet being acknowledged
+        uint8_t nextHop = NO_NEXT_HOP_PREFERENCE;
+        uint8_t relayNode = 0;
+
+        /// Fill in the fields PacketHistory needs
+        void toPacket(meshtastic_MeshPacket &p) const;
+    };
+
+    /// A copy of a packet waiting in a node's transmit queue
+    struct PendingTx {
+        uint32_t token; // identifies the timer event for this entry, so cancelled entries can be recognized
+        uint32_t message;
+        Frame frame;
+        std::vector<uint32_t> relayers; // nodes we heard transmit this packet, for coverage based suppression
+    };
+
+    struct Reception {
+        uint32_t transmission;
+        float rssi;
+        float snr;
+        bool decodable;
+        bool corrupted;
+    };
+
+    struct Node {
+        NodeNum num;
+        float x, y;
+        meshtastic_Config_DeviceConfig_Role role;
+        std::vector<Link> links;
+        std::vector<uint32_t> announced; // the neighbors NeighborInfo would announce, the strongest ones
+        std::unique_ptr<PacketHistory> history;
+        std::unique_ptr<ContentionWindow> contention;
+        std::vector<PendingTx> txQueue;
+        std::vector<Reception> receptions;
+        uint64_t txUntil = 0;
+
+        // NextHopRouter state
+        NextHopTable nextHops;
+        RecentPacketSet skippedRelays, floodedRelays, relayed;
+
+        // Results
+        uint32_t originated = 0, transmitted = 0, rxGood = 0, rxCollided = 0, duplicates = 0, cancelled = 0, skipped = 0;
+        uint64_t airtimeMsec = 0;
+    };
+
+    struct Transmission {
+        uint32_t sender;
+        uint32_t message;
+        Frame frame;
+    };
+
+    /// One end to end message injected by the traffic generator
+    struct Message {
+        uint32_t origin;
+        NodeNum to;
+        Frame frame; // as first sent by the origin, for retransmissions
+        uint64_t createdMsec;
+        uint32_t reached = 0;    // number of nodes (other than the origin) which received it
+        uint64_t latencySum = 0; // sum of first reception latencies over those nodes
+        bool delivered = false;  // unicast only, the destination received it
+        uint64_t latencyMsec = 0;
+        bool awaitingAck = false; // unicast only, the origin will retransmit unless (implicitly) acked
+        uint8_t retransmissionsLeft = 0;
+        uint64_t retransmitMsec = 0; // when the current EVENT_RETRANSMIT is due, earlier ones were rescheduled
+        bool acked = false;         // the destination's ACK made it back to the origin
+        uint32_t transmissions = 0; // by all nodes, including ACKs and retransmissions
+        std::vector<bool> seenBy;
+    };
+
+    enum EventType { EVENT_GENERATE, EVENT_TX_TIMER, EVENT_RX_END, EVENT_RETRANSMIT };
+
+    struct Event {
+        uint64_t timeMsec;
+        uint64_t seq; // tie breaker so runs are deterministic
+        EventType type;
+        uint32_t node;
+        uint32_t arg;
+
+        bool operator>(const Event &o) const { return timeMsec != o.timeMsec ? timeMsec > o.timeMsec : seq > o.seq; }
+    };
+
+    // Scenario
+    uint32_t seed = 1;
+    uint64_t durationMsec = 10 * 60 * 1000;
+    uint32_t numNodes = 100;
+    float areaMeters = 10000;
+    float routerFraction = 0;
+    uint8_t hopLimit = 3;
+    float messagesPerMinute = 10;
+    float unicastFraction = 0.5;
+    uint32_t payloadBytes = 40;
+    float txPowerDbm = 20;
+    float referenceLossDb = 31.7; // free space loss at 1 m for 915 MHz
+    float pathLossExponent = 2.7;
+    float shadowingSigmaDb = 4;
+    float noiseFloorDbm = -114; // thermal noise in 250 kHz plus a 6 dB receiver noise figure
+    float captureThresholdDb = 6;
+    bool nextHopRouting = false;
+    bool adaptiveContentionWindow = false;
+    bool coverageSuppression = false;
+    std::string reportPath;
+
+    std::unique_ptr<Modem> modem;
+    float snrFloor = 0;
+    std::mt19937 rng;
+
+    std::vector<Node> nodes;
+    std::vector<Transmission> transmissions;
+    std::vector<Message> messages;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    uint64_t now = 0, nextSeq = 0;
+    uint32_t nextToken = 1, nextPacketId = 1;
+
+    void schedule(uint64_t timeMsec, EventType type, uint32_t node, uint32_t arg = 0);
+
+    /// Compute the links between all pairs of nodes
+    void buildLinks();
+
+    void generateMessage();
+
+    /// Put a packet in a node's transmit queue, to be sent after delayMsec
+    void enqueueTx(uint32_t node, uint32_t message, const Frame &f, uint32_t delayMsec);
+
+    /// Drop a queued packet, the equivalent of RadioInterface::cancelSending()
+    bool cancelTx(uint32_t node, NodeNum from, PacketId id);
+
+    void onTxTimer(uint32_t node, uint32_t token);
+    void onRxEnd(uint32_t node, uint32_t transmission);
+
+    /// ReliableRouter::doRetransmissions() for one message
+    void onRetransmit(uint32_t message);
+
+    /// ReliableRouter::setNextTx(), replaces the retransmission scheduled before
+    void scheduleRetransmit(uint32_t message, uint32_t delayMsec);
+
+    /// The router's handling of a successfully received packet
+    void handleReceived(uint32_t node, const Transmission &t, float snr);
+
+    /// NextHopRouter::getNextHop() for a packet the node is about to transmit
+    uint8_t chooseNextHop(const Node &n, const Frame &f) const;
+
+    /// The delay for locally generated packets and for retrying while the channel is busy
+    uint32_t getSendDelayMsec(const Node &n);
+
+    /// The delay FloodingRouter would use before rebroadcasting a packet received with this snr
+    uint32_t getFloodDelayMsec(const Node &n, float snr);
+
+    /// NeighborInfoModule::getCoverage() and FloodingRouter's decision to cancel a pending rebroadcast because of it
+    bool isCovered(uint32_t node, const std::vector<uint32_t> &relayers) const;
+
+    /// Is the node transmitting, or does it hear a preamble it could decode?
+    bool isChannelBusy(const Node &n) const;
+};
+
+/// Entry point for `meshtasticd --sim`, returns the process exit code
+int runMeshSimulation(const char *scenarioPath);
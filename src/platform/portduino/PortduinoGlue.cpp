@@ -1,4 +1,6 @@
+#include "CompressionBenchmark.h"
 #include "CryptoEngine.h"
+#include "GeoBenchmark.h"
 #include "PortduinoGPIO.h"
 #include "SPIChip.h"
 #include "mesh/RF95Interface.h"
@@ -18,6 +20,9 @@
 std::map<configNames, int> settingsMap;
 std::map<configNames, std::string> settingsStrings;
 char *configPath = nullptr;
+char *simScenarioPath = nullptr;
+char *replayTracePath = nullptr;
+float replaySpeed = 1;
 
 // FIXME - move setBluetoothEnable into a HALPlatform class
 void setBluetoothEnable(bool enable)
@@ -46,6 +51,22 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     case 'c':
         configPath = arg;
         break;
+    case 's':
+        simScenarioPath = arg;
+        break;
+    case 'r':
+        replayTracePath = arg;
+        break;
+    case 'R':
+        if (sscanf(arg, "%f", &replaySpeed) < 1 || replaySpeed < 0)
+            return ARGP_ERR_UNKNOWN;
+        break;
+    case 'G':
+        runGeoBenchmark();
+        exit(EXIT_SUCCESS);
+    case 'C':
+        runCompressionBenchmark();
+        exit(EXIT_SUCCESS);
     case ARGP_KEY_ARG:
         return 0;
     default:
@@ -58,6 +79,11 @@ void portduinoCustomInit()
 {
     static struct argp_option options[] = {{"port", 'p', "PORT", 0, "The TCP port to use."},
                                            {"config", 'c', "CONFIG_PATH", 0, "Full path of the .yaml config file to use."},
+                                           {"sim", 's', "SCENARIO_PATH", 0, "Run the mesh simulator on a scenario and exit."},
+                                           {"replay", 'r', "TRACE_PATH", 0, "Replay a recorded radio trace, report and exit."},
+                                           {"replay-speed", 'R', "FACTOR", 0, "Speed up replays by FACTOR, 0 for max speed."},
+                                           {"geo-bench", 'G', 0, 0, "Benchmark the fast geodesic math, report and exit."},
+                                           {"compress-bench", 'C', 0, 0, "Benchmark text message compression, report and exit."},
                                            {0}};
     static void *childArguments;
     static char doc[] = "Meshtastic native build.";
@@ -96,6 +122,9 @@ void portduinoSetup()
     settingsStrings[webserverrootpath] = "";
     settingsStrings[spidev] = "";
     settingsStrings[displayspidev] = "";
+    settingsStrings[mqttoutboxpath] = "";
+    settingsStrings[radiotracepath] = "";
+    settingsStrings[storeforwardlogpath] = "";
 
     YAML::Node yamlConfig;
 
@@ -143,6 +172,7 @@ void portduinoSetup()
             } else if (yamlConfig["Logging"]["LogLevel"].as<std::string>("info") == "error") {
                 settingsMap[logoutputlevel] = level_error;
             }
+            settingsStrings[radiotracepath] = yamlConfig["Logging"]["RadioTracePath"].as<std::string>("");
         }
         if (yamlConfig["Lora"]) {
             settingsMap[use_sx1262] = false;
@@ -274,6 +304,17 @@ void portduinoSetup()
             settingsStrings[webserverrootpath] = (yamlConfig["Webserver"]["RootPath"]).as<std::string>("");
         }
 
+        if (yamlConfig["MQTT"]) {
+            settingsStrings[mqttoutboxpath] = (yamlConfig["MQTT"]["OutboxPath"]).as<std::string>("");
+            settingsMap[mqttoutboxmaxmb] = (yamlConfig["MQTT"]["OutboxMaxMB"]).as<int>(64);
+            settingsMap[mqttoutboxmaxagehours] = (yamlConfig["MQTT"]["OutboxMaxAgeHours"]).as<int>(24);
+            settingsMap[mqttoutboxreplaypersecond] = (yamlConfig["MQTT"]["OutboxReplayPerSecond"]).as<int>(10);
+        }
+
+        if (yamlConfig["StoreForward"]) {
+            settingsStrings[storeforwardlogpath] = (yamlConfig["StoreForward"]["LogPath"]).as<std::string>("");
+        }
+
         settingsMap[maxnodes] = (yamlConfig["General"]["MaxNodes"]).as<int>(200);
 
     } catch (YAML::Exception &e) {
@@ -48,7 +48,13 @@ enum configNames {
     webserver,
     webserverport,
     webserverrootpath,
-    maxnodes
+    maxnodes,
+    mqttoutboxpath,
+    mqttoutboxmaxmb,
+    mqttoutboxmaxagehours,
+    mqttoutboxreplaypersecond,
+    radiotracepath,
+    storeforwardlogpath
 };
 enum { no_screen, x11, st7789, st7735, st7735s, st7796, ili9341, ili9488, hx8357d };
 enum { no_touchscreen, xpt2046, stmpe610, gt911, ft5x06 };
@@ -56,4 +62,7 @@ enum { level_error, level_warn, level_info, level_debug };
 
 extern std::map<configNames, int> settingsMap;
 extern std::map<configNames, std::string> settingsStrings;
+extern char *simScenarioPath;
+extern char *replayTracePath;
+extern float replaySpeed;
 int initGPIOPin(int pinNum, std::string gpioChipname);
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "RadioTrace.h"
+#include "configuration.h"
+#include "mesh-pb-constants.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+#define RADIO_TRACE_MAGIC "MTTRACE1"
+#define RADIO_TRACE_MAGIC_LEN 8
+#define RADIO_TRACE_RECORD_HEADER 14 // time, snr, rssi and length
+
+/// Packets per run when replaying as fast as possible, so the router thread gets to drain its queue in between
+#define RADIO_TRACE_BATCH 8
+/// Give up waiting for the router to process the last packets after this long
+#define RADIO_TRACE_DRAIN_MSECS (10 * 1000)
+
+RadioTraceRecorder *radioTraceRecorder;
+
+RadioTraceRecorder::RadioTraceRecorder(const char *path)
+{
+    file = fopen(path, "wb");
+    if (!file) {
+        LOG_ERROR("Can't open radio trace %s: %s\n", path, strerror(errno));
+        return;
+    }
+    fwrite(RADIO_TRACE_MAGIC, RADIO_TRACE_MAGIC_LEN, 1, file);
+    startMsec = millis();
+    LOG_INFO("Recording received frames to %s\n", path);
+}
+
+RadioTraceRecorder::~RadioTraceRecorder()
+{
+    if (file)
+        fclose(file);
+}
+
+void RadioTraceRecorder::record(const uint8_t *frame, size_t length, float snr, int32_t rssi)
+{
+    if (!file)
+        return;
+
+    uint8_t header[RADIO_TRACE_RECORD_HEADER];
+    uint32_t timeMsec = millis() - startMsec;
+    uint16_t len = length;
+    memcpy(header, &timeMsec, 4);
+    memcpy(header + 4, &snr, 4);
+    memcpy(header + 8, &rssi, 4);
+    memcpy(header + 12, &len, 2);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(frame, length, 1, file);
+    fflush(file); // frames arrive seconds apart, and we want the trace to survive meshtasticd being killed
+}
+
+RadioTraceReplayer::RadioTraceReplayer(const char *path, float speed) : concurrency::OSThread("TraceReplay"), speed(speed)
+{
+    char magic[RADIO_TRACE_MAGIC_LEN];
+    file = fopen(path, "rb");
+    if (!file || fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, RADIO_TRACE_MAGIC, sizeof(magic)) != 0) {
+        LOG_ERROR("%s is not a radio trace\n", path);
+        exit(EXIT_FAILURE);
+    }
+    rxProcessedObserver.observe(&router->rxProcessed);
+    LOG_INFO("Replaying radio trace %s at %.1fx\n", path, speed);
+}
+
+bool RadioTraceReplayer::readNext()
+{
+    uint8_t header[RADIO_TRACE_RECORD_HEADER];
+    if (fread(header, sizeof(header), 1, file) != 1)
+        return false;
+    memcpy(&next.timeMsec, header, 4);
+    memcpy(&next.snr, header + 4, 4);
+    memcpy(&next.rssi, header + 8, 4);
+    memcpy(&next.length, header + 12, 2);
+    if (next.length > sizeof(next.frame) || fread(next.frame, next.length, 1, file) != 1) {
+        LOG_WARN("Radio trace is truncated\n");
+        return false;
+    }
+    return true;
+}
+
+meshtastic_MeshPacket *RadioTraceReplayer::toPacket(const RadioTraceRecord &r)
+{
+    int32_t payloadLen = r.length - sizeof(PacketHeader);
+    const PacketHeader *h = (const PacketHeader *)r.frame;
+    if (payloadLen < 0 || h->from == 0)
+        return NULL;
+
+    meshtastic_MeshPacket *mp = packetPool.allocZeroed();
+    mp->from = h->from;
+    mp->to = h->to;
+    mp->id = h->id;
+    mp->channel = h->channel;
+    mp->hop_limit = h->flags & PACKET_FLAGS_HOP_LIMIT_MASK;
+    mp->hop_start = (h->flags & PACKET_FLAGS_HOP_START_MASK) >> PACKET_FLAGS_HOP_START_SHIFT;
+    mp->want_ack = !!(h->flags & PACKET_FLAGS_WANT_ACK_MASK);
+    mp->via_mqtt = !!(h->flags & PACKET_FLAGS_VIA_MQTT_MASK);
+    mp->rx_snr = r.snr;
+    mp->rx_rssi = r.rssi;
+    mp->which_payload_variant = meshtastic_MeshPacket_encrypted_tag;
+    memcpy(mp->encrypted.bytes, r.frame + sizeof(PacketHeader), payloadLen);
+    mp->encrypted.size = payloadLen;
+    return mp;
+}
+
+int32_t RadioTraceReplayer::runOnce()
+{
+    uint32_t now = millis();
+    if (startMsec == 0) {
+        startMsec = now;
+        haveNext = readNext();
+    }
+
+    for (uint32_t batch = 0; haveNext && batch < RADIO_TRACE_BATCH; batch++) {
+        if (speed > 0) {
+            uint32_t dueMsec = startMsec + (uint32_t)(next.timeMsec / speed);
+            if ((int32_t)(dueMsec - now) > 0)
+                return dueMsec - now;
+        }
+
+        meshtastic_MeshPacket *mp = toPacket(next);
+        if (mp) {
+            enqueuedMicros[mp] = micros();
+            const PacketHeader *h = (const PacketHeader *)next.frame;
+            router->enqueueReceivedMessage(mp, h->next_hop, h->relay_node);
+            replayed++;
+        } else {
+            malformed++;
+        }
+        haveNext = readNext();
+    }
+    if (haveNext)
+        return 0;
+
+    if (doneMsec == 0)
+        doneMsec = now;
+    if (!enqueuedMicros.empty() && now - doneMsec < RADIO_TRACE_DRAIN_MSECS)
+        return 100;
+
+    printReport();
+    exit(EXIT_SUCCESS);
+}
+
+int RadioTraceReplayer::onRxProcessed(const RxProcessedEvent *event)
+{
+    auto found = enqueuedMicros.find(event->p);
+    if (found == enqueuedMicros.end())
+        return 0; // not one of ours, e.g. a packet we sent to ourselves
+
+    latenciesMicros.push_back(micros() - found->second);
+    enqueuedMicros.erase(found);
+    dispositions[event->disposition]++;
+    rebroadcasts += event->rebroadcast;
+    return 0;
+}
+
+void RadioTraceReplayer::printReport()
+{
+    printf("Replayed %u frames (%u malformed frames skipped), %u still unprocessed\n", replayed, malformed,
+           (unsigned)enqueuedMicros.size());
+    printf("Handled %u, filtered %u, ignored %u, undecodable %u, rebroadcast %u\n", dispositions[RX_DISPOSITION_HANDLED],
+           dispositions[RX_DISPOSITION_FILTERED], dispositions[RX_DISPOSITION_IGNORED], dispositions[RX_DISPOSITION_UNDECODABLE],
+           rebroadcasts);
+
+    if (latenciesMicros.empty())
+        return;
+    std::sort(latenciesMicros.begin(), latenciesMicros.end());
+    uint64_t sum = 0;
+    for (auto l : latenciesMicros)
+        sum += l;
+    size_t n = latenciesMicros.size();
+    printf("Processing latency: mean %llu us, median %u us, 99th percentile %u us, max %u us\n",
+           (unsigned long long)(sum / n), latenciesMicros[n / 2], latenciesMicros[n * 99 / 100], latenciesMicros[n - 1]);
+}
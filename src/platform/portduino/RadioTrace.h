@@ -0,0 +1,84 @@
+#pragma once
+
+#include "concurrency/OSThread.h"
+#include "mesh/Router.h"
+
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Radio traces are a record of the raw LoRa frames a node received, so that real traffic can be fed through the router
+ * again later to benchmark routing changes.
+ *
+ * A trace file starts with the 8 byte magic "MTTRACE1", followed by one record per frame:
+ * [uint32 msecs since the start of the recording][float snr][int32 rssi][uint16 length][frame, including the PacketHeader]
+ */
+struct RadioTraceRecord {
+    uint32_t timeMsec;
+    float snr;
+    int32_t rssi;
+    uint16_t length;
+    uint8_t frame[MAX_RHPACKETLEN];
+};
+
+/// Appends every frame received by RadioLibInterface to a trace file, enabled with Logging: RadioTracePath in config.yaml
+class RadioTraceRecorder
+{
+  public:
+    explicit RadioTraceRecorder(const char *path);
+    ~RadioTraceRecorder();
+
+    void record(const uint8_t *frame, size_t length, float snr, int32_t rssi);
+
+  private:
+    FILE *file = NULL;
+    uint32_t startMsec = 0;
+};
+
+extern RadioTraceRecorder *radioTraceRecorder;
+
+/**
+ * Feeds a recorded trace through Router::enqueueReceivedMessage(), at the original speed or faster, then prints how
+ * the router handled it and exits.  Started with `meshtasticd --replay trace.bin [--replay-speed N]`.
+ *
+ * Best run on a config without LoRa hardware (so SimRadio is used), otherwise our rebroadcasts go out over the air.
+ */
+class RadioTraceReplayer : private concurrency::OSThread
+{
+  public:
+    /// @param speed how much faster than recorded to replay, 0 for as fast as the router can take them
+    RadioTraceReplayer(const char *path, float speed);
+
+  protected:
+    virtual int32_t runOnce() override;
+
+  private:
+    FILE *file = NULL;
+    float speed;
+    RadioTraceRecord next;
+    bool haveNext = false;
+    uint32_t startMsec = 0;
+    uint32_t doneMsec = 0;
+
+    /// micros() at which each packet still waiting for the router was enqueued
+    std::unordered_map<const meshtastic_MeshPacket *, uint32_t> enqueuedMicros;
+
+    // Results
+    uint32_t replayed = 0, malformed = 0, rebroadcasts = 0;
+    uint32_t dispositions[RX_DISPOSITION_UNDECODABLE + 1] = {};
+    std::vector<uint32_t> latenciesMicros;
+
+    CallbackObserver<RadioTraceReplayer, const RxProcessedEvent *> rxProcessedObserver =
+        CallbackObserver<RadioTraceReplayer, const RxProcessedEvent *>(this, &RadioTraceReplayer::onRxProcessed);
+
+    int onRxProcessed(const RxProcessedEvent *event);
+
+    bool readNext();
+
+    /// Build a packet from a recorded frame, the same way RadioLibInterface::handleReceiveInterrupt() does
+    meshtastic_MeshPacket *toPacket(const RadioTraceRecord &r);
+
+    void printReport();
+};
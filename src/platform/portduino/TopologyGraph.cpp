@@ -0,0 +1,298 @@
+#include "TopologyGraph.h"
+#include "configuration.h"
+#include "modules/NeighborInfoModule.h"
+
+#include <algorithm>
+#include <math.h>
+#include <queue>
+
+/// Rebuild the snapshot at least this often, so expired links drop out even when nothing is reported
+#define TOPOLOGY_SNAPSHOT_MAX_AGE_SECS 60
+
+TopologyGraph topologyGraph;
+
+float TopologyGraph::getDelivery(float snr)
+{
+    // Packets mostly get through a few dB above the demodulation floor, and mostly don't below it
+    float delivery = 1 / (1 + expf(-(snr - TOPOLOGY_SNR_FLOOR_DB) / 2));
+    return std::max(delivery, 0.05f);
+}
+
+TopologyGraph::Node &TopologyGraph::getNode(NodeNum node, uint32_t now)
+{
+    auto found = nodes.find(node);
+    if (found != nodes.end())
+        return found->second;
+
+    if (nodes.size() >= TOPOLOGY_MAX_NODES) {
+        auto oldest = std::min_element(nodes.begin(), nodes.end(),
+                                       [](const std::pair<const NodeNum, Node> &a, const std::pair<const NodeNum, Node> &b) {
+                                           return a.second.updated < b.second.updated;
+                                       });
+        LOG_DEBUG("Topology graph full, dropping 0x%x\n", oldest->first);
+        nodes.erase(oldest);
+    }
+    Node &n = nodes[node];
+    n.updated = now;
+    n.hasKeyframe = false;
+    n.keyframe = 0;
+    return n;
+}
+
+void TopologyGraph::setHeard(Node &n, NodeNum node, float snr, uint32_t now)
+{
+    for (auto &h : n.heard) {
+        if (h.node == node) {
+            // A traceroute doesn't tell the SNR, don't let it erase the one from a NeighborInfo
+            if (!isnan(snr))
+                h.snr = snr;
+            h.updated = now;
+            return;
+        }
+    }
+    n.heard.push_back({node, snr, now});
+}
+
+void TopologyGraph::replaceNeighbors(NodeNum node, const Neighbor *neighbors, size_t count, uint32_t now)
+{
+    Node &n = getNode(node, now);
+    n.updated = now;
+    n.heard.clear();
+    for (size_t i = 0; i < count; i++)
+        if (neighbors[i].node != node)
+            setHeard(n, neighbors[i].node, neighbors[i].snr, now);
+    dirty = true;
+}
+
+void TopologyGraph::setNeighbors(NodeNum node, const Neighbor *neighbors, size_t count, uint32_t now)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    replaceNeighbors(node, neighbors, count, now);
+}
+
+void TopologyGraph::onNeighborInfo(const meshtastic_MeshPacket &mp, const meshtastic_NeighborInfo *np, uint32_t now)
+{
+    NeighborInfoModule::DeltaFields fields;
+    NeighborInfoModule::readDeltaFields(mp, fields);
+
+    std::vector<Neighbor> neighbors;
+    for (pb_size_t i = 0; i < np->neighbors_count; i++)
+        neighbors.push_back({np->neighbors[i].node_id, np->neighbors[i].snr});
+
+    std::lock_guard<std::mutex> guard(lock);
+    Node &n = getNode(np->node_id, now);
+    if (fields.kind == NeighborInfoModule::DeltaFields::DELTA) {
+        if (!n.hasKeyframe || n.keyframe != fields.keyframe) {
+            LOG_DEBUG("Topology: missed the full NeighborInfo of 0x%x, ignoring its delta\n", np->node_id);
+            return;
+        }
+        // The full list, less the neighbors that left, with the ones that joined or changed
+        std::vector<Neighbor> current = neighbors;
+        NodeNum *removedEnd = fields.removed + fields.numRemoved;
+        for (auto &k : n.keyframeNeighbors) {
+            bool removed = std::find(fields.removed, removedEnd, k.node) != removedEnd;
+            bool changed = std::any_of(neighbors.begin(), neighbors.end(), [&k](const Neighbor &c) { return c.node == k.node; });
+            if (!removed && !changed)
+                current.push_back(k);
+        }
+        replaceNeighbors(np->node_id, current.data(), current.size(), now);
+        return;
+    }
+
+    n.hasKeyframe = fields.kind == NeighborInfoModule::DeltaFields::KEYFRAME;
+    n.keyframe = fields.keyframe;
+    n.keyframeNeighbors = neighbors;
+    replaceNeighbors(np->node_id, neighbors.data(), neighbors.size(), now);
+}
+
+void TopologyGraph::onRoute(NodeNum origin, const uint32_t *route, size_t routeCount, NodeNum dest, uint32_t now)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    NodeNum prev = origin;
+    for (size_t i = 0; i <= routeCount; i++) {
+        NodeNum next = i < routeCount ? route[i] : dest;
+        if (next == prev)
+            continue;
+        // The packet went from prev to next, so next heard prev
+        getNode(prev, now);
+        Node &n = getNode(next, now);
+        n.updated = now;
+        setHeard(n, prev, NAN, now);
+        prev = next;
+    }
+    dirty = true;
+}
+
+void TopologyGraph::refresh(uint32_t now)
+{
+    if (!dirty && now - snapshot.builtAt < TOPOLOGY_SNAPSHOT_MAX_AGE_SECS)
+        return;
+
+    // Merge both directions of every live link
+    std::unordered_map<uint64_t, size_t> linkIndex;
+    links.clear();
+    for (auto &entry : nodes) {
+        for (auto &h : entry.second.heard) {
+            if (now - h.updated > TOPOLOGY_LINK_EXPIRE_SECS)
+                continue;
+            NodeNum a = std::min(entry.first, h.node), b = std::max(entry.first, h.node);
+            uint64_t key = (uint64_t)a << 32 | b;
+            auto found = linkIndex.find(key);
+            if (found == linkIndex.end()) {
+                found = linkIndex.emplace(key, links.size()).first;
+                links.push_back({a, b, NAN, NAN, 0});
+            }
+            Link &link = links[found->second];
+            (entry.first == a ? link.snrAB : link.snrBA) = h.snr;
+        }
+    }
+
+    snapshot.nodes.clear();
+    snapshot.index.clear();
+    std::vector<uint32_t> degree;
+    auto indexOf = [&](NodeNum node) {
+        auto found = snapshot.index.find(node);
+        if (found != snapshot.index.end())
+            return found->second;
+        uint32_t i = snapshot.nodes.size();
+        snapshot.index[node] = i;
+        snapshot.nodes.push_back(node);
+        degree.push_back(0);
+        return i;
+    };
+    for (auto &link : links) {
+        bool knownAB = !isnan(link.snrAB), knownBA = !isnan(link.snrBA);
+        if (!knownAB && !knownBA)
+            link.etx = TOPOLOGY_UNKNOWN_LINK_ETX;
+        else
+            link.etx = 1 / (getDelivery(knownAB ? link.snrAB : link.snrBA) * getDelivery(knownBA ? link.snrBA : link.snrAB));
+        degree[indexOf(link.a)]++;
+        degree[indexOf(link.b)]++;
+    }
+
+    size_t numNodes = snapshot.nodes.size();
+    snapshot.offsets.assign(numNodes + 1, 0);
+    for (size_t i = 0; i < numNodes; i++)
+        snapshot.offsets[i + 1] = snapshot.offsets[i] + degree[i];
+    snapshot.targets.resize(snapshot.offsets[numNodes]);
+    snapshot.etx.resize(snapshot.offsets[numNodes]);
+    std::vector<uint32_t> fill(snapshot.offsets.begin(), snapshot.offsets.end() - 1);
+    for (auto &link : links) {
+        uint32_t a = snapshot.index[link.a], b = snapshot.index[link.b];
+        snapshot.targets[fill[a]] = b;
+        snapshot.etx[fill[a]++] = link.etx;
+        snapshot.targets[fill[b]] = a;
+        snapshot.etx[fill[b]++] = link.etx;
+    }
+
+    snapshot.builtAt = now;
+    dirty = false;
+}
+
+bool TopologyGraph::findPath(NodeNum from, NodeNum to, uint32_t now, std::vector<NodeNum> &path, float &etx)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return findPathLocked(from, to, now, path, etx);
+}
+
+bool TopologyGraph::findPathLocked(NodeNum from, NodeNum to, uint32_t now, std::vector<NodeNum> &path, float &etx)
+{
+    refresh(now);
+    path.clear();
+    auto source = snapshot.index.find(from), target = snapshot.index.find(to);
+    if (source == snapshot.index.end() || target == snapshot.index.end())
+        return false;
+
+    // Dijkstra
+    size_t numNodes = snapshot.nodes.size();
+    std::vector<float> cost(numNodes, INFINITY);
+    std::vector<uint32_t> previous(numNodes, UINT32_MAX);
+    typedef std::pair<float, uint32_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    cost[source->second] = 0;
+    queue.push({0, source->second});
+    while (!queue.empty()) {
+        Entry e = queue.top();
+        queue.pop();
+        uint32_t u = e.second;
+        if (e.first > cost[u])
+            continue;
+        if (u == target->second)
+            break;
+        for (uint32_t i = snapshot.offsets[u]; i < snapshot.offsets[u + 1]; i++) {
+            uint32_t v = snapshot.targets[i];
+            float c = cost[u] + snapshot.etx[i];
+            if (c < cost[v]) {
+                cost[v] = c;
+                previous[v] = u;
+                queue.push({c, v});
+            }
+        }
+    }
+
+    if (isinf(cost[target->second]))
+        return false;
+    for (uint32_t u = target->second; u != UINT32_MAX; u = previous[u])
+        path.push_back(snapshot.nodes[u]);
+    std::reverse(path.begin(), path.end());
+    etx = cost[target->second];
+    return true;
+}
+
+static void appendFloat(std::string &out, float value)
+{
+    char buf[16];
+    if (isnan(value))
+        out += "null";
+    else {
+        snprintf(buf, sizeof(buf), "%.2f", value);
+        out += buf;
+    }
+}
+
+std::string TopologyGraph::toJson(uint32_t now)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    refresh(now);
+
+    std::string out = "{\"nodes\":[";
+    for (size_t i = 0; i < snapshot.nodes.size(); i++) {
+        if (i)
+            out += ",";
+        out += std::to_string(snapshot.nodes[i]);
+    }
+    out += "],\"links\":[";
+    for (size_t i = 0; i < links.size(); i++) {
+        const Link &link = links[i];
+        out += i ? ",{\"a\":" : "{\"a\":";
+        out += std::to_string(link.a) + ",\"b\":" + std::to_string(link.b) + ",\"snr_ab\":";
+        appendFloat(out, link.snrAB);
+        out += ",\"snr_ba\":";
+        appendFloat(out, link.snrBA);
+        out += ",\"etx\":";
+        appendFloat(out, link.etx);
+        out += "}";
+    }
+    out += "]}";
+    return out;
+}
+
+std::string TopologyGraph::pathToJson(NodeNum from, NodeNum to, uint32_t now)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<NodeNum> path;
+    float etx = NAN;
+    bool found = findPathLocked(from, to, now, path, etx);
+
+    std::string out = "{\"from\":" + std::to_string(from) + ",\"to\":" + std::to_string(to) + ",\"etx\":";
+    appendFloat(out, etx);
+    if (!found)
+        return out + ",\"path\":null}";
+    out += ",\"path\":[";
+    for (size_t i = 0; i < path.size(); i++) {
+        if (i)
+            out += ",";
+        out += std::to_string(path[i]);
+    }
+    return out + "]}";
+}
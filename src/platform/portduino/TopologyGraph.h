@@ -0,0 +1,121 @@
+#pragma once
+
+#include "mesh/MeshTypes.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Most nodes kept in the graph, the one updated longest ago is dropped to make room
+#ifndef TOPOLOGY_MAX_NODES
+#define TOPOLOGY_MAX_NODES 2048
+#endif
+
+/// Links nobody reported for this long are left out of the graph
+#define TOPOLOGY_LINK_EXPIRE_SECS (6 * 60 * 60)
+
+/// SNR at which about half the packets get through, the demodulation floor of LongFast (SF11)
+#ifndef TOPOLOGY_SNR_FLOOR_DB
+#define TOPOLOGY_SNR_FLOOR_DB -17.5f
+#endif
+
+/// ETX of a link we only know from a traceroute, which doesn't tell its SNR
+#define TOPOLOGY_UNKNOWN_LINK_ETX 2.0f
+
+/**
+ * The topology of the whole mesh as seen by a gateway, pieced together from the NeighborInfo and TraceRoute packets it
+ * receives, for operators to map and for routing decisions.
+ *
+ * Reports update the neighbors of one node at a time, kept per node so updates are cheap.  Queries run on a compact
+ * snapshot: nodes numbered densely, with the links of each in one array (compressed sparse rows).  It is rebuilt only
+ * when the graph changed since the last query.
+ *
+ * Links are undirected for path finding, as LoRa only gets a unicast across when it's received both ways.  A link's ETX
+ * (expected transmissions) is the product of the inverse delivery ratios both ways, estimated from the reported SNRs.
+ * When only one side reported the link, it is assumed symmetric.
+ *
+ * Thread safe, as the web server queries it from its own thread.
+ */
+class TopologyGraph
+{
+  public:
+    struct Neighbor {
+        NodeNum node;
+        float snr; // how well the reporting node hears it, NAN if unknown
+    };
+
+    /// The full list of neighbors node reported, replacing what it reported before
+    void setNeighbors(NodeNum node, const Neighbor *neighbors, size_t count, uint32_t now);
+
+    /// A NeighborInfo packet, which may be a delta relative to the last full list of its sender
+    void onNeighborInfo(const meshtastic_MeshPacket &mp, const meshtastic_NeighborInfo *np, uint32_t now);
+
+    /// A traceroute went from origin through the route to dest, so each consecutive pair are neighbors
+    void onRoute(NodeNum origin, const uint32_t *route, size_t routeCount, NodeNum dest, uint32_t now);
+
+    /**
+     * Find the path with the lowest total ETX
+     *
+     * @param path receives the nodes from 'from' to 'to', both included
+     * @return false if there is no known path
+     */
+    bool findPath(NodeNum from, NodeNum to, uint32_t now, std::vector<NodeNum> &path, float &etx);
+
+    /// The graph as JSON: {"nodes":[...],"links":[{"a":..,"b":..,"snr_ab":..,"snr_ba":..,"etx":..},...]}
+    std::string toJson(uint32_t now);
+
+    /// A path from findPath() as JSON: {"from":..,"to":..,"etx":..,"path":[...]}, with a null path if there is none
+    std::string pathToJson(NodeNum from, NodeNum to, uint32_t now);
+
+  private:
+    struct Heard {
+        NodeNum node;
+        float snr;
+        uint32_t updated;
+    };
+
+    struct Node {
+        uint32_t updated;
+        std::vector<Heard> heard; // the neighbors it hears, deduplicated
+
+        /// The last full NeighborInfo list it sent, which its deltas are relative to
+        bool hasKeyframe;
+        uint16_t keyframe;
+        std::vector<Neighbor> keyframeNeighbors;
+    };
+
+    std::mutex lock;
+    std::unordered_map<NodeNum, Node> nodes;
+    bool dirty = true;
+
+    /// Compressed sparse row snapshot of the live links
+    struct Snapshot {
+        std::vector<NodeNum> nodes;
+        std::unordered_map<NodeNum, uint32_t> index;
+        std::vector<uint32_t> offsets; // the links of node i are at [offsets[i], offsets[i + 1])
+        std::vector<uint32_t> targets;
+        std::vector<float> etx;
+        uint32_t builtAt = 0;
+    } snapshot;
+
+    struct Link {
+        NodeNum a, b; // a < b
+        float snrAB, snrBA; // how well a hears b, and b hears a
+        float etx;
+    };
+    std::vector<Link> links;
+
+    Node &getNode(NodeNum node, uint32_t now);
+    void setHeard(Node &n, NodeNum node, float snr, uint32_t now);
+    void replaceNeighbors(NodeNum node, const Neighbor *neighbors, size_t count, uint32_t now);
+
+    /// Rebuild the snapshot if the graph changed, or links may have expired since it was built
+    void refresh(uint32_t now);
+
+    bool findPathLocked(NodeNum from, NodeNum to, uint32_t now, std::vector<NodeNum> &path, float &etx);
+
+    static float getDelivery(float snr);
+};
+
+extern TopologyGraph topologyGraph;
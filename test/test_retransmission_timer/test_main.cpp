@@ -0,0 +1,121 @@
+#include "mesh/RetransmissionTimer.h"
+#include <algorithm>
+#include <unity.h>
+#include <vector>
+
+static std::vector<RetransmissionTimer> timers;
+
+/// Schedule a retransmission "d" msecs after "now" the way ReliableRouter::setNextTx does
+static void push(PacketId id, uint32_t now, uint32_t d, uint32_t busyMsec = 0)
+{
+    timers.push_back({GlobalPacketId(1, id), now + d - busyMsec});
+    std::push_heap(timers.begin(), timers.end(), &CompareRetransmissionTimer);
+}
+
+static PacketId pop()
+{
+    PacketId id = timers.front().key.id;
+    std::pop_heap(timers.begin(), timers.end(), &CompareRetransmissionTimer);
+    timers.pop_back();
+    return id;
+}
+
+void setUp(void)
+{
+    timers.clear();
+}
+
+void tearDown(void) {}
+
+void test_earliest_first(void)
+{
+    push(3, 1000, 3000);
+    push(1, 1000, 1000);
+    push(4, 1000, 4000);
+    push(2, 1000, 2000);
+
+    for (PacketId id = 1; id <= 4; id++)
+        TEST_ASSERT_EQUAL_UINT32(id, pop());
+}
+
+void test_straddling_rollover(void)
+{
+    // Scheduled just before millis() wraps, the later ones land past 2^32 and have small nextTxMsec values
+    uint32_t now = UINT32_MAX - 1500;
+    push(4, now, 4000);
+    push(2, now, 1000);
+    push(5, now, 60000);
+    push(1, now, 500);
+    push(3, now, 2000);
+
+    TEST_ASSERT_LESS_THAN_UINT32(now, timers.back().nextTxMsec);
+    for (PacketId id = 1; id <= 5; id++)
+        TEST_ASSERT_EQUAL_UINT32(id, pop());
+}
+
+void test_due_across_rollover(void)
+{
+    uint32_t now = UINT32_MAX - 100;
+    push(1, now, 300);
+    const RetransmissionTimer &t = timers.front();
+
+    TEST_ASSERT_EQUAL_INT32(300, t.dueInMsec(0, now));
+    TEST_ASSERT_EQUAL_INT32(150, t.dueInMsec(0, now + 150)); // millis() has wrapped by now
+    TEST_ASSERT_EQUAL_INT32(0, t.dueInMsec(0, now + 300));
+    TEST_ASSERT_EQUAL_INT32(-50, t.dueInMsec(0, now + 350));
+}
+
+void test_busy_shift(void)
+{
+    // Times are stored minus busyMsec, so airtime we spend busy delays every pending retransmission at once
+    uint32_t busyMsec = 5000;
+    uint32_t now = 20000;
+    push(1, now, 1000, busyMsec);
+    push(2, now, 2000, busyMsec);
+    TEST_ASSERT_EQUAL_INT32(1000, timers.front().dueInMsec(busyMsec, now));
+
+    busyMsec += 700; // ReliableRouter::delayRetransmissions
+    TEST_ASSERT_EQUAL_INT32(1700, timers.front().dueInMsec(busyMsec, now));
+    TEST_ASSERT_EQUAL_UINT32(1, pop());
+    TEST_ASSERT_EQUAL_INT32(2700, timers.front().dueInMsec(busyMsec, now));
+
+    // Timers scheduled after the shift still interleave correctly with the older ones
+    push(3, now, 2200, busyMsec);
+    TEST_ASSERT_EQUAL_UINT32(3, pop());
+    TEST_ASSERT_EQUAL_UINT32(2, pop());
+}
+
+void test_busy_shift_across_rollover(void)
+{
+    // busyMsec only grows, so it wraps too; the stored times then wrap the other way
+    uint32_t busyMsec = UINT32_MAX - 200;
+    uint32_t now = 1000;
+    push(2, now, 2000, busyMsec);
+    push(1, now, 1000, busyMsec);
+    TEST_ASSERT_EQUAL_INT32(1000, timers.front().dueInMsec(busyMsec, now));
+
+    busyMsec += 500;
+    push(3, now, 1600, busyMsec);
+    TEST_ASSERT_EQUAL_INT32(1500, timers.front().dueInMsec(busyMsec, now));
+    TEST_ASSERT_EQUAL_UINT32(1, pop());
+    TEST_ASSERT_EQUAL_UINT32(3, pop());
+    TEST_ASSERT_EQUAL_INT32(2500, timers.front().dueInMsec(busyMsec, now));
+    TEST_ASSERT_EQUAL_UINT32(2, pop());
+}
+
+// The Portduino framework calls these before setup(), the firmware defines them in PortduinoGlue.cpp
+void portduinoCustomInit() {}
+void portduinoSetup() {}
+
+void setup()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_earliest_first);
+    RUN_TEST(test_straddling_rollover);
+    RUN_TEST(test_due_across_rollover);
+    RUN_TEST(test_busy_shift);
+    RUN_TEST(test_busy_shift_across_rollover);
+    exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,309 @@
+#include "modules/StoreForwardStorage.h"
+#include <chrono>
+#include <random>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+// The index depends only on MeshTypes.h, so it is built into the test instead of linking the firmware
+#include "modules/StoreForwardIndex.cpp"
+
+static const NodeNum CLIENT = 0x10;
+static const NodeNum OTHER = 0x20;
+static const NodeNum SENDER = 0x30;
+
+static std::vector<StoreForwardIndexEntry> storage;
+static StoreForwardIndex history;
+
+static void init(uint32_t capacity)
+{
+    storage.assign(capacity, StoreForwardIndexEntry());
+    history.init(storage.data(), capacity);
+}
+
+/// Query for CLIENT with no window limit, @return the sequence numbers found
+static std::vector<uint32_t> query(uint32_t afterSeq, uint32_t max = 100, NodeNum client = CLIENT)
+{
+    std::vector<uint32_t> out(max);
+    out.resize(history.query(client, UINT32_MAX, 0, afterSeq, out.data(), max));
+    return out;
+}
+
+static void assertSeqs(const std::vector<uint32_t> &expected, const std::vector<uint32_t> &actual)
+{
+    TEST_ASSERT_EQUAL_UINT32(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++)
+        TEST_ASSERT_EQUAL_UINT32(expected[i], actual[i]);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_add_and_get(void)
+{
+    init(4);
+    TEST_ASSERT_EQUAL_UINT32(1, history.add(100, SENDER, CLIENT, 7));
+    TEST_ASSERT_EQUAL_UINT32(2, history.add(101, SENDER, NODENUM_BROADCAST, 8));
+
+    const StoreForwardIndexEntry *e = history.get(1);
+    TEST_ASSERT_NOT_NULL(e);
+    TEST_ASSERT_EQUAL_UINT32(100, e->time);
+    TEST_ASSERT_EQUAL_UINT32(SENDER, e->from);
+    TEST_ASSERT_EQUAL_UINT32(CLIENT, e->to);
+    TEST_ASSERT_EQUAL_UINT32(7, e->location);
+    TEST_ASSERT_NULL(history.get(0));
+    TEST_ASSERT_NULL(history.get(3));
+    TEST_ASSERT_EQUAL_UINT32(2, history.getCount());
+}
+
+void test_no_storage(void)
+{
+    history.init(nullptr, 10);
+    TEST_ASSERT_EQUAL_UINT32(0, history.add(100, SENDER, CLIENT, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, history.getCapacity());
+    assertSeqs({}, query(0));
+}
+
+void test_wrap_evicts_oldest(void)
+{
+    init(4);
+    for (uint32_t i = 0; i < 10; i++)
+        history.add(100 + i, SENDER, NODENUM_BROADCAST, i);
+
+    TEST_ASSERT_EQUAL_UINT32(4, history.getCount());
+    TEST_ASSERT_EQUAL_UINT32(10, history.getTotal());
+    TEST_ASSERT_EQUAL_UINT32(7, history.getOldestSeq());
+    TEST_ASSERT_NULL(history.get(6));
+    TEST_ASSERT_EQUAL_UINT32(9, history.get(10)->location);
+    assertSeqs({7, 8, 9, 10}, query(0));
+
+    // Cursors handed out before the wrap are still valid
+    assertSeqs({9, 10}, query(8));
+    assertSeqs({7, 8, 9, 10}, query(3));
+}
+
+void test_eviction_drops_whole_chain(void)
+{
+    init(3);
+    history.add(100, SENDER, CLIENT, 0);            // 1, evicted below
+    history.add(101, SENDER, OTHER, 0);             // 2
+    history.add(102, SENDER, NODENUM_BROADCAST, 0); // 3
+    assertSeqs({1, 3}, query(0));
+
+    history.add(103, SENDER, OTHER, 0); // 4 overwrites the only message to CLIENT
+    assertSeqs({3}, query(0));
+
+    // A new message to CLIENT starts a fresh chain
+    history.add(104, SENDER, CLIENT, 0); // 5
+    assertSeqs({3, 5}, query(0));
+    assertSeqs({3, 4}, query(0, 100, OTHER));
+}
+
+void test_query_filters_and_merges(void)
+{
+    init(16);
+    history.add(100, SENDER, CLIENT, 0);            // 1
+    history.add(101, SENDER, OTHER, 0);             // 2, for someone else
+    history.add(102, SENDER, NODENUM_BROADCAST, 0); // 3
+    history.add(103, CLIENT, NODENUM_BROADCAST, 0); // 4, the client's own
+    history.add(104, OTHER, CLIENT, 0);             // 5
+    history.add(105, SENDER, NODENUM_BROADCAST, 0); // 6
+
+    assertSeqs({1, 3, 5, 6}, query(0));
+    assertSeqs({2, 3, 4, 6}, query(0, 100, OTHER));
+    assertSeqs({3, 4, 6}, query(0, 100, NODENUM_BROADCAST));
+}
+
+void test_query_cursor_and_max(void)
+{
+    init(64);
+    for (uint32_t i = 0; i < 40; i++)
+        history.add(100 + i, SENDER, i % 3 ? NODENUM_BROADCAST : CLIENT, 0);
+
+    assertSeqs({1, 2, 3}, query(0, 3));
+    assertSeqs({4, 5, 6}, query(3, 3));
+    assertSeqs({39, 40}, query(38));
+    assertSeqs({}, query(40));
+
+    // A cursor from the future was handed out before the history was cleared, so it starts over
+    assertSeqs({1, 2}, query(1000, 2));
+}
+
+void test_query_window(void)
+{
+    init(16);
+    // Times close to the top of the clock, so the window wraps too
+    uint32_t t = UINT32_MAX - 25;
+    for (uint32_t i = 0; i < 6; i++)
+        history.add(t + i * 10, SENDER, NODENUM_BROADCAST, 0); // the last three are past the rollover
+
+    std::vector<uint32_t> out(16);
+    uint32_t now = t + 55;
+    TEST_ASSERT_EQUAL_UINT32(6, history.query(CLIENT, 55, now, 0, out.data(), 16));
+    TEST_ASSERT_EQUAL_UINT32(3, history.query(CLIENT, 25, now, 0, out.data(), 16));
+    TEST_ASSERT_EQUAL_UINT32(4, out[0]);
+    TEST_ASSERT_EQUAL_UINT32(0, history.query(CLIENT, 4, now, 0, out.data(), 16));
+
+    // The cursor and the window both limit the result, whichever starts later wins
+    TEST_ASSERT_EQUAL_UINT32(1, history.query(CLIENT, 25, now, 5, out.data(), 16));
+    TEST_ASSERT_EQUAL_UINT32(6, out[0]);
+}
+
+void test_matches_brute_force(void)
+{
+    struct Ref {
+        uint32_t seq, time;
+        NodeNum from, to;
+    };
+    std::mt19937 rng(1);
+
+    for (int trial = 0; trial < 200; trial++) {
+        uint32_t capacity = 1 + rng() % 50;
+        init(capacity);
+        std::vector<Ref> all;
+        uint32_t now = 0xFFFFFF00 + rng() % 1000; // let the clock wrap
+
+        for (int i = 0; i < 300; i++) {
+            now += rng() % 10;
+            NodeNum from = rng() % 5;
+            NodeNum to = rng() % 3 == 0 ? NODENUM_BROADCAST : rng() % 5;
+            uint32_t seq = history.add(now, from, to, i);
+            all.push_back({seq, now, from, to});
+
+            if (rng() % 4)
+                continue;
+            NodeNum client = rng() % 5;
+            uint32_t window = rng() % 500, after = rng() % (seq + 3), max = 1 + rng() % 10;
+            std::vector<uint32_t> out(max);
+            out.resize(history.query(client, window, now, after, out.data(), max));
+
+            std::vector<uint32_t> expected;
+            for (const Ref &r : all)
+                if (r.seq >= history.getOldestSeq() && (after > seq || r.seq > after) && now - r.time <= window &&
+                    r.from != client && (r.to == client || r.to == NODENUM_BROADCAST) && expected.size() < max)
+                    expected.push_back(r.seq);
+            assertSeqs(expected, out);
+        }
+        TEST_ASSERT_EQUAL_UINT32(std::min<uint32_t>(capacity, 300), history.getCount());
+    }
+}
+
+/// A storage backend in plain vectors, on a clock the test sets
+class TestStorage : public StoreForwardStorage
+{
+  public:
+    uint32_t now = 0;
+
+    explicit TestStorage(uint32_t capacity) : entries(capacity), records(capacity) { index.init(entries.data(), capacity); }
+
+    virtual uint32_t add(NodeNum from, NodeNum to, uint8_t channel, const uint8_t *payload, pb_size_t size) override
+    {
+        uint32_t seq = index.add(now, from, to, 0);
+        PacketHistoryStruct &r = records[seq % getCapacity()];
+        r = {now, to, from, channel, {}, size};
+        memcpy(r.payload, payload, size);
+        return seq;
+    }
+
+    virtual bool get(uint32_t seq, PacketHistoryStruct &record) override
+    {
+        if (!index.get(seq))
+            return false;
+        record = records[seq % getCapacity()];
+        return true;
+    }
+
+  protected:
+    virtual uint32_t getNow() const override { return now; }
+
+  private:
+    std::vector<StoreForwardIndexEntry> entries;
+    std::vector<PacketHistoryStruct> records;
+};
+
+void test_storage_window_ends_now(void)
+{
+    TestStorage s(3);
+    for (uint8_t i = 1; i <= 5; i++) {
+        s.now = i * 100;
+        s.add(SENDER, NODENUM_BROADCAST, 0, &i, 1);
+    }
+
+    uint32_t out[8];
+    TEST_ASSERT_EQUAL_UINT32(3, s.query(CLIENT, 1000, 0, out, 8));
+    TEST_ASSERT_EQUAL_UINT32(3, out[0]);
+
+    s.now = 550;
+    TEST_ASSERT_EQUAL_UINT32(1, s.query(CLIENT, 100, 0, out, 8));
+    PacketHistoryStruct r;
+    TEST_ASSERT_TRUE(s.get(out[0], r));
+    TEST_ASSERT_EQUAL_UINT8(5, r.payload[0]);
+    TEST_ASSERT_FALSE(s.get(2, r));
+}
+
+/// Not a pass/fail test: times queries on a full history, to compare with the linear scan the index replaced
+void test_benchmark(void)
+{
+    const uint32_t capacity = 100000, clients = 200, queries = 10000;
+    init(capacity);
+    std::mt19937 rng(2);
+    for (uint32_t i = 0; i < 250000; i++)
+        history.add(i, rng() % clients, rng() % 20 == 0 ? NODENUM_BROADCAST : rng() % clients, 0);
+
+    uint32_t out[25];
+    struct {
+        const char *name;
+        uint32_t after;
+    } cases[] = {{"new client", 0}, {"caught up client", 249990}, {"cursor mid-history", 200000}};
+    for (auto &c : cases) {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t found = 0;
+        for (uint32_t i = 0; i < queries; i++)
+            found += history.query(i % clients, UINT32_MAX, 250000, c.after, out, 25);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / queries;
+        char msg[100];
+        snprintf(msg, sizeof(msg), "%s: %.2f us per query, %u found", c.name, us, found);
+        TEST_MESSAGE(msg);
+    }
+
+    // What a query from the middle of the history used to cost: walking every record from the cursor on
+    auto start = std::chrono::steady_clock::now();
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < queries; i++) {
+        NodeNum client = i % clients;
+        uint32_t n = 0;
+        for (uint32_t seq = 200001; seq <= history.getTotal() && n < 25; seq++) {
+            const StoreForwardIndexEntry *e = history.get(seq);
+            if (e->from != client && (e->to == client || e->to == NODENUM_BROADCAST))
+                out[n++] = seq;
+        }
+        found += n;
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / queries;
+    char msg[100];
+    snprintf(msg, sizeof(msg), "linear scan mid-history: %.2f us per query, %u found", us, found);
+    TEST_MESSAGE(msg);
+}
+
+// The Portduino framework calls these before setup(), the firmware defines them in PortduinoGlue.cpp
+void portduinoCustomInit() {}
+void portduinoSetup() {}
+
+void setup()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_add_and_get);
+    RUN_TEST(test_no_storage);
+    RUN_TEST(test_wrap_evicts_oldest);
+    RUN_TEST(test_eviction_drops_whole_chain);
+    RUN_TEST(test_query_filters_and_merges);
+    RUN_TEST(test_query_cursor_and_max);
+    RUN_TEST(test_query_window);
+    RUN_TEST(test_matches_brute_force);
+    RUN_TEST(test_storage_window_ends_now);
+    RUN_TEST(test_benchmark);
+    exit(UNITY_END());
+}
+
+void loop() {}